@@ -0,0 +1,146 @@
+/**
+ * This is the implementation file for the file attributes. Only the type and
+ * the block count (and the inode when asked for) are requested from statx,
+ * which spares network and FUSE file systems from filling in the rest. If the
+ * kernel has no statx the attributes are taken from fstatat instead.
+ *
+ * @file attributes.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include "attributes.h"
+
+// Is set to 1 the first time statx turns out to be missing (shared by every search in the process, see libmdu.h).
+static atomic_int statxUnavailable;
+
+/**
+ * Gets the attributes of a file with fstatat.
+ *
+ * @param directoryFd	The directory that the name is relative to.
+ * @param name			The name of the file.
+ * @param flags			The ATTRIBUTES flags.
+ * @param attributes	The struct that the attributes are stored in.
+ * @return 0 or -1		0 on success, -1 on failure (with errno set).
+ */
+static int getFileAttributesFallback(int directoryFd, const char *name, int flags, struct fileAttributes *attributes) {
+
+	int statFlags = AT_SYMLINK_NOFOLLOW;
+	if (flags & ATTRIBUTES_EMPTY_PATH) {
+		statFlags = statFlags | AT_EMPTY_PATH;
+	}
+
+	struct stat fileStat;
+	if (fstatat(directoryFd, name, &fileStat, statFlags) == -1) {
+		return -1;
+	}
+
+	attributes->mode = fileStat.st_mode;
+	attributes->blocks = fileStat.st_blocks;
+	attributes->device = fileStat.st_dev;
+	attributes->inode = fileStat.st_ino;
+	attributes->links = fileStat.st_nlink;
+	attributes->modified = fileStat.st_mtim;
+	attributes->changed = fileStat.st_ctim;
+	return 0;
+}
+
+/**
+ * Gets the statx mask for the attributes that the flags ask for.
+ *
+ * @param flags		The ATTRIBUTES flags.
+ * @return mask		The statx mask.
+ */
+unsigned int getStatxMask(int flags) {
+
+	// Only asks for the attributes that are needed.
+	unsigned int mask = STATX_TYPE | STATX_BLOCKS;
+	if (flags & ATTRIBUTES_INODE) {
+		mask = mask | STATX_INO | STATX_NLINK;
+	}
+	if (flags & ATTRIBUTES_TIMES) {
+		mask = mask | STATX_MTIME | STATX_CTIME;
+	}
+
+	return mask;
+}
+
+/**
+ * Gets the statx flags for the flags.
+ *
+ * @param flags			The ATTRIBUTES flags.
+ * @return statxFlags	The statx flags.
+ */
+int getStatxFlags(int flags) {
+
+	int statxFlags = AT_SYMLINK_NOFOLLOW;
+	if (flags & ATTRIBUTES_DONT_SYNC) {
+		statxFlags = statxFlags | AT_STATX_DONT_SYNC;
+	}
+	if (flags & ATTRIBUTES_EMPTY_PATH) {
+		statxFlags = statxFlags | AT_EMPTY_PATH;
+	}
+
+	return statxFlags;
+}
+
+/**
+ * Copies the attributes from a statx result.
+ *
+ * @param fileStatx		The statx result.
+ * @param mask			The mask that statx was asked for.
+ * @param attributes	The struct that the attributes are stored in.
+ * @return 0 or -1		0 on success, -1 if the file system did not give all the attributes.
+ */
+int copyStatxAttributes(const struct statx *fileStatx, unsigned int mask, struct fileAttributes *attributes) {
+
+	if ((fileStatx->stx_mask & mask) != mask) {
+		return -1;
+	}
+
+	attributes->mode = fileStatx->stx_mode;
+	attributes->blocks = fileStatx->stx_blocks;
+	attributes->device = makedev(fileStatx->stx_dev_major, fileStatx->stx_dev_minor);
+	attributes->inode = fileStatx->stx_ino;
+	attributes->links = fileStatx->stx_nlink;
+	attributes->modified.tv_sec = fileStatx->stx_mtime.tv_sec;
+	attributes->modified.tv_nsec = fileStatx->stx_mtime.tv_nsec;
+	attributes->changed.tv_sec = fileStatx->stx_ctime.tv_sec;
+	attributes->changed.tv_nsec = fileStatx->stx_ctime.tv_nsec;
+	return 0;
+}
+
+/**
+ * Gets the attributes of a file without following symbolic links.
+ *
+ * @param directoryFd	The directory that the name is relative to (or AT_FDCWD).
+ * @param name			The name of the file.
+ * @param flags			The ATTRIBUTES flags.
+ * @param attributes	The struct that the attributes are stored in.
+ * @return 0 or -1		0 on success, -1 on failure (with errno set).
+ */
+int getFileAttributes(int directoryFd, const char *name, int flags, struct fileAttributes *attributes) {
+
+	if (atomic_load_explicit(&statxUnavailable, memory_order_relaxed) == 0) {
+
+		unsigned int mask = getStatxMask(flags);
+		struct statx fileStatx;
+		if (statx(directoryFd, name, getStatxFlags(flags), mask, &fileStatx) == 0) {
+
+			// If the file system could not give all the attributes they are taken from fstatat.
+			if (copyStatxAttributes(&fileStatx, mask, attributes) == -1) {
+				return getFileAttributesFallback(directoryFd, name, flags, attributes);
+			}
+			return 0;
+		}
+
+		// Any other error than a missing statx is the files error.
+		if (errno != ENOSYS) {
+			return -1;
+		}
+		atomic_store_explicit(&statxUnavailable, 1, memory_order_relaxed);
+	}
+
+	return getFileAttributesFallback(directoryFd, name, flags, attributes);
+}
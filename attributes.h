@@ -0,0 +1,58 @@
+/**
+ * This is the header file for the file attributes, which gets the few
+ * attributes of a file that the program needs (with statx when it can).
+ *
+ * @file attributes.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef ATTRIBUTES_H
+#define ATTRIBUTES_H
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdatomic.h>
+
+// Also gets the device, inode and link count of the file.
+#define ATTRIBUTES_INODE 1
+
+// Lets the file system answer from its cache, even if it might be slightly stale.
+#define ATTRIBUTES_DONT_SYNC 2
+
+// Also gets the modification and status change times of the file.
+#define ATTRIBUTES_TIMES 4
+
+// Gets the attributes of the directory file descriptor itself (the name has to be "").
+#define ATTRIBUTES_EMPTY_PATH 8
+
+// The attributes of a file that the program uses.
+struct fileAttributes {
+	mode_t mode;
+	blkcnt_t blocks;
+	dev_t device;
+	ino_t inode;
+	nlink_t links;
+	struct timespec modified;
+	struct timespec changed;
+};
+
+// The statx result (only used through pointers outside of attributes.c).
+struct statx;
+
+// Gets the statx mask for the attributes that the flags ask for.
+unsigned int getStatxMask(int flags);
+
+// Gets the statx flags for the flags.
+int getStatxFlags(int flags);
+
+// Copies the attributes from a statx result.
+int copyStatxAttributes(const struct statx *fileStatx, unsigned int mask, struct fileAttributes *attributes);
+
+// Gets the attributes of a file (without following symbolic links).
+int getFileAttributes(int directoryFd, const char *name, int flags, struct fileAttributes *attributes);
+
+#endif
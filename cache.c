@@ -0,0 +1,435 @@
+/**
+ * This is the implementation file for the scan cache. The cache file starts
+ * with a header, followed by the directories sorted by device and inode and
+ * then the names of their subdirectories. It is mapped read-only and searched
+ * in place, so loading it costs nothing even for millions of directories.
+ *
+ * A cached directory is only reused if its modification and status change
+ * times are the same as when it was cached, which is the case as long as no
+ * entries have been added, removed or renamed in it. The subdirectories are
+ * still checked one by one (they can change without the parent changing), so
+ * the only thing that can be missed is a file that grows or shrinks in place.
+ *
+ * A new cache file is written to a temporary file and renamed over the old
+ * one, so a search that runs at the same time either maps the old file or the
+ * new one, never a half-written one.
+ *
+ * @file cache.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "cache.h"
+
+// The first bytes of a cache file (the last character is the version of the format).
+#define CACHE_MAGIC "MDUCACH1"
+
+// The header at the start of a cache file.
+struct cacheHeader {
+	char magic[8];
+	uint32_t entrySize;
+	uint32_t unused;
+	uint64_t entryAmount;
+	uint64_t namesSize;
+};
+
+/**
+ * Maps the cache file. If there is no cache file or it is not valid the cache
+ * is left empty, so that every directory gets searched.
+ *
+ * @param cache	The cache.
+ * @param path	The path of the cache file.
+ */
+void openScanCache(struct scanCache *cache, const char *path) {
+
+	memset(cache, 0, sizeof(struct scanCache));
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return;
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1 || (size_t)fileStat.st_size < sizeof(struct cacheHeader)) {
+		close(fd);
+		return;
+	}
+
+	void *map = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return;
+	}
+
+	// Checks that the file is a cache file of this format and that its sizes add up.
+	const struct cacheHeader *header = map;
+	uint64_t expectedSize = sizeof(struct cacheHeader);
+	int valid = memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) == 0 && header->entrySize == sizeof(struct cacheEntry);
+	if (valid && header->entryAmount <= ((uint64_t)fileStat.st_size)/sizeof(struct cacheEntry)) {
+		expectedSize = expectedSize + header->entryAmount*sizeof(struct cacheEntry) + header->namesSize;
+	}
+	if (!valid || expectedSize != (uint64_t)fileStat.st_size) {
+		munmap(map, fileStat.st_size);
+		return;
+	}
+
+	cache->map = map;
+	cache->mapSize = fileStat.st_size;
+	cache->entries = (const struct cacheEntry *)(header + 1);
+	cache->entryAmount = header->entryAmount;
+	cache->names = (const char *)(cache->entries + cache->entryAmount);
+	cache->namesSize = header->namesSize;
+}
+
+/**
+ * Unmaps the cache file.
+ *
+ * @param cache	The cache.
+ */
+void closeScanCache(struct scanCache *cache) {
+
+	if (cache->map != NULL) {
+		munmap(cache->map, cache->mapSize);
+	}
+	memset(cache, 0, sizeof(struct scanCache));
+}
+
+/**
+ * Calculates the checksum of a directory in the cache (FNV-1a over the entry,
+ * without its checksum, and the names of its subdirectories).
+ *
+ * @param entry		The cached directory.
+ * @param names		The names of its subdirectories.
+ * @return checksum	The checksum.
+ */
+static uint32_t getCacheEntryChecksum(const struct cacheEntry *entry, const char *names) {
+
+	struct cacheEntry copy = *entry;
+	copy.checksum = 0;
+
+	uint32_t checksum = 2166136261u;
+	const unsigned char *bytes = (const unsigned char *)&copy;
+	for (size_t i = 0; i < sizeof(copy); i++) {
+		checksum = (checksum ^ bytes[i])*16777619u;
+	}
+	bytes = (const unsigned char *)names;
+	for (uint32_t i = 0; i < entry->namesSize; i++) {
+		checksum = (checksum ^ bytes[i])*16777619u;
+	}
+
+	return checksum;
+}
+
+/**
+ * Compares two directories by device and inode.
+ *
+ * @param first		The first directory.
+ * @param second	The second directory.
+ * @return order	Less than, equal to or greater than 0.
+ */
+static int compareCacheEntries(const void *first, const void *second) {
+
+	const struct cacheEntry *firstEntry = first;
+	const struct cacheEntry *secondEntry = second;
+
+	if (firstEntry->device != secondEntry->device) {
+		return firstEntry->device < secondEntry->device ? -1 : 1;
+	}
+	if (firstEntry->inode != secondEntry->inode) {
+		return firstEntry->inode < secondEntry->inode ? -1 : 1;
+	}
+	return 0;
+}
+
+/**
+ * Finds a directory in the cache. The directory is only found if it has not
+ * changed since it was cached and its names are intact.
+ *
+ * @param cache			The cache.
+ * @param attributes	The attributes of the directory (with the inode and the times).
+ * @return entry		The cached directory or NULL.
+ */
+const struct cacheEntry *findCacheEntry(const struct scanCache *cache, const struct fileAttributes *attributes) {
+
+	if (cache->entryAmount == 0) {
+		return NULL;
+	}
+
+	struct cacheEntry key;
+	key.device = attributes->device;
+	key.inode = attributes->inode;
+
+	const struct cacheEntry *entry = bsearch(&key, cache->entries, cache->entryAmount, sizeof(struct cacheEntry), compareCacheEntries);
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	// The directory has changed since it was cached.
+	if (entry->modifiedSeconds != attributes->modified.tv_sec || entry->modifiedNanoseconds != attributes->modified.tv_nsec ||
+		entry->changedSeconds != attributes->changed.tv_sec || entry->changedNanoseconds != attributes->changed.tv_nsec) {
+		return NULL;
+	}
+
+	// Checks that the names are inside the file and that there are as many of them as there should be.
+	if (entry->namesOffset > cache->namesSize || entry->namesSize > cache->namesSize - entry->namesOffset) {
+		return NULL;
+	}
+	uint32_t nameAmount = 0;
+	const char *names = cache->names + entry->namesOffset;
+	for (uint32_t i = 0; i < entry->namesSize; i++) {
+		if (names[i] == '\0') {
+			nameAmount++;
+		}
+	}
+	if (nameAmount != entry->subdirectoryAmount || (entry->namesSize > 0 && names[entry->namesSize - 1] != '\0')) {
+		return NULL;
+	}
+	if (getCacheEntryChecksum(entry, names) != entry->checksum) {
+		return NULL;
+	}
+
+	return entry;
+}
+
+/**
+ * Gets the names of the subdirectories of a cached directory (stored one
+ * after the other).
+ *
+ * @param cache		The cache.
+ * @param entry		The cached directory.
+ * @return names	The names.
+ */
+const char *getCacheEntryNames(const struct scanCache *cache, const struct cacheEntry *entry) {
+	return cache->names + entry->namesOffset;
+}
+
+/**
+ * Initiates a cache writer. Directories that have changed after the given
+ * time are not cached, since a change within the same clock tick as the
+ * search would not change their times.
+ *
+ * @param writer	The cache writer.
+ * @param startTime	The time that the search started.
+ */
+void createCacheWriter(struct cacheWriter *writer, time_t startTime) {
+
+	memset(writer, 0, sizeof(struct cacheWriter));
+	writer->startTime = startTime;
+}
+
+/**
+ * Frees a cache writer.
+ *
+ * @param writer	The cache writer.
+ */
+void freeCacheWriter(struct cacheWriter *writer) {
+
+	free(writer->entries);
+	free(writer->names);
+	memset(writer, 0, sizeof(struct cacheWriter));
+}
+
+/**
+ * Adds a searched directory to a cache writer.
+ *
+ * @param writer				The cache writer.
+ * @param attributes			The attributes of the directory (with the inode and the times).
+ * @param fileBlocks			The blocks of the files in the directory that are not directories.
+ * @param names					The names of the subdirectories (stored one after the other).
+ * @param namesSize				The size of the names.
+ * @param subdirectoryAmount	The amount of subdirectories.
+ */
+void addCacheEntry(struct cacheWriter *writer, const struct fileAttributes *attributes, blkcnt_t fileBlocks, const char *names, size_t namesSize, int subdirectoryAmount) {
+
+	// A directory that changed while it was searched (or just before) is left out.
+	if (attributes->changed.tv_sec >= writer->startTime || attributes->modified.tv_sec >= writer->startTime || namesSize > UINT32_MAX) {
+		return;
+	}
+
+	// The entries and the names grow the same way as a name list.
+	if (writer->entryAmount == writer->entrySize) {
+		size_t newEntrySize = writer->entrySize*2 + 64;
+		struct cacheEntry *newEntries = realloc(writer->entries, newEntrySize*sizeof(struct cacheEntry));
+
+		// A directory that there is no memory for is left out (it is simply read again next time).
+		if (newEntries == NULL) {
+			return;
+		}
+
+		writer->entries = newEntries;
+		writer->entrySize = newEntrySize;
+	}
+	if (writer->namesUsed + namesSize > writer->namesSize) {
+		size_t newNamesSize = writer->namesSize*2 + namesSize + 4096;
+		char *newNames = realloc(writer->names, newNamesSize);
+
+		// Error checks the reallocation of the names.
+		if (newNames == NULL) {
+			return;
+		}
+
+		writer->names = newNames;
+		writer->namesSize = newNamesSize;
+	}
+
+	struct cacheEntry *entry = &writer->entries[writer->entryAmount];
+	memset(entry, 0, sizeof(struct cacheEntry));
+	entry->device = attributes->device;
+	entry->inode = attributes->inode;
+	entry->modifiedSeconds = attributes->modified.tv_sec;
+	entry->modifiedNanoseconds = attributes->modified.tv_nsec;
+	entry->changedSeconds = attributes->changed.tv_sec;
+	entry->changedNanoseconds = attributes->changed.tv_nsec;
+	entry->fileBlocks = fileBlocks;
+	entry->namesOffset = writer->namesUsed;
+	entry->namesSize = namesSize;
+	entry->subdirectoryAmount = subdirectoryAmount;
+
+	if (namesSize > 0) {
+		memcpy(writer->names + writer->namesUsed, names, namesSize);
+	}
+	writer->namesUsed = writer->namesUsed + namesSize;
+	writer->entryAmount++;
+}
+
+/**
+ * Writes all of a buffer to a file.
+ *
+ * @param fd		The file.
+ * @param buffer	The buffer.
+ * @param size		The size of the buffer.
+ * @return 0 or -1	0 on success, -1 on failure (with errno set).
+ */
+static int writeAll(int fd, const void *buffer, size_t size) {
+
+	const char *position = buffer;
+	while (size > 0) {
+		ssize_t written = write(fd, position, size);
+		if (written == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		position = position + written;
+		size = size - written;
+	}
+	return 0;
+}
+
+/**
+ * Writes the directories of all the writers to a new cache file. The file is
+ * written next to the old one under a temporary name and then renamed over
+ * it. If the same directory was searched more than once it is only cached
+ * once.
+ *
+ * @param path			The path of the cache file.
+ * @param writers		The cache writers (one for each thread).
+ * @param writerAmount	The amount of writers.
+ * @return 0 or -1		0 on success, -1 on failure (with errno set).
+ */
+int writeScanCache(const char *path, struct cacheWriter *writers, int writerAmount) {
+
+	// Puts the directories of all the writers together (the names are moved after each other).
+	size_t entryAmount = 0;
+	size_t namesSize = 0;
+	for (int i = 0; i < writerAmount; i++) {
+		entryAmount = entryAmount + writers[i].entryAmount;
+		namesSize = namesSize + writers[i].namesUsed;
+	}
+
+	struct cacheEntry *entries = malloc((entryAmount + 1)*sizeof(struct cacheEntry));
+	char *names = malloc(namesSize + 1);
+
+	// Error checks the allocation of the entries and the names.
+	if (entries == NULL || names == NULL) {
+		free(entries);
+		free(names);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	size_t entryIndex = 0;
+	size_t namesOffset = 0;
+	for (int i = 0; i < writerAmount; i++) {
+		for (size_t j = 0; j < writers[i].entryAmount; j++) {
+			entries[entryIndex] = writers[i].entries[j];
+			entries[entryIndex].namesOffset = entries[entryIndex].namesOffset + namesOffset;
+			entryIndex++;
+		}
+		if (writers[i].namesUsed > 0) {
+			memcpy(names + namesOffset, writers[i].names, writers[i].namesUsed);
+		}
+		namesOffset = namesOffset + writers[i].namesUsed;
+	}
+
+	// Sorts the directories and leaves out the ones that are there more than once.
+	qsort(entries, entryAmount, sizeof(struct cacheEntry), compareCacheEntries);
+	size_t uniqueAmount = 0;
+	for (size_t i = 0; i < entryAmount; i++) {
+		if (uniqueAmount == 0 || compareCacheEntries(&entries[uniqueAmount - 1], &entries[i]) != 0) {
+			entries[uniqueAmount] = entries[i];
+			entries[uniqueAmount].checksum = getCacheEntryChecksum(&entries[uniqueAmount], names + entries[uniqueAmount].namesOffset);
+			uniqueAmount++;
+		}
+	}
+
+	struct cacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.entrySize = sizeof(struct cacheEntry);
+	header.entryAmount = uniqueAmount;
+	header.namesSize = namesSize;
+
+	// The temporary file is unique for this process, so searches that run at the same time do not mix their files.
+	char *temporaryPath = malloc(strlen(path) + 32);
+	if (temporaryPath == NULL) {
+		free(entries);
+		free(names);
+		errno = ENOMEM;
+		return -1;
+	}
+	sprintf(temporaryPath, "%s.tmp.%ld", path, (long)getpid());
+
+	int result = -1;
+	int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd != -1) {
+		if (writeAll(fd, &header, sizeof(header)) == 0 && writeAll(fd, entries, uniqueAmount*sizeof(struct cacheEntry)) == 0 &&
+			writeAll(fd, names, namesSize) == 0 && fsync(fd) == 0) {
+			result = 0;
+		}
+
+		// Keeps the error from the writing if closing works.
+		int error = errno;
+		if (close(fd) == -1) {
+			result = -1;
+		}
+		else {
+			errno = error;
+		}
+
+		if (result == 0) {
+			result = rename(temporaryPath, path);
+		}
+
+		// The temporary file is removed if anything went wrong.
+		if (result == -1) {
+			error = errno;
+			unlink(temporaryPath);
+			errno = error;
+		}
+	}
+
+	free(temporaryPath);
+	free(entries);
+	free(names);
+	return result;
+}
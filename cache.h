@@ -0,0 +1,95 @@
+/**
+ * This is the header file for the scan cache, which remembers the entries of
+ * the directories from the last search so that a directory that has not
+ * changed does not have to be read again, and the files in it do not have to
+ * be checked again.
+ *
+ * @file cache.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include "attributes.h"
+#include "entries.h"
+
+/**
+ * A directory in the cache file. The entries are sorted by device and inode
+ * so that they can be searched in the mapped file without loading it.
+ */
+struct cacheEntry {
+	uint64_t device;
+	uint64_t inode;
+
+	// The directory is only reused if both times are the same as when it was cached.
+	int64_t modifiedSeconds;
+	int64_t changedSeconds;
+
+	// The blocks of the files in the directory that are not directories.
+	int64_t fileBlocks;
+
+	// Where the names of the subdirectories start in the names of the cache file.
+	uint64_t namesOffset;
+	uint32_t modifiedNanoseconds;
+	uint32_t changedNanoseconds;
+	uint32_t namesSize;
+	uint32_t subdirectoryAmount;
+
+	// A checksum of the entry and its names (a damaged entry is never reused).
+	uint32_t checksum;
+	uint32_t unused;
+};
+
+// The cache from the last search (mapped from the cache file).
+struct scanCache {
+	void *map;
+	size_t mapSize;
+	const struct cacheEntry *entries;
+	uint64_t entryAmount;
+	const char *names;
+	uint64_t namesSize;
+};
+
+// The directories that a thread has searched (written to the new cache file at the end).
+struct cacheWriter {
+	struct cacheEntry *entries;
+	size_t entryAmount;
+	size_t entrySize;
+	char *names;
+	size_t namesUsed;
+	size_t namesSize;
+
+	// Directories that have changed after the search started are not cached.
+	time_t startTime;
+};
+
+// Maps the cache file (an empty cache is used if there is no valid one).
+void openScanCache(struct scanCache *cache, const char *path);
+
+// Unmaps the cache file.
+void closeScanCache(struct scanCache *cache);
+
+// Finds an unchanged directory in the cache.
+const struct cacheEntry *findCacheEntry(const struct scanCache *cache, const struct fileAttributes *attributes);
+
+// Gets the names of the subdirectories of a cached directory.
+const char *getCacheEntryNames(const struct scanCache *cache, const struct cacheEntry *entry);
+
+// Initiates a cache writer.
+void createCacheWriter(struct cacheWriter *writer, time_t startTime);
+
+// Frees a cache writer.
+void freeCacheWriter(struct cacheWriter *writer);
+
+// Adds a searched directory to a cache writer.
+void addCacheEntry(struct cacheWriter *writer, const struct fileAttributes *attributes, blkcnt_t fileBlocks, const char *names, size_t namesSize, int subdirectoryAmount);
+
+// Writes the directories of all the writers to a new cache file.
+int writeScanCache(const char *path, struct cacheWriter *writers, int writerAmount);
+
+#endif
@@ -0,0 +1,342 @@
+/**
+ * This is the implementation file for the directory entries. The entries are
+ * read with getdents64 straight into a large buffer that each thread reuses
+ * for every directory, instead of one entry at a time with readdir.
+ *
+ * @file entries.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include "entries.h"
+
+// An entry the way getdents64 writes it into the buffer.
+struct linuxDirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+// An entry of a batch while the batch is being sorted (the three arrays of the batch are sorted together).
+struct sortedEntry {
+	ino_t inode;
+	char *name;
+	unsigned char type;
+};
+
+// The smallest entry that fits in the buffer (the header and a short name).
+#define SMALLEST_ENTRY_SIZE 24
+
+// The most entries that can be in a batch.
+#define MAX_BATCH_AMOUNT (DIRECTORY_BUFFER_SIZE/SMALLEST_ENTRY_SIZE)
+
+/**
+ * Creates a directory reader with its buffer and the arrays of its batch.
+ *
+ * @param reader	The reader.
+ * @return 0 or -1	0 on success, -1 if the memory could not be allocated (nothing has to be freed then).
+ */
+int createDirectoryReader(struct directoryReader *reader) {
+
+	reader->buffer = malloc(DIRECTORY_BUFFER_SIZE);
+	reader->batch.amount = 0;
+	reader->batch.names = malloc(MAX_BATCH_AMOUNT*sizeof(char*));
+	reader->batch.types = malloc(MAX_BATCH_AMOUNT*sizeof(unsigned char));
+	reader->batch.inodes = malloc(MAX_BATCH_AMOUNT*sizeof(ino_t));
+	reader->batch.attributes = malloc(MAX_BATCH_AMOUNT*sizeof(struct fileAttributes));
+	reader->batch.errors = malloc(MAX_BATCH_AMOUNT*sizeof(int));
+	reader->sortBuffer = NULL;
+
+	// Error checks the allocation of the buffer and the arrays.
+	if (reader->buffer == NULL || reader->batch.names == NULL || reader->batch.types == NULL || reader->batch.inodes == NULL ||
+		reader->batch.attributes == NULL || reader->batch.errors == NULL) {
+		freeDirectoryReader(reader);
+		memset(reader, 0, sizeof(*reader));
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Frees a directory reader.
+ *
+ * @param reader	The reader.
+ */
+void freeDirectoryReader(struct directoryReader *reader) {
+
+	free(reader->buffer);
+	free(reader->batch.names);
+	free(reader->batch.types);
+	free(reader->batch.inodes);
+	free(reader->batch.attributes);
+	free(reader->batch.errors);
+	free(reader->sortBuffer);
+}
+
+/**
+ * Reads the next batch of entries from a directory into the readers batch.
+ * The "." and ".." entries are left out.
+ *
+ * @param reader		The reader.
+ * @param directoryFd	The file descriptor of the directory.
+ * @return amount		The amount of entries in the batch, 0 at the end of the directory or -1 on error.
+ */
+int readEntryBatch(struct directoryReader *reader, int directoryFd) {
+
+	struct entryBatch *batch = &reader->batch;
+	batch->amount = 0;
+
+	// Reads until there is at least one entry (a buffer might only have "." and "..").
+	while (batch->amount == 0) {
+
+		long bytesRead = syscall(SYS_getdents64, directoryFd, reader->buffer, DIRECTORY_BUFFER_SIZE);
+		if (bytesRead <= 0) {
+			return bytesRead;
+		}
+
+		// Goes through the entries in the buffer.
+		long position = 0;
+		while (position < bytesRead) {
+			struct linuxDirent64 *entry = (struct linuxDirent64 *)(reader->buffer + position);
+			position = position + entry->d_reclen;
+
+			// If the current entry is not "." (link to current directory) or ".." (link to previous directory).
+			char *name = entry->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+
+			batch->names[batch->amount] = name;
+			batch->types[batch->amount] = entry->d_type;
+			batch->inodes[batch->amount] = entry->d_ino;
+			batch->amount++;
+		}
+	}
+
+	return batch->amount;
+}
+
+/**
+ * Compares two entries by their inode numbers (for qsort).
+ *
+ * @param first		The first entry.
+ * @param second	The second entry.
+ * @return order	Less than, equal to or greater than 0.
+ */
+static int compareInodes(const void *first, const void *second) {
+
+	ino_t firstInode = ((const struct sortedEntry *)first)->inode;
+	ino_t secondInode = ((const struct sortedEntry *)second)->inode;
+	return (firstInode > secondInode) - (firstInode < secondInode);
+}
+
+/**
+ * Sorts the readers batch by inode number, so that the inodes are read
+ * from the disk in order instead of in the order of the directory (which
+ * turns the seeks over the inode table of a spinning disk into mostly
+ * sequential reads). If there is no memory for the sorting the batch is
+ * left as it is.
+ *
+ * @param reader	The reader.
+ */
+void sortEntryBatch(struct directoryReader *reader) {
+
+	struct entryBatch *batch = &reader->batch;
+	if (batch->amount < 2) {
+		return;
+	}
+
+	if (reader->sortBuffer == NULL) {
+		reader->sortBuffer = malloc(MAX_BATCH_AMOUNT*sizeof(struct sortedEntry));
+		if (reader->sortBuffer == NULL) {
+			return;
+		}
+	}
+
+	struct sortedEntry *entries = reader->sortBuffer;
+	for (int index = 0; index < batch->amount; index++) {
+		entries[index].inode = batch->inodes[index];
+		entries[index].name = batch->names[index];
+		entries[index].type = batch->types[index];
+	}
+
+	qsort(entries, batch->amount, sizeof(struct sortedEntry), compareInodes);
+
+	for (int index = 0; index < batch->amount; index++) {
+		batch->inodes[index] = entries[index].inode;
+		batch->names[index] = entries[index].name;
+		batch->types[index] = entries[index].type;
+	}
+}
+
+/**
+ * Puts the next names from a list of names (stored one after the other) into
+ * the readers batch. Used for directories whose entries are already known,
+ * so that they can be checked the same way as the entries that are read.
+ *
+ * @param reader	The reader.
+ * @param names		The names that are left (moved past the names that are put into the batch).
+ * @param amount	The amount of names that are left (lowered the same way).
+ * @return amount	The amount of entries in the batch (0 when there are no names left).
+ */
+int readNameBatch(struct directoryReader *reader, const char **names, int *amount) {
+
+	struct entryBatch *batch = &reader->batch;
+	batch->amount = 0;
+
+	while (*amount > 0 && batch->amount < MAX_BATCH_AMOUNT) {
+		batch->names[batch->amount] = (char *)*names;
+		batch->types[batch->amount] = DT_UNKNOWN;
+		batch->inodes[batch->amount] = 0;
+		batch->amount++;
+
+		*names = *names + strlen(*names) + 1;
+		*amount = *amount - 1;
+	}
+
+	return batch->amount;
+}
+
+/**
+ * Adds a copy of a name to a name list. The names are stored one after the
+ * other in a buffer that doubles in size when it is full.
+ *
+ * @param list		The name list.
+ * @param name		The name.
+ * @param blocks	The block amount of the file that the name belongs to.
+ * @return 0 or -1	0 on success, -1 if the list could not grow (the list is left as it was).
+ */
+int addName(struct nameList *list, const char *name, blkcnt_t blocks) {
+
+	size_t nameLength = strlen(name) + 1;
+	if (list->used + nameLength > list->size) {
+		size_t newSize = list->size*2;
+		if (newSize < list->used + nameLength) {
+			newSize = list->used + nameLength + 256;
+		}
+
+		char *newNames = realloc(list->names, newSize);
+
+		// Error checks the reallocation of the names.
+		if (newNames == NULL) {
+			return -1;
+		}
+
+		list->names = newNames;
+		list->size = newSize;
+	}
+
+	// The block amounts are kept in an array of their own that grows the same way.
+	if (list->amount == list->blockSize) {
+		int newBlockSize = list->blockSize*2 + 16;
+		blkcnt_t *newBlocks = realloc(list->blocks, newBlockSize*sizeof(blkcnt_t));
+
+		// Error checks the reallocation of the block amounts.
+		if (newBlocks == NULL) {
+			return -1;
+		}
+
+		list->blocks = newBlocks;
+		list->blockSize = newBlockSize;
+	}
+
+	memcpy(list->names + list->used, name, nameLength);
+	list->used = list->used + nameLength;
+	list->blocks[list->amount] = blocks;
+	list->amount++;
+	return 0;
+}
+
+/**
+ * Empties a name list. The memory is kept so that the list can be filled
+ * again without growing.
+ *
+ * @param list	The name list.
+ */
+void clearNameList(struct nameList *list) {
+
+	list->used = 0;
+	list->amount = 0;
+}
+
+/**
+ * Frees the names in a name list.
+ *
+ * @param list	The name list.
+ */
+void freeNameList(struct nameList *list) {
+
+	free(list->names);
+	free(list->blocks);
+	list->names = NULL;
+	list->blocks = NULL;
+	list->used = 0;
+	list->size = 0;
+	list->amount = 0;
+	list->blockSize = 0;
+}
+
+/**
+ * Puts together the full path of a file/directory from its name and the
+ * names of its parents (a name that already ends with a slash gets no extra
+ * one). The links of the chain can be of any kind, the getter gives the name
+ * of a link and its parent.
+ *
+ * @param link		The file/directory at the end of the chain.
+ * @param getName	Gives the name of a link and sets its parent (NULL for the first name of the path).
+ * @return fullPath	The full path (has to be freed by the caller, NULL if there was no memory for it).
+ */
+char *getChainPath(const void *link, const char *(*getName)(const void *link, const void **parent)) {
+
+	// Counts the length of the full path (with the slashes and the terminating null byte).
+	size_t length = 1;
+	const void *parent = NULL;
+	for (const void *current = link; current != NULL; current = parent) {
+		const char *name = getName(current, &parent);
+		size_t nameLength = strlen(name);
+		length = length + nameLength;
+		if (current != link && nameLength > 0 && name[nameLength - 1] != '/') {
+			length++;
+		}
+	}
+
+	char *fullPath = malloc(length);
+
+	// Error checks the allocation of the full path.
+	if (fullPath == NULL) {
+		return NULL;
+	}
+
+	// Copies the names from the end of the path towards the start (each one only if it fits in what is left of the path).
+	length--;
+	fullPath[length] = '\0';
+	for (const void *current = link; current != NULL; current = parent) {
+		const char *name = getName(current, &parent);
+		size_t nameLength = strlen(name);
+		size_t slashLength = current != link && nameLength > 0 && name[nameLength - 1] != '/' ? 1 : 0;
+		if (nameLength + slashLength > length) {
+			free(fullPath);
+			return NULL;
+		}
+		length = length - slashLength;
+		if (slashLength == 1) {
+			fullPath[length] = '/';
+		}
+		length = length - nameLength;
+		memcpy(fullPath + length, name, nameLength);
+	}
+
+	return fullPath;
+}
@@ -0,0 +1,83 @@
+/**
+ * This is the header file for the directory entries, which reads the entries
+ * of a directory in large batches with getdents64.
+ *
+ * @file entries.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef ENTRIES_H
+#define ENTRIES_H
+
+#include <sys/types.h>
+#include "attributes.h"
+
+// The size of the buffer that the entries are read into.
+#define DIRECTORY_BUFFER_SIZE (128*1024)
+
+/**
+ * A batch of entries from a directory. The names point into the readers
+ * buffer, so they are only valid until the next batch is read.
+ */
+struct entryBatch {
+	int amount;
+	char **names;
+	unsigned char *types;
+	ino_t *inodes;
+
+	// The attributes of the entries (filled in by the one checking the batch).
+	struct fileAttributes *attributes;
+	int *errors;
+};
+
+// An entry of a batch while the batch is being sorted.
+struct sortedEntry;
+
+// Reads the entries of directories into a buffer that is reused for every directory.
+struct directoryReader {
+	char *buffer;
+	struct entryBatch batch;
+
+	// The memory that a batch is sorted in (only allocated once a batch is sorted).
+	struct sortedEntry *sortBuffer;
+};
+
+// A list of names that are copied out of a batch (so they outlive it) and the block amounts of their files.
+struct nameList {
+	char *names;
+	size_t used;
+	size_t size;
+	blkcnt_t *blocks;
+	int amount;
+	int blockSize;
+};
+
+// Creates a directory reader.
+int createDirectoryReader(struct directoryReader *reader);
+
+// Frees a directory reader.
+void freeDirectoryReader(struct directoryReader *reader);
+
+// Reads the next batch of entries from a directory.
+int readEntryBatch(struct directoryReader *reader, int directoryFd);
+
+// Sorts the readers batch by inode number.
+void sortEntryBatch(struct directoryReader *reader);
+
+// Puts the next names from a list of names into the readers batch (instead of reading them from the directory).
+int readNameBatch(struct directoryReader *reader, const char **names, int *amount);
+
+// Adds a copy of a name (and the block amount of its file) to a name list.
+int addName(struct nameList *list, const char *name, blkcnt_t blocks);
+
+// Empties a name list (the memory is kept for the next names).
+void clearNameList(struct nameList *list);
+
+// Frees the names in a name list.
+void freeNameList(struct nameList *list);
+
+// Puts together the full path of a file/directory from a chain of names that leads up to it.
+char *getChainPath(const void *link, const char *(*getName)(const void *link, const void **parent));
+
+#endif
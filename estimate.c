@@ -0,0 +1,634 @@
+/**
+ * This is the implementation file for the estimate. Each file/directory is
+ * read one level at a time with the parallel search, where the search only
+ * collects the subdirectories of the level instead of going into them. Once a
+ * level would make too much read whole (or half the time has gone) it is
+ * sampled: a probe starts at a random directory of the level and goes down
+ * one random subdirectory at a time, and what it finds in each directory is
+ * multiplied by the amount of choices that led there. The probes are
+ * unbiased, so their mean estimates the rest of the tree and their spread
+ * gives a confidence interval. The threads run probes until the interval is
+ * narrow enough or the time is up.
+ *
+ * @file estimate.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "search.h"
+#include "estimate.h"
+#include "entries.h"
+#include "uring.h"
+#include "stats.h"
+
+/**
+ * The probes of one file/directory, shared by the threads. The sums are only
+ * touched with the lock held, once for each probe.
+ */
+struct estimateProbes {
+
+	// The directories that the probes start from (the widest level that was collected) and their own blocks.
+	char **paths;
+	blkcnt_t *blocks;
+	int amount;
+
+	// What the probes need to check the entries the same way as the search.
+	const struct excludeMatcher *exclude;
+	int attributeFlags;
+	int oneFileSystem;
+	dev_t device;
+
+	// When the probes stop.
+	blkcnt_t exactBlocks;
+	double accuracy;
+	long long deadline;
+	atomic_int done;
+
+	pthread_mutex_t mutex;
+	long long probeAmount;
+	long long directories;
+	double sum;
+	double squareSum;
+
+	// Set if a probe ran out of memory (the estimate then fails).
+	atomic_int failed;
+};
+
+// What each thread that runs probes needs.
+struct probeThread {
+	struct estimateProbes *probes;
+	int useUring;
+	uint64_t random;
+	struct directoryReader reader;
+	struct statRing ring;
+	struct statRing *ringPointer;
+	struct nameList subdirectories;
+};
+
+/**
+ * Gets the next random number of a thread (xorshift64*).
+ *
+ * @param thread	The thread.
+ * @return random	The number.
+ */
+static uint64_t getRandom(struct probeThread *thread) {
+
+	thread->random ^= thread->random >> 12;
+	thread->random ^= thread->random << 25;
+	thread->random ^= thread->random >> 27;
+	return thread->random*0x2545f4914f6cdd1dULL;
+}
+
+/**
+ * Gets the square root of a number with Newton's method.
+ *
+ * @param value		The number.
+ * @return root		The square root (0 for a number that is not above 0).
+ */
+static double getSquareRoot(double value) {
+
+	if (!(value > 0)) {
+		return 0;
+	}
+
+	double root = value > 1 ? value : 1;
+	for (int round = 0; round < 100; round++) {
+		double next = (root + value/root)/2;
+		if (next >= root) {
+			break;
+		}
+		root = next;
+	}
+	return root;
+}
+
+/**
+ * Reads a directory for a probe: adds up the blocks of the files in it and
+ * collects the subdirectories (with their own blocks) in the threads list.
+ * The entries are left out the same way as in the search, and an entry that
+ * can not be checked is skipped.
+ *
+ * @param thread		The thread.
+ * @param directoryFd	The file descriptor of the directory.
+ * @return blockAmount	The blocks of the files in the directory.
+ */
+static blkcnt_t readProbeDirectory(struct probeThread *thread, int directoryFd) {
+
+	struct estimateProbes *probes = thread->probes;
+	struct entryBatch *batch = &thread->reader.batch;
+	blkcnt_t blockAmount = 0;
+
+	while (readEntryBatch(&thread->reader, directoryFd) > 0) {
+		if (probes->exclude != NULL) {
+			filterEntryBatch(probes->exclude, batch);
+		}
+		getBatchAttributes(thread->ringPointer, directoryFd, batch->names, batch->amount, probes->attributeFlags, batch->attributes, batch->errors, NULL);
+
+		for (int index = 0; index < batch->amount; index++) {
+			if (batch->errors[index] != 0) {
+				continue;
+			}
+			if (!S_ISDIR(batch->attributes[index].mode)) {
+				blockAmount = batch->attributes[index].blocks + blockAmount;
+			}
+			else if (probes->oneFileSystem == 0 || batch->attributes[index].device == probes->device) {
+				if (addName(&thread->subdirectories, batch->names[index], batch->attributes[index].blocks) == -1) {
+					atomic_store(&probes->failed, 1);
+				}
+			}
+		}
+	}
+
+	return blockAmount;
+}
+
+/**
+ * Runs one probe. It starts at a random directory of the widest level and
+ * goes down through one random subdirectory at a time until it reaches a
+ * directory without subdirectories. The weight of a directory is the product
+ * of the amounts of choices on the way to it (one over the chance of getting
+ * there), so the weighted sum of what the probe finds is on average the size
+ * of everything below the level.
+ *
+ * @param thread		The thread.
+ * @param directories	Where the amount of directories that the probe read is stored.
+ * @return estimate		The estimate of the probe.
+ */
+static double runProbe(struct probeThread *thread, long long *directories) {
+
+	struct estimateProbes *probes = thread->probes;
+	int choice = getRandom(thread) % probes->amount;
+	double weight = probes->amount;
+	blkcnt_t ownBlocks = probes->blocks[choice];
+	int directoryFd = open(probes->paths[choice], O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+	double estimate = 0;
+	*directories = 0;
+	while (1) {
+
+		// A directory that can not be opened still counts with its own blocks, the same way as in the search.
+		blkcnt_t blockAmount = ownBlocks;
+		clearNameList(&thread->subdirectories);
+		if (directoryFd != -1) {
+			blockAmount = readProbeDirectory(thread, directoryFd) + blockAmount;
+			*directories = *directories + 1;
+		}
+		estimate = estimate + weight*blockAmount;
+
+		if (directoryFd == -1 || thread->subdirectories.amount == 0) {
+			break;
+		}
+
+		// Goes down into a random subdirectory.
+		int amount = thread->subdirectories.amount;
+		choice = getRandom(thread) % amount;
+		const char *name = thread->subdirectories.names;
+		for (int index = 0; index < choice; index++) {
+			name = name + strlen(name) + 1;
+		}
+		weight = weight*amount;
+		ownBlocks = thread->subdirectories.blocks[choice];
+
+		int subdirectoryFd = openat(directoryFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		close(directoryFd);
+		directoryFd = subdirectoryFd;
+	}
+
+	if (directoryFd != -1) {
+		close(directoryFd);
+	}
+	return estimate;
+}
+
+/**
+ * Checks if the probes can stop (the caller holds the lock): the time is up,
+ * or there are enough probes and half the confidence interval is at most the
+ * wanted part of the whole estimate.
+ *
+ * @param probes	The probes.
+ * @return done		1 if they can stop, otherwise 0.
+ */
+static int isEstimateDone(struct estimateProbes *probes) {
+
+	if (probes->deadline > 0 && getStatisticsTime() >= probes->deadline) {
+		return 1;
+	}
+	if (probes->accuracy == 0 || probes->probeAmount < ESTIMATE_MIN_PROBES) {
+		return 0;
+	}
+
+	// Compared squared (the variance of the mean against the square of the allowed margin).
+	double amount = probes->probeAmount;
+	double mean = probes->sum/amount;
+	double variance = (probes->squareSum - amount*mean*mean)/(amount - 1);
+	double allowed = probes->accuracy*(probes->exactBlocks + mean)/ESTIMATE_Z;
+	return variance/amount <= allowed*allowed;
+}
+
+/**
+ * Runs probes until the estimate is done (the function of the threads).
+ *
+ * @param info	The thread.
+ */
+static void *runProbes(void *info) {
+
+	struct probeThread *thread = (struct probeThread *)info;
+	struct estimateProbes *probes = thread->probes;
+
+	while (!atomic_load(&probes->done) && !atomic_load(&probes->failed)) {
+		long long directories;
+		double estimate = runProbe(thread, &directories);
+
+		pthread_mutex_lock(&probes->mutex);
+		probes->probeAmount++;
+		probes->directories = probes->directories + directories;
+		probes->sum = probes->sum + estimate;
+		probes->squareSum = probes->squareSum + estimate*estimate;
+		if (isEstimateDone(probes)) {
+			atomic_store(&probes->done, 1);
+		}
+		pthread_mutex_unlock(&probes->mutex);
+	}
+
+	return NULL;
+}
+
+/**
+ * Samples everything below the widest level with probes in several threads.
+ * The threads that could not be set up are left out (the estimate fails if
+ * none could).
+ *
+ * @param probes		The probes.
+ * @param threadAmount	The amount of threads.
+ * @param useUring		If the threads check the entries through io_uring.
+ * @return result		MDU_SUCCESS, MDU_ERROR_MEMORY or MDU_ERROR_THREAD.
+ */
+static int sampleFrontier(struct estimateProbes *probes, int threadAmount, int useUring) {
+
+	struct probeThread *threads = calloc(threadAmount, sizeof(struct probeThread));
+	pthread_t *threadIds = calloc(threadAmount, sizeof(pthread_t));
+	if (threads == NULL || threadIds == NULL) {
+		free(threads);
+		free(threadIds);
+		return MDU_ERROR_MEMORY;
+	}
+
+	int result = MDU_SUCCESS;
+	int started = 0;
+	for (int index = 0; index < threadAmount; index++) {
+		struct probeThread *thread = &threads[index];
+		thread->probes = probes;
+		thread->random = (uint64_t)getStatisticsTime() ^ ((uint64_t)(index + 1)*0x9e3779b97f4a7c15ULL);
+		if (thread->random == 0) {
+			thread->random = 1;
+		}
+		if (createDirectoryReader(&thread->reader) == -1) {
+			result = MDU_ERROR_MEMORY;
+			break;
+		}
+		if (useUring && createStatRing(&thread->ring) == 0) {
+			thread->ringPointer = &thread->ring;
+		}
+
+		int createCheck = pthread_create(&threadIds[index], NULL, runProbes, thread);
+		if (createCheck != 0) {
+			errno = createCheck;
+			freeDirectoryReader(&thread->reader);
+			if (thread->ringPointer != NULL) {
+				destroyStatRing(thread->ringPointer);
+			}
+			result = MDU_ERROR_THREAD;
+			break;
+		}
+		started++;
+	}
+
+	// The threads that are running are enough (the probes just take longer).
+	if (started > 0) {
+		result = MDU_SUCCESS;
+	}
+	else if (result != MDU_SUCCESS) {
+		free(threads);
+		free(threadIds);
+		return result;
+	}
+
+	for (int index = 0; index < started; index++) {
+		pthread_join(threadIds[index], NULL);
+		freeDirectoryReader(&threads[index].reader);
+		freeNameList(&threads[index].subdirectories);
+		if (threads[index].ringPointer != NULL) {
+			destroyStatRing(threads[index].ringPointer);
+		}
+	}
+
+	free(threads);
+	free(threadIds);
+	if (atomic_load(&probes->failed)) {
+		return MDU_ERROR_MEMORY;
+	}
+	return result;
+}
+
+/**
+ * Reads one level of a file/directory whole with the parallel search. The
+ * subdirectories of the level are collected (with their own blocks) instead
+ * of being searched, and become the next level.
+ *
+ * @param levelScanner	The scanner for the levels (nothing is handed over from it but the errors).
+ * @param level			The paths of the directories of the level.
+ * @param levelAmount	The amount of directories of the level.
+ * @param exclude		The exclude patterns (NULL if there are none).
+ * @param blockAmount	Where the blocks of the level are added.
+ * @param next			The list that the next level is collected in (emptied first).
+ * @param links			The files with more than one link that the levels have counted (NULL if every link counts).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the search.
+ */
+static int readEstimateLevel(struct mduScanner *levelScanner, char **level, int levelAmount, const struct excludeMatcher *exclude, blkcnt_t *blockAmount, struct nameList *next, struct linkSet *links) {
+
+	int threadAmount = levelScanner->threadAmount;
+	struct nameList *frontiers = calloc(threadAmount, sizeof(struct nameList));
+	blkcnt_t *levelAmounts = malloc(levelAmount*sizeof(blkcnt_t));
+	if (frontiers == NULL || levelAmounts == NULL) {
+		free(frontiers);
+		free(levelAmounts);
+		return MDU_ERROR_MEMORY;
+	}
+
+	int result = calculateSizeOnDiskParallel(levelScanner, level, levelAmount, levelAmounts, exclude, frontiers, links);
+	if (result >= 0) {
+		for (int index = 0; index < levelAmount; index++) {
+			*blockAmount = levelAmounts[index] + *blockAmount;
+		}
+	}
+
+	// Moves the subdirectories that the threads collected into one list.
+	clearNameList(next);
+	for (int threadIndex = 0; threadIndex < threadAmount; threadIndex++) {
+		const char *name = frontiers[threadIndex].names;
+		for (int index = 0; index < frontiers[threadIndex].amount && result >= 0; index++) {
+			if (addName(next, name, frontiers[threadIndex].blocks[index]) == -1) {
+				result = MDU_ERROR_MEMORY;
+			}
+			name = name + strlen(name) + 1;
+		}
+		freeNameList(&frontiers[threadIndex]);
+	}
+
+	free(frontiers);
+	free(levelAmounts);
+	return result;
+}
+
+/**
+ * Gets the pointers to the names of a name list.
+ *
+ * @param list		The name list.
+ * @return paths	The pointers (NULL if there was no memory for them).
+ */
+static char **getNamePointers(struct nameList *list) {
+
+	char **paths = malloc((list->amount + 1)*sizeof(char *));
+	if (paths == NULL) {
+		return NULL;
+	}
+
+	char *name = list->names;
+	for (int index = 0; index < list->amount; index++) {
+		paths[index] = name;
+		name = name + strlen(name) + 1;
+	}
+	return paths;
+}
+
+/**
+ * Estimates the size of one file/directory. The levels are read whole for as
+ * long as not too many directories have been read and less than half of the
+ * time of the file/directory has gone, and what is below the
+ * last level that was collected is sampled with probes.
+ *
+ * @param scanner		The scanner of the search.
+ * @param levelScanner	The scanner for the levels.
+ * @param file			The file/directory.
+ * @param exclude		The exclude patterns (NULL if there are none).
+ * @param deadline		When the estimate of the file/directory has to be done (0 for no time limit).
+ * @param estimate		Where the estimate is stored.
+ * @param links			The files with more than one link that the levels have counted (NULL if every link counts).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the estimate.
+ */
+static int estimateFile(struct mduScanner *scanner, struct mduScanner *levelScanner, char *file, const struct excludeMatcher *exclude, long long deadline, struct mduEstimate *estimate, struct linkSet *links) {
+
+	long long startTime = getStatisticsTime();
+	struct nameList levels[2];
+	memset(levels, 0, sizeof(levels));
+	char **level = &file;
+	int levelAmount = 1;
+	int current = 0;
+	int result = MDU_SUCCESS;
+	memset(estimate, 0, sizeof(*estimate));
+
+	// Reads the levels whole until there are no more or the next one is to be sampled.
+	while (levelAmount > 0) {
+		int levelResult = readEstimateLevel(levelScanner, level, levelAmount, exclude, &estimate->exactBlocks, &levels[current], links);
+		estimate->directories = estimate->directories + levelAmount;
+		if (level != &file) {
+			free(level);
+		}
+		if (levelResult < 0) {
+			freeNameList(&levels[0]);
+			freeNameList(&levels[1]);
+			return levelResult;
+		}
+		if (levelResult == MDU_INCOMPLETE) {
+			result = MDU_INCOMPLETE;
+		}
+
+		levelAmount = levels[current].amount;
+		level = getNamePointers(&levels[current]);
+		if (level == NULL) {
+			freeNameList(&levels[0]);
+			freeNameList(&levels[1]);
+			return MDU_ERROR_MEMORY;
+		}
+
+		// The level is sampled if reading it would make too much read whole or if half of the time has gone.
+		if (estimate->directories + levelAmount > ESTIMATE_EXACT_DIRECTORIES || (deadline > 0 && getStatisticsTime() - startTime > (deadline - startTime)/2)) {
+			break;
+		}
+		current = 1 - current;
+	}
+
+	estimate->blocks = estimate->exactBlocks;
+	if (levelAmount > 0) {
+
+		// The probes need the file system of the file/directory for -x.
+		struct fileAttributes fileStat;
+		fileStat.device = 0;
+		if (scanner->options.oneFileSystem != 0 && getFileAttributes(AT_FDCWD, file, 0, &fileStat) == -1) {
+			scanner->errorNumber = errno;
+			free(scanner->errorPath);
+			scanner->errorPath = strdup(file);
+			free(level);
+			freeNameList(&levels[0]);
+			freeNameList(&levels[1]);
+			return MDU_ERROR_STAT;
+		}
+
+		struct estimateProbes probes;
+		memset(&probes, 0, sizeof(probes));
+		probes.paths = level;
+		probes.blocks = levels[current].blocks;
+		probes.amount = levelAmount;
+		probes.exclude = exclude;
+		probes.attributeFlags = getAttributeFlags(&scanner->options);
+		probes.oneFileSystem = scanner->options.oneFileSystem;
+		probes.device = fileStat.device;
+		probes.exactBlocks = estimate->exactBlocks;
+		probes.accuracy = scanner->options.estimateAccuracy;
+		probes.deadline = deadline;
+		atomic_init(&probes.done, 0);
+		atomic_init(&probes.failed, 0);
+		pthread_mutex_init(&probes.mutex, NULL);
+
+		int sampleResult = sampleFrontier(&probes, levelScanner->threadAmount, scanner->options.ioUring);
+		pthread_mutex_destroy(&probes.mutex);
+		if (sampleResult < 0) {
+			scanner->errorNumber = sampleResult == MDU_ERROR_MEMORY ? ENOMEM : errno;
+			free(level);
+			freeNameList(&levels[0]);
+			freeNameList(&levels[1]);
+			return sampleResult;
+		}
+
+		// The mean of the probes estimates everything below the levels, and their spread how far off it might be (unknown if the time ran out before there were enough probes).
+		double amount = probes.probeAmount;
+		double mean = probes.sum/amount;
+		estimate->blocks = estimate->exactBlocks + (blkcnt_t)(mean + 0.5);
+		estimate->margin = -1;
+		if (probes.probeAmount >= ESTIMATE_MIN_PROBES) {
+			double variance = (probes.squareSum - amount*mean*mean)/(amount - 1);
+			estimate->margin = (blkcnt_t)(ESTIMATE_Z*getSquareRoot(variance/amount) + 0.5);
+		}
+		estimate->probes = probes.probeAmount;
+		estimate->directories = estimate->directories + probes.directories;
+	}
+
+	free(level);
+	freeNameList(&levels[0]);
+	freeNameList(&levels[1]);
+	return result;
+}
+
+/**
+ * Estimates the size of each file/directory in a list. The time of the search
+ * is shared out between the files/directories as it goes (one that finishes
+ * early leaves its time to the ones after it). The estimates are handed over
+ * as the totals, and the confidence intervals are kept in the scanner.
+ *
+ * @param scanner		The scanner of the search.
+ * @param files			The list of files/directories.
+ * @param fileAmount	The amount of files/directories.
+ * @param blockAmounts	Where the estimate of each file/directory is stored.
+ * @param exclude		The exclude patterns (NULL if there are none).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the estimate.
+ */
+int estimateSizeOnDisk(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts, const struct excludeMatcher *exclude) {
+
+	long long startTime = getStatisticsTime();
+	scanner->estimates = calloc(fileAmount + 1, sizeof(struct mduEstimate));
+	if (scanner->estimates == NULL) {
+		scanner->errorNumber = ENOMEM;
+		return MDU_ERROR_MEMORY;
+	}
+
+	/**
+	 * The levels are read by a scanner of their own that only hands over the
+	 * errors. A file with more than one link is counted once in all the levels
+	 * of all the files/directories (the same way as in a whole search), but the
+	 * probes can not know which links have been seen, so below the levels every
+	 * link counts.
+	 */
+	struct linkSet links;
+	struct linkSet *linkPointer = NULL;
+	if (scanner->options.countLinks == 0) {
+		createLinkSet(&links);
+		linkPointer = &links;
+	}
+	struct mduScanner levelScanner;
+	mduInitScanner(&levelScanner);
+	levelScanner.options.fast = scanner->options.fast;
+	levelScanner.options.ioUring = scanner->options.ioUring;
+	levelScanner.options.inodeOrder = scanner->options.inodeOrder;
+	levelScanner.options.maxQueue = scanner->options.maxQueue;
+	levelScanner.options.oneFileSystem = scanner->options.oneFileSystem;
+	levelScanner.options.countLinks = scanner->options.countLinks;
+	levelScanner.options.minimumThreads = scanner->options.minimumThreads;
+	levelScanner.options.maximumThreads = scanner->options.maximumThreads;
+	levelScanner.threadAmount = scanner->threadAmount > 0 ? scanner->threadAmount : 1;
+	levelScanner.callbacks.error = scanner->callbacks.error;
+	levelScanner.callbacks.flush = scanner->callbacks.flush;
+	levelScanner.callbacks.data = scanner->callbacks.data;
+
+	long long scanDeadline = 0;
+	if (scanner->options.estimateSeconds > 0) {
+		scanDeadline = startTime + (long long)(scanner->options.estimateSeconds*1e9);
+	}
+
+	int result = MDU_SUCCESS;
+	for (int index = 0; index < fileAmount; index++) {
+
+		// Each file/directory gets an even share of the time that is left.
+		long long deadline = 0;
+		if (scanDeadline > 0) {
+			long long now = getStatisticsTime();
+			deadline = now + (scanDeadline - now)/(fileAmount - index);
+		}
+
+		int fileResult = estimateFile(scanner, &levelScanner, files[index], exclude, deadline, &scanner->estimates[index], linkPointer);
+
+		// The error of a level is moved over to the scanner.
+		if (levelScanner.errorPath != NULL || fileResult < 0) {
+			if (levelScanner.errorNumber != 0) {
+				scanner->errorNumber = levelScanner.errorNumber;
+			}
+			if (levelScanner.errorPath != NULL) {
+				free(scanner->errorPath);
+				scanner->errorPath = levelScanner.errorPath;
+				levelScanner.errorPath = NULL;
+			}
+		}
+		if (fileResult < 0) {
+			result = fileResult;
+			break;
+		}
+		if (fileResult == MDU_INCOMPLETE) {
+			result = MDU_INCOMPLETE;
+		}
+
+		scanner->estimateAmount = index + 1;
+		if (blockAmounts != NULL) {
+			blockAmounts[index] = scanner->estimates[index].blocks;
+		}
+		if (scanner->callbacks.directory != NULL) {
+			scanner->callbacks.directory(scanner->callbacks.data, files[index], scanner->estimates[index].blocks, 0);
+		}
+	}
+
+	if (scanner->callbacks.flush != NULL) {
+		scanner->callbacks.flush(scanner->callbacks.data);
+	}
+	mduFreeScanner(&levelScanner);
+	if (linkPointer != NULL) {
+		freeLinkSet(linkPointer);
+	}
+	scanner->nanoseconds = getStatisticsTime() - startTime;
+	return result;
+}
@@ -0,0 +1,30 @@
+/**
+ * This is the header file for the estimate, which gives the size of a huge
+ * tree from a small part of it: the directories near the top are read whole
+ * with the parallel search, and what is below them is sampled with random
+ * probes (Knuth's estimate of the size of a tree).
+ *
+ * @file estimate.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include "libmdu.h"
+#include "exclude.h"
+
+// The levels near the top are read whole as long as at most this many directories of a file/directory have been read in all (the rest is sampled).
+#define ESTIMATE_EXACT_DIRECTORIES 16384
+
+// The least amount of probes before the confidence interval is trusted.
+#define ESTIMATE_MIN_PROBES 32
+
+// The z value of a 95% confidence interval.
+#define ESTIMATE_Z 1.96
+
+// Estimates the size of each file/directory.
+int estimateSizeOnDisk(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts, const struct excludeMatcher *exclude);
+
+#endif
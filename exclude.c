@@ -0,0 +1,215 @@
+/**
+ * This is the implementation file for the exclude matcher. The names of the
+ * entries are checked right after they have been read, before anything is
+ * asked about them, so an excluded file costs no stat call and an excluded
+ * directory is never opened.
+ *
+ * @file exclude.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include "exclude.h"
+
+/**
+ * Checks if a string has any of the characters that make a pattern more than
+ * plain bytes.
+ *
+ * @param string	The string.
+ * @param length	The length of the string.
+ * @return special	1 if it has one, otherwise 0.
+ */
+static int hasSpecialCharacters(const char *string, size_t length) {
+
+	for (size_t index = 0; index < length; index++) {
+		if (string[index] == '*' || string[index] == '?' || string[index] == '[' || string[index] == '\\') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Hashes a name (FNV-1a) and gets its length at the same time.
+ *
+ * @param name		The name.
+ * @param length	Where the length of the name is stored.
+ * @return hash		The hash of the name.
+ */
+static unsigned int hashName(const char *name, size_t *length) {
+
+	unsigned int hash = 2166136261u;
+	const unsigned char *byte = (const unsigned char *)name;
+	while (*byte != '\0') {
+		hash = (hash ^ *byte)*16777619u;
+		byte++;
+	}
+	*length = byte - (const unsigned char *)name;
+	return hash;
+}
+
+/**
+ * Creates an exclude matcher. A pattern is matched against the name of an
+ * entry (not its path), the same way as fnmatch without any flags, so it
+ * can not have a '/' in it.
+ *
+ * @param matcher		The matcher.
+ * @param patterns		The patterns (they have to outlive the matcher).
+ * @param patternAmount	The amount of patterns (0 gives a matcher that matches nothing).
+ * @return 0 or -1		0 on success, -1 on failure (with errno set to EINVAL for a pattern that is empty or has a '/' in it, otherwise to ENOMEM).
+ */
+int createExcludeMatcher(struct excludeMatcher *matcher, char **patterns, int patternAmount) {
+
+	memset(matcher, 0, sizeof(*matcher));
+	for (int index = 0; index < patternAmount; index++) {
+		if (patterns[index][0] == '\0' || strchr(patterns[index], '/') != NULL) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	if (patternAmount == 0) {
+		return 0;
+	}
+
+	// The hash table is at least twice the size of the names, so that the probe sequences stay short.
+	unsigned int tableSize = 4;
+	while (tableSize < 2*(unsigned int)patternAmount) {
+		tableSize = tableSize*2;
+	}
+	matcher->names = calloc(tableSize, sizeof(struct excludeString));
+	matcher->nameMask = tableSize - 1;
+	matcher->suffixes = malloc(patternAmount*sizeof(struct excludeString));
+	matcher->prefixes = malloc(patternAmount*sizeof(struct excludeString));
+	matcher->globs = malloc(patternAmount*sizeof(char *));
+
+	// Error checks the allocation of the arrays.
+	if (matcher->names == NULL || matcher->suffixes == NULL || matcher->prefixes == NULL || matcher->globs == NULL) {
+		freeExcludeMatcher(matcher);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	// Sorts the patterns by kind.
+	for (int index = 0; index < patternAmount; index++) {
+		const char *pattern = patterns[index];
+		size_t length = strlen(pattern);
+
+		if (!hasSpecialCharacters(pattern, length)) {
+			size_t nameLength;
+			unsigned int slot = hashName(pattern, &nameLength) & matcher->nameMask;
+			while (matcher->names[slot].string != NULL && strcmp(matcher->names[slot].string, pattern) != 0) {
+				slot = (slot + 1) & matcher->nameMask;
+			}
+			matcher->names[slot].string = pattern;
+			matcher->names[slot].length = length;
+		}
+		else if (pattern[0] == '*' && !hasSpecialCharacters(pattern + 1, length - 1)) {
+			matcher->suffixes[matcher->suffixAmount].string = pattern + 1;
+			matcher->suffixes[matcher->suffixAmount].length = length - 1;
+			matcher->suffixAmount++;
+		}
+		else if (pattern[length - 1] == '*' && !hasSpecialCharacters(pattern, length - 1)) {
+			matcher->prefixes[matcher->prefixAmount].string = pattern;
+			matcher->prefixes[matcher->prefixAmount].length = length - 1;
+			matcher->prefixAmount++;
+		}
+		else {
+			matcher->globs[matcher->globAmount] = pattern;
+			matcher->globAmount++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Frees an exclude matcher.
+ *
+ * @param matcher	The matcher.
+ */
+void freeExcludeMatcher(struct excludeMatcher *matcher) {
+
+	free(matcher->names);
+	free(matcher->suffixes);
+	free(matcher->prefixes);
+	free(matcher->globs);
+	memset(matcher, 0, sizeof(*matcher));
+}
+
+/**
+ * Checks if a name matches one of the patterns. The plain names are looked up
+ * in the hash table, the suffixes and prefixes are compared byte for byte and
+ * only the rest go through fnmatch.
+ *
+ * @param matcher	The matcher.
+ * @param name		The name.
+ * @return excluded	1 if the name matches a pattern, otherwise 0.
+ */
+int isExcludedName(const struct excludeMatcher *matcher, const char *name) {
+
+	if (matcher->names == NULL) {
+		return 0;
+	}
+
+	size_t length;
+	unsigned int slot = hashName(name, &length) & matcher->nameMask;
+	while (matcher->names[slot].string != NULL) {
+		if (matcher->names[slot].length == length && memcmp(matcher->names[slot].string, name, length) == 0) {
+			return 1;
+		}
+		slot = (slot + 1) & matcher->nameMask;
+	}
+
+	for (int index = 0; index < matcher->suffixAmount; index++) {
+		const struct excludeString *suffix = &matcher->suffixes[index];
+		if (suffix->length <= length && memcmp(name + length - suffix->length, suffix->string, suffix->length) == 0) {
+			return 1;
+		}
+	}
+
+	for (int index = 0; index < matcher->prefixAmount; index++) {
+		const struct excludeString *prefix = &matcher->prefixes[index];
+		if (prefix->length <= length && memcmp(name, prefix->string, prefix->length) == 0) {
+			return 1;
+		}
+	}
+
+	for (int index = 0; index < matcher->globAmount; index++) {
+		if (fnmatch(matcher->globs[index], name, 0) == 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Takes the entries whose names match one of the patterns out of a batch
+ * (the ones that are left keep their order). Only the names, types and
+ * inodes are moved, since the attributes have not been taken yet.
+ *
+ * @param matcher	The matcher.
+ * @param batch		The batch.
+ * @return amount	The amount of entries that were taken out.
+ */
+int filterEntryBatch(const struct excludeMatcher *matcher, struct entryBatch *batch) {
+
+	int kept = 0;
+	for (int index = 0; index < batch->amount; index++) {
+		if (isExcludedName(matcher, batch->names[index])) {
+			continue;
+		}
+		batch->names[kept] = batch->names[index];
+		batch->types[kept] = batch->types[index];
+		batch->inodes[kept] = batch->inodes[index];
+		kept++;
+	}
+
+	int excluded = batch->amount - kept;
+	batch->amount = kept;
+	return excluded;
+}
@@ -0,0 +1,54 @@
+/**
+ * This is the header file for the exclude matcher, which checks the names of
+ * the entries of a directory against the exclude patterns of the search. The
+ * patterns are sorted into kinds once, when the matcher is created, so that
+ * the common ones (a plain name, "*.suffix" and "prefix*") are matched without
+ * fnmatch.
+ *
+ * @file exclude.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef EXCLUDE_H
+#define EXCLUDE_H
+
+#include <stddef.h>
+#include "entries.h"
+
+// A pattern that is matched by comparing bytes (a plain name, a suffix or a prefix, pointing into the pattern without its '*').
+struct excludeString {
+	const char *string;
+	size_t length;
+};
+
+/**
+ * The exclude patterns sorted by kind. The plain names are in an open
+ * addressing hash table (with a power of two size), and the patterns that
+ * are neither of the simple kinds are left to fnmatch.
+ */
+struct excludeMatcher {
+	struct excludeString *names;
+	unsigned int nameMask;
+
+	struct excludeString *suffixes;
+	int suffixAmount;
+	struct excludeString *prefixes;
+	int prefixAmount;
+	const char **globs;
+	int globAmount;
+};
+
+// Creates an exclude matcher from the patterns (which have to outlive it).
+int createExcludeMatcher(struct excludeMatcher *matcher, char **patterns, int patternAmount);
+
+// Frees an exclude matcher.
+void freeExcludeMatcher(struct excludeMatcher *matcher);
+
+// Checks if a name matches one of the patterns.
+int isExcludedName(const struct excludeMatcher *matcher, const char *name);
+
+// Takes the entries whose names match one of the patterns out of a batch.
+int filterEntryBatch(const struct excludeMatcher *matcher, struct entryBatch *batch);
+
+#endif
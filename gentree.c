@@ -0,0 +1,200 @@
+/**
+ * This is the tree generator for the benchmarks. It creates a directory tree
+ * of a given shape and scale, and the same shape and scale always gives the
+ * same tree (the names and the file sizes come from a fixed seed), so that
+ * runs on different machines or on different versions can be compared.
+ *
+ * The shapes (the amounts are for scale 1):
+ *   wide	2 000 directories next to each other with 20 files each.
+ *   deep	20 chains of directories that are 500 levels deep, with a file on each level.
+ *   tiny	1 000 directories with 1 000 tiny files each (a million files).
+ *   huge	4 directories with 100 000 files each.
+ *
+ * Usage: ./gentree wide|deep|tiny|huge directory [scale]
+ *
+ * @file gentree.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// The largest file that is created (the buffer that the files are written from).
+#define LARGEST_FILE (16*1024)
+
+// The state of the random number generator (xorshift64, the same seed gives the same tree).
+static uint64_t randomState = 0x9E3779B97F4A7C15u;
+
+// The amount of files and directories that have been created.
+static long long entryAmount = 0;
+
+// The contents of every file.
+static char fileData[LARGEST_FILE];
+
+/**
+ * Gets the next random number.
+ *
+ * @return number	The number.
+ */
+static uint64_t nextRandom(void) {
+
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+/**
+ * Creates a directory relative to a parent and opens it.
+ *
+ * @param parentFd		The file descriptor of the parent (or AT_FDCWD).
+ * @param name			The name of the directory.
+ * @return directoryFd	The file descriptor of the new directory.
+ */
+static int makeDirectory(int parentFd, const char *name) {
+
+	if (mkdirat(parentFd, name, 0755) == -1) {
+		fprintf(stderr, "gentree: cannot create directory '%s': %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	int directoryFd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (directoryFd == -1) {
+		fprintf(stderr, "gentree: cannot open directory '%s': %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	entryAmount++;
+	return directoryFd;
+}
+
+/**
+ * Creates the files of a directory with random sizes up to a limit.
+ *
+ * @param directoryFd	The file descriptor of the directory.
+ * @param fileAmount	The amount of files.
+ * @param largestSize	The largest size of a file.
+ */
+static void makeFiles(int directoryFd, long fileAmount, size_t largestSize) {
+
+	char name[32];
+	for (long index = 0; index < fileAmount; index++) {
+		snprintf(name, sizeof(name), "f%08lx%04x", index, (unsigned int)(nextRandom() & 0xffff));
+		size_t size = nextRandom() % (largestSize + 1);
+
+		int fileFd = openat(directoryFd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+		if (fileFd == -1 || write(fileFd, fileData, size) != (ssize_t)size) {
+			fprintf(stderr, "gentree: cannot create file '%s': %s\n", name, strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		close(fileFd);
+		entryAmount++;
+	}
+}
+
+/**
+ * Creates directories next to each other, each with the same amount of files.
+ *
+ * @param rootFd			The file descriptor of the top directory.
+ * @param directoryAmount	The amount of directories.
+ * @param fileAmount		The amount of files in each directory.
+ * @param largestSize		The largest size of a file.
+ */
+static void makeFlatTree(int rootFd, long directoryAmount, long fileAmount, size_t largestSize) {
+
+	char name[32];
+	for (long index = 0; index < directoryAmount; index++) {
+		snprintf(name, sizeof(name), "d%06lx", index);
+		int directoryFd = makeDirectory(rootFd, name);
+		makeFiles(directoryFd, fileAmount, largestSize);
+		close(directoryFd);
+	}
+}
+
+/**
+ * Creates chains of directories, with one file on each level.
+ *
+ * @param rootFd		The file descriptor of the top directory.
+ * @param chainAmount	The amount of chains.
+ * @param depth			The amount of levels in each chain.
+ */
+static void makeDeepTree(int rootFd, long chainAmount, long depth) {
+
+	char name[32];
+	for (long chain = 0; chain < chainAmount; chain++) {
+		snprintf(name, sizeof(name), "chain%ld", chain);
+		int directoryFd = makeDirectory(rootFd, name);
+
+		for (long level = 0; level < depth; level++) {
+			makeFiles(directoryFd, 1, LARGEST_FILE);
+			int subdirectoryFd = makeDirectory(directoryFd, "level");
+			close(directoryFd);
+			directoryFd = subdirectoryFd;
+		}
+		close(directoryFd);
+	}
+}
+
+/**
+ * Multiplies an amount by the scale (but never below one).
+ *
+ * @param amount	The amount for scale 1.
+ * @param scale		The scale.
+ * @return amount	The scaled amount.
+ */
+static long scaleAmount(long amount, double scale) {
+
+	long scaled = (long)(amount*scale + 0.5);
+	return scaled < 1 ? 1 : scaled;
+}
+
+/**
+ * Main method for the tree generator. The amount of files and directories
+ * that were created (the top directory included) is printed at the end.
+ *
+ * @param argc			The amount of arguments for the program.
+ * @param argv			The list of arguments for the program.
+ * @return exitValue	The exit value for the program.
+ */
+int main(int argc, char **argv) {
+
+	double scale = 1;
+	if (argc < 3 || argc > 4 || (argc == 4 && (sscanf(argv[3], "%lf", &scale) != 1 || !(scale > 0)))) {
+		fprintf(stderr, "Usage: %s wide|deep|tiny|huge directory [scale]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(fileData, 'x', sizeof(fileData));
+	int rootFd = makeDirectory(AT_FDCWD, argv[2]);
+
+	if (strcmp(argv[1], "wide") == 0) {
+		makeFlatTree(rootFd, scaleAmount(2000, scale), 20, LARGEST_FILE);
+	}
+	else if (strcmp(argv[1], "deep") == 0) {
+		makeDeepTree(rootFd, 20, scaleAmount(500, scale));
+	}
+	else if (strcmp(argv[1], "tiny") == 0) {
+		makeFlatTree(rootFd, scaleAmount(1000, scale), 1000, 64);
+	}
+	else if (strcmp(argv[1], "huge") == 0) {
+		makeFlatTree(rootFd, 4, scaleAmount(100000, scale), 8*1024);
+	}
+	else {
+		fprintf(stderr, "%s: unknown shape '%s'\n", argv[0], argv[1]);
+		rmdir(argv[2]);
+		exit(EXIT_FAILURE);
+	}
+
+	close(rootFd);
+	printf("%lld\n", entryAmount);
+
+	return EXIT_SUCCESS;
+}
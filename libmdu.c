@@ -0,0 +1,2281 @@
+/**
+ * This is the implementation file for libmdu, the library that does the
+ * searches of the mdu program. Everything that a search needs is kept in the
+ * scanner and in the information of its threads, the results are handed to
+ * the callbacks of the scanner, and an error stops the search and is returned
+ * as an error code (the program is never exited from here).
+ *  
+ * @file libmdu.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <limits.h>
+#include "search.h"
+#include "stacks.h"
+#include "uring.h"
+#include "entries.h"
+#include "cache.h"
+#include "stats.h"
+#include "progress.h"
+#include "tuner.h"
+#include "top.h"
+#include "exclude.h"
+#include "links.h"
+#include "estimate.h"
+
+// The least amount of entries in a chunk of a large directory that is handed over to another thread.
+#define MINIMUM_CHUNK_SIZE 256
+
+// How many directories may wait to be searched by default before the threads search new ones in line.
+#define DEFAULT_MAX_QUEUE 65536
+
+// How many directories a thread searches in line inside each other at most (each level has a directory reader of its own).
+#define MAX_INLINE_DEPTH 8
+
+/**
+ * A link in the chain of directory names that make up the current path
+ * of a search. The full path is only put together when it is needed.
+ */
+struct pathLink {
+	struct pathLink *parent;
+	char *name;
+	int depth;
+};
+
+/**
+ * The reader and the cache names of a directory while a directory inside it
+ * is searched in line (one for each level, created when it is first needed).
+ */
+struct inlineLevel {
+	struct directoryReader reader;
+	struct nameList cacheNames;
+	int created;
+};
+
+/** 
+ * Struct that keeps information that each thread needs in order to do
+ * the search (the recursive search is done by a single thread).
+ */
+struct threadInformation {
+	int threadNumber;
+	int threadAmount;
+	struct scanOptions *options;
+	int attributeFlags;
+	
+	// The scanner of the search (its callbacks get the results and its error fields the reason of a failure).
+	struct mduScanner *scanner;
+	
+	// The error code that stops the search (0 while it goes on, only the first error is kept).
+	atomic_int *scanError;
+	
+	// The threads directory reader and its io_uring ring (NULL if it does not use one).
+	struct directoryReader reader;
+	struct statRing ring;
+	struct statRing *ringPointer;
+	
+	// The cache from the last search and the threads part of the new one (both NULL if no cache is used).
+	struct scanCache *cache;
+	struct cacheWriter *cacheWriter;
+	
+	// The names of the subdirectories of the directory that the thread is searching (only kept for the cache).
+	struct nameList cacheNames;
+	
+	// The threads statistics (NULL if they are not kept).
+	struct scanStatistics *statistics;
+	
+	// The threads progress counters (NULL if the progress is not shown).
+	struct progressCounters *progress;
+	
+	// The threads counters for the thread tuner (NULL if the amount of threads is fixed).
+	struct tunerCounters *tuning;
+	
+	// The largest files and directories that the thread has seen (both NULL if they are not kept).
+	struct topList *topFiles;
+	struct topList *topDirectories;
+	
+	// The names that are left out before they are checked (NULL if there are no exclude patterns).
+	const struct excludeMatcher *exclude;
+	
+	// The file system of the file/directory that is searched (recursive search) or of each of them (parallel search), for -x.
+	dev_t operandDevice;
+	const dev_t *operandDevices;
+	
+	// The files with more than one link that have been counted, and the threads cache of them (both NULL if every link is counted).
+	struct linkSet *links;
+	struct linkCache *linkCache;
+	
+	// Where the paths of the subdirectories are collected instead of being searched (NULL unless an estimate reads one level).
+	struct nameList *frontier;
+	
+	// Only used in the parallel search.
+	struct directoryDeque *deques;
+	struct workTracker *work;
+	
+	// How many directories may be waiting before new ones are searched in line, and the levels of the ones that are.
+	long maxQueue;
+	struct inlineLevel *inlineLevels;
+	int inlineDepth;
+	
+	// The block amounts of the files/directories in the program arguments.
+	_Atomic(blkcnt_t) *blockAmounts;
+	
+	// The arena that the threads directory items are cut from.
+	struct itemArena arena;
+	
+	// The amount of directories that are open and how many may be open at the same time.
+	atomic_int *openDirectories;
+	int openDirectoryLimit;
+	
+	// The exit value of the search (set to MDU_INCOMPLETE by any thread that could not read something).
+	atomic_int *exitValuePointer;
+};
+
+// Searches a directory of the parallel search (it may search the directories in it in line).
+static void searchDirectoryItem(struct threadInformation *threadInfo, struct directoryItem *directory);
+
+// Does a recursive search of a directory.
+static blkcnt_t searchDirectoryRecursive(int directoryFd, struct pathLink *path, blkcnt_t totalBlockAmount, struct threadInformation *threadInfo);
+
+// Sets up the things that a thread needs for its search.
+static int setUpThread(struct threadInformation *threadInfo);
+
+// Frees the things that a thread used for its search.
+static void tearDownThread(struct threadInformation *threadInfo);
+
+// Opens the cache from the last search and prepares the new one.
+static void startScanCache(struct scanOptions *options, struct scanCache *cache, struct cacheWriter *writers, int writerAmount);
+
+// Writes the new cache and closes the old one.
+static void finishScanCache(struct mduScanner *scanner, struct scanCache *cache, struct cacheWriter *writers, int writerAmount, int write);
+
+// Does a parallel search of a directory.
+static void *searchDirectoryParallel(void *info);
+
+// Gets the limit on open files.
+static int getOpenFileLimit(void);
+
+// Opens a directory relative to its parent.
+static int openDirectory(struct threadInformation *threadInfo, int parentFd, struct pathLink *path);
+
+// Puts together the full path of a directory.
+static char *getFullPath(struct pathLink *path);
+
+// Hands over that a directory can not be read.
+static void reportDirectoryError(struct threadInformation *threadInfo, struct pathLink *path);
+
+// Hands over the disk usage of a file/directory below one in the program arguments.
+static void reportPathUsage(struct threadInformation *threadInfo, struct pathLink *path, blkcnt_t blockAmount, int directory);
+
+/**
+ * Stops the search with an error. Only the first error is kept, together with
+ * the errno and the path of the file that caused it (the threads that fail
+ * after it only stop).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param error			The error code.
+ * @param path			The path of the file (taken over by the function, NULL if there is none).
+ */
+static void setScanError(struct threadInformation *threadInfo, int error, char *path) {
+	
+	// Saves the error before anything else can change it.
+	int errorNumber = errno;
+	
+	int expected = 0;
+	if (atomic_compare_exchange_strong(threadInfo->scanError, &expected, error)) {
+		threadInfo->scanner->errorNumber = errorNumber;
+		threadInfo->scanner->errorPath = path;
+	}
+	else {
+		free(path);
+	}
+	errno = errorNumber;
+}
+
+/**
+ * Checks if the search has been stopped by an error.
+ *
+ * @param threadInfo	The information about the thread.
+ * @return failed		1 if the search has been stopped, otherwise 0.
+ */
+static int isScanFailed(struct threadInformation *threadInfo) {
+	return atomic_load_explicit(threadInfo->scanError, memory_order_relaxed) != 0;
+}
+
+/**
+ * Sets the exit value to failure.
+ *
+ * @param threadInfo	The information about the thread.
+ */
+static void setExitFailure(struct threadInformation *threadInfo) {
+	atomic_store_explicit(threadInfo->exitValuePointer, MDU_INCOMPLETE, memory_order_relaxed);
+}
+
+/**
+ * Puts together the path of an entry in a directory (a directory path that
+ * already ends with a slash gets no extra one).
+ *
+ * @param directoryPath	The path of the directory.
+ * @param name			The name of the entry.
+ * @return entryPath	The path of the entry (has to be freed by the caller, NULL if there was no memory for it).
+ */
+static char *getEntryPath(const char *directoryPath, const char *name) {
+	
+	size_t directoryLength = strlen(directoryPath);
+	size_t nameLength = strlen(name);
+	char *entryPath = malloc(directoryLength + nameLength + 2);
+	if (entryPath == NULL) {
+		return NULL;
+	}
+	
+	memcpy(entryPath, directoryPath, directoryLength);
+	if (directoryLength == 0 || directoryPath[directoryLength - 1] != '/') {
+		entryPath[directoryLength] = '/';
+		directoryLength++;
+	}
+	memcpy(entryPath + directoryLength, name, nameLength + 1);
+	
+	return entryPath;
+}
+
+/**
+ * Checks if the scanner has a callback for the disk usage of a file/directory
+ * (the path does not have to be put together otherwise).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		If the usage is of a directory.
+ * @return wanted		1 if there is a callback for it, otherwise 0.
+ */
+static int isUsageWanted(struct threadInformation *threadInfo, int directory) {
+	
+	struct mduCallbacks *callbacks = &threadInfo->scanner->callbacks;
+	if (directory) {
+		return callbacks->directory != NULL;
+	}
+	return callbacks->file != NULL;
+}
+
+/**
+ * Hands the disk usage of a file/directory to the callback of the scanner.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param depth			How many levels below the files/directories of the search it is.
+ * @param directory		If it is a directory.
+ */
+static void reportUsage(struct threadInformation *threadInfo, const char *path, blkcnt_t blockAmount, int depth, int directory) {
+	
+	struct mduCallbacks *callbacks = &threadInfo->scanner->callbacks;
+	if (directory && callbacks->directory != NULL) {
+		callbacks->directory(callbacks->data, path, blockAmount, depth);
+	}
+	else if (!directory && callbacks->file != NULL) {
+		callbacks->file(callbacks->data, path, blockAmount);
+	}
+}
+
+/**
+ * Lets the callbacks write out what the thread has buffered, since the thread
+ * is done or is about to wait for work.
+ *
+ * @param threadInfo	The information about the thread.
+ */
+static void flushResults(struct threadInformation *threadInfo) {
+	
+	struct mduCallbacks *callbacks = &threadInfo->scanner->callbacks;
+	if (callbacks->flush != NULL) {
+		callbacks->flush(callbacks->data);
+	}
+}
+
+/**
+ * Hands a directory that can not be read to the error callback of the scanner
+ * (with the reason from errno).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param path			The path of the directory.
+ */
+static void reportError(struct threadInformation *threadInfo, const char *path) {
+	
+	int error = errno;
+	struct mduCallbacks *callbacks = &threadInfo->scanner->callbacks;
+	if (callbacks->error != NULL) {
+		callbacks->error(callbacks->data, MDU_INCOMPLETE, path, error);
+	}
+	errno = error;
+}
+
+/**
+ * Adds a file/directory to one of the threads lists of the largest ones (the
+ * caller has already checked that it makes it in).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param list			The list.
+ * @param path			The path of the file/directory (taken over by the function, NULL if there was no memory for it).
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ */
+static void addTopPath(struct threadInformation *threadInfo, struct topList *list, char *path, blkcnt_t blockAmount) {
+	
+	if (path == NULL) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return;
+	}
+	addTopEntry(list, path, blockAmount);
+}
+
+/**
+ * Checks if the blocks of a file are counted. A file with more than one link
+ * is only counted for the first of its links that the search finds, the
+ * others are left out completely (the same way as in du). Only the files
+ * with more than one link are looked up in the link set.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param attributes	The attributes of the file (not a directory).
+ * @return counted		1 if the file is counted, 0 if it has been counted already (or if there was no memory to remember it, which stops the search).
+ */
+static int isFirstLink(struct threadInformation *threadInfo, const struct fileAttributes *attributes) {
+	
+	if (threadInfo->links == NULL || attributes->links < 2) {
+		return 1;
+	}
+	
+	int first = addLink(threadInfo->links, threadInfo->linkCache, attributes->device, attributes->inode);
+	if (first == -1) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return 0;
+	}
+	if (first == 0 && threadInfo->statistics != NULL) {
+		threadInfo->statistics->linkedEntries++;
+	}
+	return first;
+}
+
+/**
+ * Creates the lists of the largest files and directories for each thread
+ * (the lists of thread i are at 2*i and 2*i + 1).
+ *
+ * @param scanner		The scanner of the search.
+ * @param threadAmount	The amount of threads.
+ * @return lists		The lists (NULL if they are not kept or if there was no memory for them).
+ */
+static struct topList *createTopLists(struct mduScanner *scanner, int threadAmount) {
+	
+	struct topList *lists = calloc(2*threadAmount, sizeof(struct topList));
+	if (lists == NULL) {
+		return NULL;
+	}
+	
+	for (int index = 0; index < 2*threadAmount; index++) {
+		if (createTopList(&lists[index], scanner->options.topAmount) == -1) {
+			for (int created = 0; created < index; created++) {
+				freeTopList(&lists[created]);
+			}
+			free(lists);
+			return NULL;
+		}
+	}
+	return lists;
+}
+
+/**
+ * Merges the lists of the threads into the lists of the scanner (sorted from
+ * the largest file/directory down) and frees them.
+ *
+ * @param scanner		The scanner of the search.
+ * @param lists			The lists of the threads.
+ * @param threadAmount	The amount of threads.
+ */
+static void finishTopLists(struct mduScanner *scanner, struct topList *lists, int threadAmount) {
+	
+	// The lists of the first thread take in the ones of the others.
+	for (int index = 1; index < threadAmount; index++) {
+		mergeTopLists(&lists[0], &lists[2*index]);
+		mergeTopLists(&lists[1], &lists[2*index + 1]);
+	}
+	sortTopList(&lists[0]);
+	sortTopList(&lists[1]);
+	
+	// The entries (and their paths) now belong to the scanner.
+	scanner->topFiles = lists[0].entries;
+	scanner->topFileAmount = lists[0].amount;
+	scanner->topDirectories = lists[1].entries;
+	scanner->topDirectoryAmount = lists[1].amount;
+	lists[0].entries = NULL;
+	lists[0].amount = 0;
+	lists[1].entries = NULL;
+	lists[1].amount = 0;
+	
+	for (int index = 0; index < 2*threadAmount; index++) {
+		freeTopList(&lists[index]);
+	}
+	free(lists);
+}
+
+/**
+ * Calculates the size a list of files/directories takes on the disk recursively.
+ *
+ * @param scanner		The scanner of the search.
+ * @param files			The list of files/directories.
+ * @param fileAmount	The amount of files/directories.
+ * @param blockAmounts	Where the total of each file/directory is stored.
+ * @param exclude		The exclude patterns (NULL if there are none).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the search.
+ */
+static int calculateSizeOnDiskRecursive(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts, const struct excludeMatcher *exclude) {
+	
+	struct scanOptions *options = &scanner->options;
+	
+	// Sets the default exit value to success.
+	atomic_int exitVal;
+	atomic_init(&exitVal, MDU_SUCCESS);
+	atomic_int scanError;
+	atomic_init(&scanError, 0);
+	
+	/**
+	 * The information about the thread doing the search, which gets,
+	 * sent in to the searchDirectoryRecursive function.
+	 */
+	struct threadInformation threadInfo;
+	memset(&threadInfo, 0, sizeof(threadInfo));
+	threadInfo.threadAmount = 1;
+	threadInfo.options = options;
+	threadInfo.scanner = scanner;
+	threadInfo.scanError = &scanError;
+	threadInfo.exitValuePointer = &exitVal;
+	threadInfo.exclude = exclude;
+	
+	// Keeps statistics (if they have been asked for).
+	long long startTime = getStatisticsTime();
+	if (options->statistics != 0) {
+		scanner->statistics = calloc(1, sizeof(struct scanStatistics));
+		if (scanner->statistics == NULL) {
+			return MDU_ERROR_MEMORY;
+		}
+		scanner->statisticsAmount = 1;
+		threadInfo.statistics = scanner->statistics;
+	}
+	
+	// Keeps the largest files and directories (if they have been asked for).
+	struct topList *topLists = NULL;
+	if (options->topAmount > 0) {
+		topLists = createTopLists(scanner, 1);
+		if (topLists == NULL) {
+			return MDU_ERROR_MEMORY;
+		}
+		threadInfo.topFiles = &topLists[0];
+		threadInfo.topDirectories = &topLists[1];
+	}
+	
+	// Remembers the files with more than one link, so that they are only counted once (unless every link is counted).
+	struct linkSet links;
+	createLinkSet(&links);
+	if (options->countLinks == 0) {
+		threadInfo.links = &links;
+	}
+	
+	if (setUpThread(&threadInfo) == -1) {
+		tearDownThread(&threadInfo);
+		freeLinkSet(&links);
+		if (topLists != NULL) {
+			finishTopLists(scanner, topLists, 1);
+		}
+		return MDU_ERROR_MEMORY;
+	}
+	
+	// Shows the progress (if it has been asked for), the thread keeps its own count of waiting directories.
+	struct progressReporter progress;
+	int progressCheck = -1;
+	if (options->progressFd != -1) {
+		progressCheck = startProgress(&progress, options->progressFd, 1, NULL);
+		if (progressCheck == 0) {
+			threadInfo.progress = &progress.counters[0];
+		}
+	}
+	
+	// Opens the cache (if one has been asked for).
+	struct scanCache cache;
+	struct cacheWriter cacheWriter;
+	if (options->cachePath != NULL) {
+		startScanCache(options, &cache, &cacheWriter, 1);
+		threadInfo.cache = &cache;
+		threadInfo.cacheWriter = &cacheWriter;
+	}
+	
+	// The total block amount for all files.
+	blkcnt_t  totalBlockAmount = 0;
+	
+	// The block amount for one individual file.
+	blkcnt_t  blockAmountForFile = 0;
+	
+	struct fileAttributes fileStat;
+	int index = 0;
+	// Goes through the list of files until they are done or the search fails.
+	while (index < fileAmount && !isScanFailed(&threadInfo)) {
+			
+		// Stores the file info in the fileStat struct.
+		int statCheck = getFileAttributes(AT_FDCWD, files[index], threadInfo.attributeFlags, &fileStat);
+
+		// Error checks the storing of the file info.
+		if (statCheck == -1) {
+			setScanError(&threadInfo, MDU_ERROR_STAT, strdup(files[index]));
+			break;
+		}
+			
+		// Checks if the current file is a directory.
+		int fileCheck = S_ISDIR(fileStat.mode);
+		
+		// If the current file is a directory.
+		if (fileCheck != 0) {
+			
+			// The path of the search starts with the file (relative to the current working directory).
+			struct pathLink path = {NULL, files[index], 0};
+			threadInfo.operandDevice = fileStat.device;
+			
+			// Opens the directory.
+			int directoryFd = openDirectory(&threadInfo, AT_FDCWD, &path);
+			if (threadInfo.statistics != NULL) {
+				threadInfo.statistics->openCalls++;
+			}
+			
+			// If the directory can be opened it can be recursively searched.
+			if (directoryFd != -1) {
+				
+				// Starts the recursive search of the directory.				
+				totalBlockAmount = searchDirectoryRecursive(directoryFd, &path, 0, &threadInfo);
+				if (isScanFailed(&threadInfo)) {
+					break;
+				}
+			}
+
+			/** 
+			 * If the directory can not be opened the exit value is set to failure,
+             * and the function continues to the next file instead. 
+			 */
+			else {
+				setExitFailure(&threadInfo);
+			}
+		}
+		
+		// Gets the number of blocks allocated to the file (nothing if it is another link to a file that has been counted).
+		blockAmountForFile = fileStat.blocks;
+		if (fileCheck == 0 && !isFirstLink(&threadInfo, &fileStat)) {
+			blockAmountForFile = 0;
+		}
+				
+		// Adds it to the total amount of blocks.
+		totalBlockAmount = blockAmountForFile + totalBlockAmount;
+			
+		// Hands over the disk usage of the current file.
+		if (blockAmounts != NULL) {
+			blockAmounts[index] = totalBlockAmount;
+		}
+		reportUsage(&threadInfo, files[index], totalBlockAmount, 0, 1);
+		
+		// Resets the block amount.
+		totalBlockAmount = 0;
+			
+		index++;
+	}
+	
+	flushResults(&threadInfo);
+	tearDownThread(&threadInfo);
+	if (progressCheck == 0) {
+		stopProgress(&progress);
+	}
+	
+	// Writes the new cache (only if the search went through, a failed search would leave directories out).
+	if (options->cachePath != NULL) {
+		finishScanCache(scanner, &cache, &cacheWriter, 1, !isScanFailed(&threadInfo));
+	}
+	
+	scanner->nanoseconds = getStatisticsTime() - startTime;
+	if (topLists != NULL) {
+		finishTopLists(scanner, topLists, 1);
+	}
+	freeLinkSet(&links);
+	
+	if (isScanFailed(&threadInfo)) {
+		return atomic_load(&scanError);
+	}
+	return atomic_load(&exitVal);
+}
+
+/**
+ * Looks up a directory in the cache. The attributes of the directory are
+ * stored so that the directory can be added to the new cache once it has
+ * been searched (the inode is left at 0 if they could not be taken).
+ *
+ * @param threadInfo	The information about the thread doing the search.
+ * @param directoryFd	The file descriptor of the directory.
+ * @param attributes	The struct that the attributes of the directory are stored in.
+ * @return entry		The cached directory or NULL if it has to be read.
+ */
+static const struct cacheEntry *lookUpDirectory(struct threadInformation *threadInfo, int directoryFd, struct fileAttributes *attributes) {
+	
+	attributes->inode = 0;
+	if (threadInfo->cacheWriter == NULL) {
+		return NULL;
+	}
+	
+	int flags = threadInfo->attributeFlags | ATTRIBUTES_INODE | ATTRIBUTES_TIMES | ATTRIBUTES_EMPTY_PATH;
+	if (threadInfo->statistics != NULL) {
+		threadInfo->statistics->statCalls++;
+	}
+	if (getFileAttributes(directoryFd, "", flags, attributes) == -1) {
+		attributes->inode = 0;
+		return NULL;
+	}
+	
+	// The files have to be printed (or looked at for the largest ones), so the directory has to be read (it is still added to the new cache).
+	if (threadInfo->options->allFiles == 1 || threadInfo->topFiles != NULL) {
+		return NULL;
+	}
+	
+	return findCacheEntry(threadInfo->cache, attributes);
+}
+
+/**
+ * Reads the next batch of entries of a directory into the threads reader. For
+ * a cached directory the batch is the next names of its subdirectories from
+ * the cache instead (the directory itself is not read). The entries that
+ * match an exclude pattern are taken out of a batch that is read, and with
+ * --inode-order the batch is then sorted by inode number.
+ *
+ * @param threadInfo	The information about the thread doing the search.
+ * @param directoryFd	The file descriptor of the directory.
+ * @param cached		The cached directory (NULL if it has to be read).
+ * @param cachedNames	The names of the subdirectories that are left (for a cached directory).
+ * @param cachedAmount	The amount of names that are left (for a cached directory).
+ * @return batchCheck	The amount of entries in the batch, 0 at the end or -1 on an error.
+ */
+static int readDirectoryBatch(struct threadInformation *threadInfo, int directoryFd, const struct cacheEntry *cached, const char **cachedNames, int *cachedAmount) {
+	
+	if (cached != NULL) {
+		return readNameBatch(&threadInfo->reader, cachedNames, cachedAmount);
+	}
+	
+	struct scanStatistics *statistics = threadInfo->statistics;
+	long long start = 0;
+	if (statistics != NULL) {
+		start = getStatisticsTime();
+	}
+	
+	// Reads until there is an entry that is not excluded (or until the end of the directory).
+	int batchCheck;
+	int excluded;
+	do {
+		batchCheck = readEntryBatch(&threadInfo->reader, directoryFd);
+		
+		if (statistics != NULL) {
+			statistics->readCalls++;
+			if (batchCheck > 0) {
+				statistics->entries = statistics->entries + batchCheck;
+			}
+		}
+		
+		// The excluded entries are taken out of the batch before anything is asked about them.
+		excluded = 0;
+		if (batchCheck > 0 && threadInfo->exclude != NULL) {
+			excluded = filterEntryBatch(threadInfo->exclude, &threadInfo->reader.batch);
+			if (statistics != NULL) {
+				statistics->prunedEntries = statistics->prunedEntries + excluded;
+			}
+		}
+	} while (batchCheck > 0 && excluded == batchCheck);
+	
+	if (batchCheck > 0) {
+		batchCheck = batchCheck - excluded;
+	}
+	
+	if (statistics != NULL) {
+		statistics->readNanoseconds = statistics->readNanoseconds + getStatisticsTime() - start;
+	}
+	
+	// The entries are checked (and the subdirectories opened) in the order of their inodes.
+	if (batchCheck > 0 && threadInfo->options->inodeOrder == 1) {
+		sortEntryBatch(&threadInfo->reader);
+	}
+	
+	return batchCheck;
+}
+
+/**
+ * Calculates the size a directory takes on the disk recursively. The directory
+ * has been opened relative to its parents file descriptor and the files in it
+ * are checked relative to its own, so the working directory never changes. The
+ * entries are read in batches into the threads reader, and since the reader
+ * is reused the names of the subdirectories are copied out and searched once
+ * the whole directory has been read.
+ *
+ * @param directoryFd		The file descriptor of the directory (closed by the function).
+ * @param path				The path of the directory.
+ * @param totalBlockAmount	The amount of blocks the directory takes on the disk.
+ * @param threadInfo		The information about the thread doing the search.
+ * @return totalBlockAmount The amount of blocks the directory takes on the disk.
+ */
+static blkcnt_t searchDirectoryRecursive(int directoryFd, struct pathLink *path, blkcnt_t totalBlockAmount, struct threadInformation *threadInfo) {
+	
+	// The subdirectories that are found in the directory.
+	struct nameList subdirectories;
+	memset(&subdirectories, 0, sizeof(subdirectories));
+	
+	if (threadInfo->statistics != NULL) {
+		threadInfo->statistics->directories++;
+	}
+	
+	// If the directory has not changed since the last search its files are taken from the cache.
+	struct fileAttributes directoryAttributes;
+	const char *cachedNames = NULL;
+	int cachedAmount = 0;
+	blkcnt_t startBlockAmount = totalBlockAmount;
+	const struct cacheEntry *cached = lookUpDirectory(threadInfo, directoryFd, &directoryAttributes);
+	if (cached != NULL) {
+		cachedNames = getCacheEntryNames(threadInfo->cache, cached);
+		cachedAmount = cached->subdirectoryAmount;
+		totalBlockAmount = cached->fileBlocks + totalBlockAmount;
+	}
+	
+	struct entryBatch *batch = &threadInfo->reader.batch;
+	long long entryAmount = 0;
+	int batchCheck = 0;
+	// Goes through the directory one batch of entries at a time (only the subdirectories if it is cached).
+	while (!isScanFailed(threadInfo) && (batchCheck = readDirectoryBatch(threadInfo, directoryFd, cached, &cachedNames, &cachedAmount)) > 0) {
+		entryAmount = entryAmount + batchCheck;
+		
+		// Gets the attributes of all the files in the batch.
+		getBatchAttributes(threadInfo->ringPointer, directoryFd, batch->names, batch->amount, threadInfo->attributeFlags, batch->attributes, batch->errors, threadInfo->statistics);
+		
+		int index = 0;
+		// Goes through each file in the batch.
+		while (index < batch->amount) {
+			struct pathLink filePath = {path, batch->names[index], path->depth + 1};
+			
+			// Error checks the storing of the file info (a file that can not be checked stops the search).
+			if (batch->errors[index] != 0) {
+				errno = batch->errors[index];
+				setScanError(threadInfo, MDU_ERROR_STAT, getFullPath(&filePath));
+				break;
+			}
+			
+			// A directory on another file system is left out completely with -x (it is not counted or opened).
+			if (S_ISDIR(batch->attributes[index].mode) && threadInfo->options->oneFileSystem == 1 && batch->attributes[index].device != threadInfo->operandDevice) {
+				if (threadInfo->statistics != NULL) {
+					threadInfo->statistics->prunedEntries++;
+				}
+				index++;
+				continue;
+			}
+			
+			// If the current file is a directory it is searched (and its blocks are added) once the whole directory has been read.
+			if (S_ISDIR(batch->attributes[index].mode)) {
+				if (addName(&subdirectories, batch->names[index], batch->attributes[index].blocks) == -1) {
+					setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+					break;
+				}
+			}
+			
+			else {
+				
+				// Another link to a file that has been counted is left out completely.
+				if (!isFirstLink(threadInfo, &batch->attributes[index])) {
+					index++;
+					continue;
+				}
+				
+				// Adds the number of blocks allocated to the file to the total amount of blocks.
+				totalBlockAmount = batch->attributes[index].blocks + totalBlockAmount;
+				
+				// Keeps the file if it is one of the largest ones so far.
+				if (threadInfo->topFiles != NULL && isTopCandidate(threadInfo->topFiles, batch->attributes[index].blocks)) {
+					addTopPath(threadInfo, threadInfo->topFiles, getFullPath(&filePath), batch->attributes[index].blocks);
+				}
+				
+				// Hands over the disk usage of the file if all files are wanted and it is not too deep.
+				if (threadInfo->options->allFiles == 1 && path->depth < threadInfo->options->maxDepth) {
+					reportPathUsage(threadInfo, &filePath, batch->attributes[index].blocks, 0);
+				}
+			}
+			
+			index++;
+		}
+	}
+	
+	// Error checks the reading of the directory.
+	if (!isScanFailed(threadInfo) && batchCheck == -1) {
+		setScanError(threadInfo, MDU_ERROR_READ, getFullPath(path));
+	}
+	
+	// Stops the search if it has failed (the directories above this one stop as well).
+	if (isScanFailed(threadInfo)) {
+		close(directoryFd);
+		freeNameList(&subdirectories);
+		return totalBlockAmount;
+	}
+	
+	// Adds the directory to the new cache.
+	if (threadInfo->cacheWriter != NULL && directoryAttributes.inode != 0) {
+		addCacheEntry(threadInfo->cacheWriter, &directoryAttributes, totalBlockAmount - startBlockAmount, subdirectories.names, subdirectories.used, subdirectories.amount);
+	}
+	
+	// Counts the directory (with its own blocks and the files in it) and the subdirectories that are now waiting.
+	if (threadInfo->progress != NULL) {
+		addProgress(threadInfo->progress, entryAmount, 1, totalBlockAmount);
+		addPendingProgress(threadInfo->progress, subdirectories.amount);
+	}
+	
+	char *name = subdirectories.names;
+	// Goes through each subdirectory (until the search fails).
+	for (int index = 0; index < subdirectories.amount && !isScanFailed(threadInfo); index++) {
+		
+		// Links the subdirectory into the current path.
+		struct pathLink subdirectoryPath = {path, name, path->depth + 1};
+		
+		// The subdirectory starts with the blocks allocated to the directory itself.
+		blkcnt_t subdirectoryBlockAmount = subdirectories.blocks[index];
+		
+		// Opens the directory (only once, the search continues with the same file descriptor).
+		addPendingProgress(threadInfo->progress, -1);
+		int subdirectoryFd = openDirectory(threadInfo, directoryFd, &subdirectoryPath);
+		if (threadInfo->statistics != NULL) {
+			threadInfo->statistics->openCalls++;
+		}
+		
+		/**
+		 * If the directory can be opened the function continues with the,
+		 * recursive search of the directory.
+		 */
+		if (subdirectoryFd != -1) {
+			
+			// The method calls itself recursively with the subdirectory as a directory.
+			subdirectoryBlockAmount = searchDirectoryRecursive(subdirectoryFd, &subdirectoryPath, subdirectoryBlockAmount, threadInfo);
+		}
+		
+		/**
+		 * If the directory can not be opened the exit value is set to failure,
+		 * and the function continues to the next subdirectory instead. 
+		 */
+		else {
+			setExitFailure(threadInfo);
+		}
+		
+		// Hands over the disk usage of the subdirectory if it is not too deep.
+		if (subdirectoryPath.depth <= threadInfo->options->maxDepth && !isScanFailed(threadInfo)) {
+			reportPathUsage(threadInfo, &subdirectoryPath, subdirectoryBlockAmount, 1);
+		}
+		
+		// Keeps the subdirectory if it is one of the largest ones so far.
+		if (threadInfo->topDirectories != NULL && isTopCandidate(threadInfo->topDirectories, subdirectoryBlockAmount) && !isScanFailed(threadInfo)) {
+			addTopPath(threadInfo, threadInfo->topDirectories, getFullPath(&subdirectoryPath), subdirectoryBlockAmount);
+		}
+		
+		// Adds the blocks of the subdirectory to the total amount of blocks.
+		totalBlockAmount = subdirectoryBlockAmount + totalBlockAmount;
+		
+		name = name + strlen(name) + 1;
+	}
+	
+	// Closes the directory and frees the subdirectories.
+	close(directoryFd);
+	freeNameList(&subdirectories);
+	
+	return totalBlockAmount;
+}
+
+/**
+ * Gives back the directory items that are still waiting in the deques of a
+ * search that never started (an item keeps the chunk of its arena from being
+ * freed until it is released).
+ *
+ * @param deques		The deques.
+ * @param threadAmount	The amount of deques.
+ */
+static void releaseQueuedDirectories(struct directoryDeque *deques, int threadAmount) {
+	
+	for (int index = 0; index < threadAmount; index++) {
+		struct directoryItem *item;
+		while ((item = getDirectory(&deques[index])) != NULL) {
+			if (releaseDirectoryItem(item) == 1) {
+				freeDirectoryItem(item);
+			}
+		}
+	}
+}
+
+/**
+ * Calculates the size a list of files/directories takes on the disk in parallel.
+ * 
+ * @param scanner		The scanner of the search.
+ * @param files			The list of files/directories.
+ * @param fileAmount	The amount of files/directories.
+ * @param blockAmounts	Where the total of each file/directory is stored.
+ * @param exclude		The exclude patterns (NULL if there are none).
+ * @param frontiers		One name list for each thread that the paths of the subdirectories are collected in instead of being searched (NULL for a whole search).
+ * @param sharedLinks	The files with more than one link that have been counted by earlier searches (NULL if the search keeps its own).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the search.
+ */
+int calculateSizeOnDiskParallel(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts, const struct excludeMatcher *exclude, struct nameList *frontiers, struct linkSet *sharedLinks) {
+	
+	struct scanOptions *options = &scanner->options;
+	int threadAmount = scanner->threadAmount;
+	
+	// Creates one directory deque for each thread.
+	struct directoryDeque *deques = createDirectoryDeques(threadAmount);
+	
+	// The block amount of each file/directory in the files list (the threads add to the directories).
+	_Atomic(blkcnt_t) *operandBlockAmounts = malloc(fileAmount*sizeof(_Atomic(blkcnt_t)));
+	
+	// The file system of each file/directory in the files list (for -x).
+	dev_t *operandDevices = malloc(fileAmount*sizeof(dev_t));
+	
+	// The files with more than one link that have been counted (shared by the threads, and by the searches of an estimate).
+	struct linkSet ownLinks;
+	struct linkSet *links = sharedLinks;
+	if (links == NULL) {
+		createLinkSet(&ownLinks);
+		links = &ownLinks;
+	}
+	
+	// The statistics of each thread (only kept if they have been asked for).
+	long long startTime = getStatisticsTime();
+	if (options->statistics != 0) {
+		scanner->statistics = calloc(threadAmount, sizeof(struct scanStatistics));
+		scanner->statisticsAmount = threadAmount;
+	}
+	
+	// The largest files and directories of each thread (only kept if they have been asked for).
+	struct topList *topLists = NULL;
+	if (options->topAmount > 0) {
+		topLists = createTopLists(scanner, threadAmount);
+	}
+	
+	// The information, the thread ids and the cache writers of the threads (on the heap, since the amount of threads comes from the caller).
+	struct threadInformation *threadInfos = calloc(threadAmount, sizeof(struct threadInformation));
+	pthread_t *threads = calloc(threadAmount, sizeof(pthread_t));
+	struct cacheWriter *cacheWriters = calloc(threadAmount, sizeof(struct cacheWriter));
+	
+	// Error checks the allocation of the deques, the block amounts, the file systems, the statistics, the lists and the threads.
+	if (deques == NULL || operandBlockAmounts == NULL || operandDevices == NULL || (options->statistics != 0 && scanner->statistics == NULL) || (options->topAmount > 0 && topLists == NULL) ||
+		threadInfos == NULL || threads == NULL || cacheWriters == NULL) {
+		if (deques != NULL) {
+			freeDirectoryDeques(deques, threadAmount);
+		}
+		if (topLists != NULL) {
+			finishTopLists(scanner, topLists, threadAmount);
+		}
+		free(operandBlockAmounts);
+		free(operandDevices);
+		free(threadInfos);
+		free(threads);
+		free(cacheWriters);
+		if (sharedLinks == NULL) {
+			freeLinkSet(&ownLinks);
+		}
+		scanner->errorNumber = ENOMEM;
+		return MDU_ERROR_MEMORY;
+	}
+	
+	// The arena for the items of the directories in the program arguments.
+	struct itemArena arena;
+	createItemArena(&arena);
+	
+	// Keeps track of the directories that are left and of the threads that are waiting for work.
+	struct workTracker work;
+	
+	// Opens the cache (if one has been asked for), each thread writes its own part of the new cache.
+	struct scanCache cache;
+	if (options->cachePath != NULL) {
+		startScanCache(options, &cache, cacheWriters, threadAmount);
+	}
+	
+	// The amount of directories that are open (the limit leaves room for the other files).
+	atomic_int openDirectories;
+	atomic_init(&openDirectories, 0);
+	int openDirectoryLimit = getOpenFileLimit()/2;
+	
+	// How many directories may be waiting, at least a few for each thread so that none of them runs out of work.
+	long maxQueue = options->maxQueue > 0 ? options->maxQueue : DEFAULT_MAX_QUEUE;
+	if (maxQueue < 4*threadAmount) {
+		maxQueue = 4*threadAmount;
+	}
+	
+	// Sets the default exit value to be MDU_SUCCESS.
+	atomic_int exitval;
+	atomic_init(&exitval, MDU_SUCCESS);
+	atomic_int scanError;
+	atomic_init(&scanError, 0);
+	
+	/**
+	 * The files/directories are checked before the search starts. If one of them can't
+	 * be checked the ones before it are still searched and handed over before the search fails.
+	 */
+	int statError = 0;
+	int directoryAmount = 0;
+	int index = 0;
+	// Goes through the list of files/directories.
+	while (index < fileAmount) {
+		
+		// Struct to store info about the current file.
+		struct fileAttributes fileStat;
+		
+		// Stores the file info in the fileStat struct.
+		int statCheck = getFileAttributes(AT_FDCWD, files[index], getAttributeFlags(options), &fileStat);
+
+		// Error checks the storing of the file info.
+		if (statCheck == -1) {
+			statError = errno;
+			fileAmount = index;
+			break;
+		}
+		
+		// Starts with the number of blocks allocated to the file (nothing if it is another link to a file that has been counted).
+		int firstLink = 1;
+		if (!S_ISDIR(fileStat.mode) && options->countLinks == 0 && fileStat.links > 1) {
+			firstLink = addLink(links, NULL, fileStat.device, fileStat.inode);
+			if (firstLink == -1) {
+				atomic_store(&scanError, MDU_ERROR_MEMORY);
+				scanner->errorNumber = ENOMEM;
+				break;
+			}
+		}
+		atomic_init(&operandBlockAmounts[index], firstLink == 1 ? fileStat.blocks : 0);
+		operandDevices[index] = fileStat.device;
+		
+		// If the current file is a directory it is added to one of the deques (spread out over the threads).
+		if (S_ISDIR(fileStat.mode)) {
+			struct directoryItem *item = createDirectoryItem(&arena, NULL, files[index], -1, index, 0);
+			if (item == NULL || addDirectory(&deques[directoryAmount % threadAmount], item) == -1) {
+				if (item != NULL && releaseDirectoryItem(item) == 1) {
+					freeDirectoryItem(item);
+				}
+				atomic_store(&scanError, MDU_ERROR_MEMORY);
+				scanner->errorNumber = ENOMEM;
+				break;
+			}
+			directoryAmount++;
+		}
+		
+		index++;
+	}
+	
+	// Shows the progress (if it has been asked for), the estimate comes from the directories that are waiting.
+	struct progressReporter progress;
+	int progressCheck = -1;
+	
+	// Tunes the amount of active threads (with -j auto, all the threads are created but only some of them search).
+	struct threadTuner tuner;
+	int tunerCheck = -1;
+	
+	// All the directories are searched by the same threads (at the same time).
+	if (directoryAmount > 0 && atomic_load(&scanError) == 0) {
+		createWorkTracker(&work, directoryAmount);
+		if (options->maximumThreads > 0) {
+			tunerCheck = createThreadTuner(&tuner, &work, options->minimumThreads, threadAmount);
+		}
+		if (options->progressFd != -1) {
+			progressCheck = startProgress(&progress, options->progressFd, threadAmount, &work.pendingDirectories);
+		}
+		
+		int threadIndex = 0;
+		// Goes through each thread.
+		while (threadIndex < threadAmount) {
+			
+			// Prepares the thread info struct that gets sent into the function.
+			threadInfos[threadIndex].threadNumber = threadIndex;
+			threadInfos[threadIndex].threadAmount = threadAmount;
+			threadInfos[threadIndex].options = options;
+			threadInfos[threadIndex].scanner = scanner;
+			threadInfos[threadIndex].scanError = &scanError;
+			threadInfos[threadIndex].deques = deques;
+			threadInfos[threadIndex].work = &work;
+			threadInfos[threadIndex].maxQueue = maxQueue;
+			threadInfos[threadIndex].blockAmounts = operandBlockAmounts;
+			threadInfos[threadIndex].exclude = exclude;
+			threadInfos[threadIndex].operandDevices = operandDevices;
+			threadInfos[threadIndex].links = options->countLinks == 0 ? links : NULL;
+			threadInfos[threadIndex].frontier = frontiers != NULL ? &frontiers[threadIndex] : NULL;
+			threadInfos[threadIndex].openDirectories = &openDirectories;
+			threadInfos[threadIndex].openDirectoryLimit = openDirectoryLimit;
+			threadInfos[threadIndex].exitValuePointer = &exitval;
+			threadInfos[threadIndex].statistics = NULL;
+			if (options->statistics != 0) {
+				threadInfos[threadIndex].statistics = &scanner->statistics[threadIndex];
+			}
+			threadInfos[threadIndex].progress = NULL;
+			if (progressCheck == 0) {
+				threadInfos[threadIndex].progress = &progress.counters[threadIndex];
+			}
+			threadInfos[threadIndex].tuning = NULL;
+			if (tunerCheck == 0) {
+				threadInfos[threadIndex].tuning = &tuner.counters[threadIndex];
+			}
+			threadInfos[threadIndex].topFiles = NULL;
+			threadInfos[threadIndex].topDirectories = NULL;
+			if (topLists != NULL) {
+				threadInfos[threadIndex].topFiles = &topLists[2*threadIndex];
+				threadInfos[threadIndex].topDirectories = &topLists[2*threadIndex + 1];
+			}
+			threadInfos[threadIndex].cache = NULL;
+			threadInfos[threadIndex].cacheWriter = NULL;
+			if (options->cachePath != NULL) {
+				threadInfos[threadIndex].cache = &cache;
+				threadInfos[threadIndex].cacheWriter = &cacheWriters[threadIndex];
+			}
+			
+			// Creates a thread to run the searchDirectoryParallel function.
+			int createCheck = pthread_create(&threads[threadIndex], NULL, searchDirectoryParallel, &threadInfos[threadIndex]);
+
+			/**
+			 * Error checks the creation of the thread. The threads that are already running
+			 * empty the deques without searching (the directories of the missing threads are
+			 * stolen), and all of them are kept active since the tuner does not run.
+			 */
+			if (createCheck != 0) {
+				errno = createCheck;
+				setScanError(&threadInfos[threadIndex], MDU_ERROR_THREAD, NULL);
+				setActiveThreads(&work, threadAmount);
+				break;
+			}
+			
+			threadIndex++;
+		}
+		
+		// Moves the amount of active threads towards the fastest one until the search is done.
+		if (tunerCheck == 0 && threadIndex == threadAmount) {
+			runThreadTuner(&tuner);
+		}
+		
+		// Waits for the threads that were created to terminate.
+		for (int joinIndex = 0; joinIndex < threadIndex; joinIndex++) {
+			pthread_join(threads[joinIndex], NULL);
+		}
+		
+		if (progressCheck == 0) {
+			stopProgress(&progress);
+		}
+		if (tunerCheck == 0) {
+			freeThreadTuner(&tuner);
+		}
+	}
+	
+	// The directories that were queued for a search that never started are given back to the arena.
+	else if (directoryAmount > 0) {
+		releaseQueuedDirectories(deques, threadAmount);
+	}
+	
+	// Writes the new cache (only if the search went through, a failed search would leave directories out).
+	if (options->cachePath != NULL) {
+		finishScanCache(scanner, &cache, cacheWriters, threadAmount, atomic_load(&scanError) == 0 && statError == 0);
+	}
+	
+	// Hands over the disk usage of each file/directory (in the order they were given).
+	struct mduCallbacks *callbacks = &scanner->callbacks;
+	index = 0;
+	while (index < fileAmount && atomic_load(&scanError) == 0) {
+		blkcnt_t blockAmount = atomic_load(&operandBlockAmounts[index]);
+		if (blockAmounts != NULL) {
+			blockAmounts[index] = blockAmount;
+		}
+		if (callbacks->directory != NULL) {
+			callbacks->directory(callbacks->data, files[index], blockAmount, 0);
+		}
+		index++;
+	}
+	scanner->nanoseconds = getStatisticsTime() - startTime;
+	if (topLists != NULL) {
+		finishTopLists(scanner, topLists, threadAmount);
+	}
+	
+	// Frees the block amounts, the file systems, the threads, the deques and the arena.
+	free(operandBlockAmounts);
+	free(operandDevices);
+	free(threadInfos);
+	free(threads);
+	free(cacheWriters);
+	if (sharedLinks == NULL) {
+		freeLinkSet(&ownLinks);
+	}
+	freeDirectoryDeques(deques, threadAmount);
+	freeItemArena(&arena);
+	
+	// Fails if one of the files/directories could not be checked.
+	if (atomic_load(&scanError) == 0 && statError != 0) {
+		scanner->errorNumber = statError;
+		scanner->errorPath = strdup(files[fileAmount]);
+		return MDU_ERROR_STAT;
+	}
+	if (atomic_load(&scanError) != 0) {
+		return atomic_load(&scanError);
+	}
+	return atomic_load(&exitval);
+}
+
+/**
+ * Sets up the things that a thread needs for its search: the directory reader
+ * and, if the user has asked for it, an io_uring ring (if io_uring can not be
+ * used the thread falls back to one statx call at a time).
+ *
+ * @param threadInfo	The information about the thread.
+ * @return 0 or -1		0 on success, -1 if there was no memory for the reader (the thread still has to be torn down).
+ */
+static int setUpThread(struct threadInformation *threadInfo) {
+	
+	threadInfo->linkCache = NULL;
+	threadInfo->attributeFlags = getAttributeFlags(threadInfo->options);
+	createItemArena(&threadInfo->arena);
+	memset(&threadInfo->cacheNames, 0, sizeof(threadInfo->cacheNames));
+	threadInfo->ringPointer = NULL;
+	threadInfo->inlineLevels = NULL;
+	threadInfo->inlineDepth = 0;
+	if (createDirectoryReader(&threadInfo->reader) == -1) {
+		return -1;
+	}
+	
+	// The thread remembers the files with more than one link that it has found counted, without taking a lock.
+	if (threadInfo->links != NULL) {
+		threadInfo->linkCache = calloc(1, sizeof(struct linkCache));
+		if (threadInfo->linkCache == NULL) {
+			return -1;
+		}
+	}
+	
+	if (threadInfo->options->ioUring == 1 && createStatRing(&threadInfo->ring) == 0) {
+		threadInfo->ringPointer = &threadInfo->ring;
+	}
+	return 0;
+}
+
+/**
+ * Frees the things that a thread used for its search.
+ *
+ * @param threadInfo	The information about the thread.
+ */
+static void tearDownThread(struct threadInformation *threadInfo) {
+	
+	freeDirectoryReader(&threadInfo->reader);
+	freeItemArena(&threadInfo->arena);
+	freeNameList(&threadInfo->cacheNames);
+	free(threadInfo->linkCache);
+	threadInfo->linkCache = NULL;
+	if (threadInfo->inlineLevels != NULL) {
+		for (int level = 0; level < MAX_INLINE_DEPTH; level++) {
+			if (threadInfo->inlineLevels[level].created) {
+				freeDirectoryReader(&threadInfo->inlineLevels[level].reader);
+				freeNameList(&threadInfo->inlineLevels[level].cacheNames);
+			}
+		}
+		free(threadInfo->inlineLevels);
+	}
+	if (threadInfo->ringPointer != NULL) {
+		destroyStatRing(threadInfo->ringPointer);
+	}
+}
+
+/**
+ * Opens the cache from the last search and prepares the writers for the new
+ * one (one for each thread).
+ *
+ * @param options		The options for the search.
+ * @param cache			The cache.
+ * @param writers		The cache writers.
+ * @param writerAmount	The amount of writers.
+ */
+static void startScanCache(struct scanOptions *options, struct scanCache *cache, struct cacheWriter *writers, int writerAmount) {
+	
+	openScanCache(cache, options->cachePath);
+	
+	time_t startTime = time(NULL);
+	for (int i = 0; i < writerAmount; i++) {
+		createCacheWriter(&writers[i], startTime);
+	}
+}
+
+/**
+ * Writes the new cache and closes the old one. If the new cache can't be
+ * written the sizes are still correct, so the error callback only gets a
+ * warning (MDU_ERROR_CACHE) and the search goes on.
+ *
+ * @param scanner		The scanner of the search.
+ * @param cache			The cache.
+ * @param writers		The cache writers.
+ * @param writerAmount	The amount of writers.
+ * @param write			If the new cache is written (a search that failed only frees it).
+ */
+static void finishScanCache(struct mduScanner *scanner, struct scanCache *cache, struct cacheWriter *writers, int writerAmount, int write) {
+	
+	struct mduCallbacks *callbacks = &scanner->callbacks;
+	if (write && writeScanCache(scanner->options.cachePath, writers, writerAmount) == -1 && callbacks->error != NULL) {
+		callbacks->error(callbacks->data, MDU_ERROR_CACHE, scanner->options.cachePath, errno);
+	}
+	
+	for (int i = 0; i < writerAmount; i++) {
+		freeCacheWriter(&writers[i]);
+	}
+	closeScanCache(cache);
+}
+
+/**
+ * Gets the next directory for a thread to search. The thread first takes from
+ * its own deque, then tries to steal from the other threads deques and if all
+ * of them are empty it sleeps until more directories are added or until all
+ * directories have been searched (which means that the search is done).
+ *
+ * @param threadInfo	The information about the thread.
+ * @return directory	The directory to search or NULL if the search is done.
+ */
+static struct directoryItem *getNextDirectory(struct threadInformation *threadInfo) {
+	
+	int threadNumber = threadInfo->threadNumber;
+	int threadAmount = threadInfo->threadAmount;
+	
+	// Gets a directory from the threads own deque (no locking needed), unless the thread tuner has parked the thread.
+	struct directoryItem *directory = NULL;
+	if (isThreadActive(threadInfo->work, threadNumber)) {
+		directory = getDirectory(&threadInfo->deques[threadNumber]);
+		if (directory != NULL) {
+			return directory;
+		}
+	}
+	
+	// The time until another directory is found counts as idle.
+	long long idleStart = 0;
+	if (threadInfo->statistics != NULL) {
+		idleStart = getStatisticsTime();
+	}
+	
+	// Loop that will iterate until a directory is found or the search is done.
+	while (directory == NULL) {
+		
+		// A parked thread sleeps until it is needed again (the active threads steal the directories in its deque meanwhile).
+		if (!isThreadActive(threadInfo->work, threadNumber)) {
+			flushResults(threadInfo);
+			waitUntilActive(threadInfo->work, threadNumber);
+			directory = getDirectory(&threadInfo->deques[threadNumber]);
+			if (directory != NULL) {
+				break;
+			}
+		}
+		
+		// Tries to steal a directory from one of the other threads.
+		directory = stealDirectory(threadInfo->deques, threadAmount, threadNumber);
+		if (directory != NULL || isWorkDone(threadInfo->work)) {
+			break;
+		}
+		
+		/**
+		 * All deques seem to be empty so the thread marks itself as idle. The deques
+		 * are checked again after that so that a thread that adds a directory at the
+		 * same time either gets seen here or sees the idle thread and wakes it.
+		 */
+		unsigned int wakeups = startIdling(threadInfo->work);
+		directory = stealDirectory(threadInfo->deques, threadAmount, threadNumber);
+		if (directory == NULL && !isWorkDone(threadInfo->work)) {
+			
+			// What the thread has found so far is written out before it sleeps, so the results keep coming.
+			flushResults(threadInfo);
+			waitForWork(threadInfo->work, wakeups);
+		}
+		stopIdling(threadInfo->work);
+	}
+	
+	if (threadInfo->statistics != NULL) {
+		threadInfo->statistics->idleNanoseconds = threadInfo->statistics->idleNanoseconds + getStatisticsTime() - idleStart;
+	}
+	
+	return directory;
+}
+
+/**
+ * Puts together the full path of a directory (or of an entry in it). The full
+ * path is only put together when it is needed.
+ *
+ * @param directory	The directory.
+ * @param name		The name of the entry (NULL for the directory itself).
+ * @return fullPath	The full path (has to be freed by the caller, NULL if there was no memory for it).
+ */
+static char *getItemEntryPath(struct directoryItem *directory, const char *name) {
+	
+	char *fullPath = getItemPath(directory);
+	if (fullPath == NULL || name == NULL) {
+		return fullPath;
+	}
+	
+	char *entryPath = getEntryPath(fullPath, name);
+	free(fullPath);
+	return entryPath;
+}
+
+/**
+ * Hands a directory (or one of its subdirectories) that can not be read to
+ * the error callback.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory.
+ * @param name			The name of the subdirectory (NULL for the directory itself).
+ */
+static void reportItemError(struct threadInformation *threadInfo, struct directoryItem *directory, char *name) {
+	
+	if (threadInfo->scanner->callbacks.error == NULL) {
+		return;
+	}
+	
+	// Saves the error before the path is put together.
+	int error = errno;
+	char *fullPath = getItemEntryPath(directory, name);
+	errno = error;
+	
+	if (fullPath == NULL) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return;
+	}
+	reportError(threadInfo, fullPath);
+	free(fullPath);
+}
+
+/**
+ * Hands the disk usage of a directory (or of an entry in it) to the callbacks.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory.
+ * @param name			The name of the entry (NULL for the directory itself).
+ * @param blockAmount	The amount of blocks the directory/entry takes on the disk.
+ * @param isDirectory	If the directory/entry is a directory.
+ */
+static void reportItemUsage(struct threadInformation *threadInfo, struct directoryItem *directory, char *name, blkcnt_t blockAmount, int isDirectory) {
+	
+	if (!isUsageWanted(threadInfo, isDirectory)) {
+		return;
+	}
+	
+	char *fullPath = getItemEntryPath(directory, name);
+	if (fullPath == NULL) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return;
+	}
+	reportUsage(threadInfo, fullPath, blockAmount, name == NULL ? directory->depth : directory->depth + 1, isDirectory);
+	free(fullPath);
+}
+
+/**
+ * Finishes a directory once it and everything in it has been searched. The
+ * directories total is added to its parent (or to the file/directory in the
+ * program arguments) and printed if it is not too deep. Finishing the last
+ * subdirectory of a parent finishes the parent as well, so the totals are
+ * added up from the bottom of the tree without any locks.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory whose own reference has been released.
+ */
+static void finishDirectoryItem(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	// Goes up through the parents for as long as the last reference is released.
+	while (directory != NULL && releaseDirectoryItem(directory) == 1) {
+		
+		struct directoryItem *parent = directory->parent;
+		blkcnt_t blockAmount = atomic_load_explicit(&directory->blocks, memory_order_relaxed);
+		
+		// The total of a directory in the program arguments is handed over once all threads are done.
+		if (parent == NULL) {
+			atomic_fetch_add_explicit(&threadInfo->blockAmounts[directory->operand], blockAmount, memory_order_relaxed);
+		}
+		else {
+			if (directory->entryAmount == 0 && directory->depth <= threadInfo->options->maxDepth && !isScanFailed(threadInfo)) {
+				reportItemUsage(threadInfo, directory, NULL, blockAmount, 1);
+			}
+			
+			// Keeps the directory if it is one of the largest ones so far (in the list of the thread that finished it).
+			if (directory->entryAmount == 0 && threadInfo->topDirectories != NULL && isTopCandidate(threadInfo->topDirectories, blockAmount) && !isScanFailed(threadInfo)) {
+				addTopPath(threadInfo, threadInfo->topDirectories, getItemEntryPath(directory, NULL), blockAmount);
+			}
+			atomic_fetch_add_explicit(&parent->blocks, blockAmount, memory_order_relaxed);
+		}
+		
+		freeDirectoryItem(directory);
+		directory = parent;
+	}
+}
+
+/**
+ * Releases a reference to a directories file descriptor. Once nothing needs
+ * the file descriptor any more the directory is closed and its own reference
+ * is released (which finishes it if everything in it has been searched).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory.
+ */
+static void closeItem(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	if (closeDirectoryItem(directory, threadInfo->openDirectories) == 1) {
+		finishDirectoryItem(threadInfo, directory);
+	}
+}
+
+/**
+ * Lets go of a directory without searching it, once the search has failed.
+ * A directory that was never opened (and a chunk) lets go of its parents file
+ * descriptor as well, just like it would have after opening it.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory.
+ */
+static void dropDirectoryItem(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	if (directory->fd == -1 && directory->parent != NULL) {
+		closeItem(threadInfo, directory->parent);
+	}
+	closeItem(threadInfo, directory);
+}
+
+/**
+ * Adds a directory to a threads own deque and wakes a waiting thread if there
+ * is one. If the deque can not grow the directory is dropped and the search
+ * fails.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory to add.
+ */
+static void publishDirectory(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	addPendingDirectory(threadInfo->work);
+	if (addDirectory(&threadInfo->deques[threadInfo->threadNumber], directory) == -1) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		dropDirectoryItem(threadInfo, directory);
+		finishPendingDirectory(threadInfo->work);
+		return;
+	}
+	wakeIdleThread(threadInfo->work);
+}
+
+/**
+ * Checks if a subdirectory should be searched in line instead of being handed
+ * over, which is the case once too many directories are waiting. The thread
+ * then goes depth first through what it finds, so the waiting directories
+ * (and the memory they take) stop growing, while the ones that are already
+ * waiting keep the other threads busy.
+ *
+ * @param threadInfo	The information about the thread.
+ * @return inline		1 if the subdirectory should be searched in line, otherwise 0.
+ */
+static int isQueueFull(struct threadInformation *threadInfo) {
+	return threadInfo->inlineDepth < MAX_INLINE_DEPTH && atomic_load_explicit(&threadInfo->work->pendingDirectories, memory_order_relaxed) >= threadInfo->maxQueue;
+}
+
+/**
+ * Searches a subdirectory in line, right away and by the thread that found
+ * it. The reader (and the cache names) of the directory that it is in are put
+ * aside for the time of the search, since they are still needed afterwards.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The subdirectory.
+ * @return 0 or -1		0 if it was searched, -1 if there was no memory for another level (it has to be handed over).
+ */
+static int searchDirectoryInline(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	if (threadInfo->inlineLevels == NULL) {
+		threadInfo->inlineLevels = calloc(MAX_INLINE_DEPTH, sizeof(struct inlineLevel));
+		if (threadInfo->inlineLevels == NULL) {
+			return -1;
+		}
+	}
+	
+	struct inlineLevel *level = &threadInfo->inlineLevels[threadInfo->inlineDepth];
+	if (!level->created) {
+		if (createDirectoryReader(&level->reader) == -1) {
+			return -1;
+		}
+		level->created = 1;
+	}
+	
+	// Swaps the readers and the cache names of the directory and of the subdirectory.
+	struct directoryReader reader = threadInfo->reader;
+	struct nameList cacheNames = threadInfo->cacheNames;
+	threadInfo->reader = level->reader;
+	threadInfo->cacheNames = level->cacheNames;
+	level->reader = reader;
+	level->cacheNames = cacheNames;
+	
+	if (threadInfo->statistics != NULL) {
+		threadInfo->statistics->inlineDirectories++;
+	}
+	threadInfo->inlineDepth++;
+	searchDirectoryItem(threadInfo, directory);
+	threadInfo->inlineDepth--;
+	
+	// Swaps them back.
+	reader = threadInfo->reader;
+	cacheNames = threadInfo->cacheNames;
+	threadInfo->reader = level->reader;
+	threadInfo->cacheNames = level->cacheNames;
+	level->reader = reader;
+	level->cacheNames = cacheNames;
+	
+	return 0;
+}
+
+/**
+ * Checks the entries in the threads current batch and adds up their block
+ * amounts. The attributes of the whole batch are fetched at once (through the
+ * threads io_uring ring if it has one) and the subdirectories that are found
+ * are added to the threads deque.
+ *
+ * @param threadInfo		The information about the thread.
+ * @param directory			The directory that the entries are in.
+ * @return totalBlockAmount	The amount of blocks the entries take on the disk.
+ */
+static blkcnt_t checkEntryBatch(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	blkcnt_t totalBlockAmount = 0;
+	struct entryBatch *batch = &threadInfo->reader.batch;
+	
+	// Gets the attributes of all the entries in the batch.
+	getBatchAttributes(threadInfo->ringPointer, directory->fd, batch->names, batch->amount, threadInfo->attributeFlags, batch->attributes, batch->errors, threadInfo->statistics);
+	
+	// Goes through each entry in the batch.
+	for (int index = 0; index < batch->amount; index++) {
+		
+		// Error checks the storing of the file info (a file that can not be checked stops the search).
+		if (batch->errors[index] != 0) {
+			errno = batch->errors[index];
+			setScanError(threadInfo, MDU_ERROR_STAT, getItemEntryPath(directory, batch->names[index]));
+			break;
+		}
+		
+		// Checks if the file is a directory.
+		int directoryCheck = S_ISDIR(batch->attributes[index].mode);
+		
+		// If the file is not a directory its block amount is added to the total block amount (only for the first link of a file with more than one).
+		if (directoryCheck == 0) {
+			if (!isFirstLink(threadInfo, &batch->attributes[index])) {
+				continue;
+			}
+			totalBlockAmount = batch->attributes[index].blocks + totalBlockAmount;
+			
+			// Hands over the disk usage of the file if all files are wanted and it is not too deep.
+			if (threadInfo->options->allFiles == 1 && directory->depth < threadInfo->options->maxDepth) {
+				reportItemUsage(threadInfo, directory, batch->names[index], batch->attributes[index].blocks, 0);
+			}
+			
+			// Keeps the file if it is one of the largest ones so far.
+			if (threadInfo->topFiles != NULL && isTopCandidate(threadInfo->topFiles, batch->attributes[index].blocks)) {
+				addTopPath(threadInfo, threadInfo->topFiles, getItemEntryPath(directory, batch->names[index]), batch->attributes[index].blocks);
+			}
+		}
+		
+		// A directory on another file system is left out completely with -x (it is not counted or opened).
+		else if (threadInfo->options->oneFileSystem == 1 && batch->attributes[index].device != threadInfo->operandDevices[directory->operand]) {
+			if (threadInfo->statistics != NULL) {
+				threadInfo->statistics->prunedEntries++;
+			}
+		}
+		
+		// With a frontier the subdirectory is only collected, with its own blocks (the estimate samples everything in it).
+		else if (threadInfo->frontier != NULL) {
+			char *subdirectoryPath = getItemEntryPath(directory, batch->names[index]);
+			if (subdirectoryPath == NULL || addName(threadInfo->frontier, subdirectoryPath, batch->attributes[index].blocks) == -1) {
+				free(subdirectoryPath);
+				setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+				break;
+			}
+			free(subdirectoryPath);
+		}
+		
+		// If the file is a directory (its block amount goes with it to the thread that searches it).
+		else {
+			
+			// Remembers the subdirectory for the new cache.
+			if (threadInfo->cacheWriter != NULL && addName(&threadInfo->cacheNames, batch->names[index], 0) == -1) {
+				setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+				break;
+			}
+			
+			int subdirectoryFd = -1;
+			
+			/**
+			 * If there is room for more open directories the directory is opened now,
+			 * and handed over open so that it is only opened once.
+			 */
+			if (atomic_load_explicit(threadInfo->openDirectories, memory_order_relaxed) < threadInfo->openDirectoryLimit) {
+				subdirectoryFd = openat(directory->fd, batch->names[index], O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+				if (threadInfo->statistics != NULL) {
+					threadInfo->statistics->openCalls++;
+				}
+				
+				// If the directory can't be opened (and not just because too many files are open).
+				if (subdirectoryFd == -1 && errno != EMFILE && errno != ENFILE) {
+					
+					// Hands over the error and sets the exit value to failure.
+					reportItemError(threadInfo, directory, batch->names[index]);
+					setExitFailure(threadInfo);
+					
+					// The directory still counts with its own blocks (added straight to the directory, so they stay out of its cached file blocks).
+					atomic_fetch_add_explicit(&directory->blocks, batch->attributes[index].blocks, memory_order_relaxed);
+					addProgress(threadInfo->progress, 0, 0, batch->attributes[index].blocks);
+					if (directory->depth < threadInfo->options->maxDepth) {
+						reportItemUsage(threadInfo, directory, batch->names[index], batch->attributes[index].blocks, 1);
+					}
+					if (threadInfo->topDirectories != NULL && isTopCandidate(threadInfo->topDirectories, batch->attributes[index].blocks)) {
+						addTopPath(threadInfo, threadInfo->topDirectories, getItemEntryPath(directory, batch->names[index]), batch->attributes[index].blocks);
+					}
+					continue;
+				}
+				
+				if (subdirectoryFd != -1) {
+					atomic_fetch_add_explicit(threadInfo->openDirectories, 1, memory_order_relaxed);
+				}
+			}
+			
+			// Error checks the creation of the item (the directory is closed again if it was opened).
+			struct directoryItem *subdirectory = createDirectoryItem(&threadInfo->arena, directory, batch->names[index], subdirectoryFd, directory->operand, batch->attributes[index].blocks);
+			if (subdirectory == NULL) {
+				if (subdirectoryFd != -1) {
+					close(subdirectoryFd);
+					atomic_fetch_sub_explicit(threadInfo->openDirectories, 1, memory_order_relaxed);
+				}
+				setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+				break;
+			}
+			
+			/**
+			 * Adds the directory to the threads deque and wakes a waiting thread (if the directory,
+			 * is not open it gets opened relative to this directory by the thread that searches it).
+			 * If too many directories are waiting already it is searched in line instead.
+			 */
+			if (!isQueueFull(threadInfo) || searchDirectoryInline(threadInfo, subdirectory) == -1) {
+				publishDirectory(threadInfo, subdirectory);
+			}
+		}
+	}
+	
+	return totalBlockAmount;
+}
+
+/**
+ * Hands parts of the threads current batch over to the threads that are idle,
+ * so that the entries of a very large directory are checked by several
+ * threads. Only batches after the first one are shared (a directory that fits
+ * in one batch costs nothing extra), and the batch is only split into as many
+ * chunks as there are idle threads to take them. The thread keeps the first
+ * chunk in its batch. Nothing is shared when a cache is written, since the
+ * names of all the subdirectories of a directory have to end up in the same
+ * thread's part of the cache.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory that the entries are in.
+ */
+static void shareEntryBatch(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	struct entryBatch *batch = &threadInfo->reader.batch;
+	if (threadInfo->threadAmount == 1 || threadInfo->cacheWriter != NULL) {
+		return;
+	}
+	
+	// Each chunk has at least a few hundred entries, so that the chunk is worth more than handing it over.
+	int chunkAmount = atomic_load_explicit(&threadInfo->work->idleThreads, memory_order_relaxed) + 1;
+	if (chunkAmount > batch->amount/MINIMUM_CHUNK_SIZE) {
+		chunkAmount = batch->amount/MINIMUM_CHUNK_SIZE;
+	}
+	if (chunkAmount < 2) {
+		return;
+	}
+	
+	// The last chunks are handed over and the first one stays in the batch (with the rest if there is no memory for a chunk).
+	int chunkSize = batch->amount/chunkAmount;
+	for (int chunk = chunkAmount - 1; chunk > 0; chunk--) {
+		int first = chunk*chunkSize;
+		int amount = chunk == chunkAmount - 1 ? batch->amount - first : chunkSize;
+		struct directoryItem *item = createEntryChunk(&threadInfo->arena, directory, batch->names + first, amount);
+		if (item == NULL) {
+			batch->amount = first + amount;
+			return;
+		}
+		publishDirectory(threadInfo, item);
+	}
+	batch->amount = chunkSize;
+}
+
+/**
+ * Checks a chunk of a directories entries that another thread has handed
+ * over. The entries are checked the same way as the ones that the thread
+ * reads itself, relative to the directory that they are in, and their blocks
+ * are added to the directory once the chunk is released.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param chunk			The chunk.
+ */
+static void searchEntryChunk(struct threadInformation *threadInfo, struct directoryItem *chunk) {
+	
+	long long chunkStart = 0;
+	if (threadInfo->tuning != NULL) {
+		chunkStart = getStatisticsTime();
+	}
+	
+	const char *names = chunk->name;
+	int amount = chunk->entryAmount;
+	blkcnt_t totalBlockAmount = 0;
+	// Goes through the chunk one batch at a time (until the search fails).
+	while (!isScanFailed(threadInfo) && readNameBatch(&threadInfo->reader, &names, &amount) > 0) {
+		totalBlockAmount = checkEntryBatch(threadInfo, chunk->parent) + totalBlockAmount;
+	}
+	atomic_fetch_add_explicit(&chunk->blocks, totalBlockAmount, memory_order_relaxed);
+	
+	// The entries were already counted by the thread that read them.
+	addProgress(threadInfo->progress, 0, 0, totalBlockAmount);
+	if (threadInfo->tuning != NULL) {
+		addTunerSample(threadInfo->tuning, 0, getStatisticsTime() - chunkStart);
+	}
+	
+	// Lets go of the directory and of the chunk (which adds the blocks to the directory).
+	closeItem(threadInfo, chunk->parent);
+	closeItem(threadInfo, chunk);
+}
+
+/**
+ * Searches a directory: opens it (if it was not handed over open), reads its
+ * entries in batches and checks them, and adds up the blocks of its files.
+ * The subdirectories that are found are handed over to the other threads, or
+ * searched in line once too many directories are waiting.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param directory		The directory (released by the function).
+ */
+static void searchDirectoryItem(struct threadInformation *threadInfo, struct directoryItem *directory) {
+	
+	if (threadInfo->statistics != NULL) {
+		threadInfo->statistics->directories++;
+	}
+	
+	// The time the directory takes is only needed by the thread tuner.
+	long long directoryStart = 0;
+	if (threadInfo->tuning != NULL) {
+		directoryStart = getStatisticsTime();
+	}
+	
+	// Nothing has been added to the directories blocks yet, so they are its own blocks (only read for the progress).
+	blkcnt_t ownBlockAmount = 0;
+	if (threadInfo->progress != NULL) {
+		ownBlockAmount = atomic_load_explicit(&directory->blocks, memory_order_relaxed);
+	}
+	
+	// If the directory was not handed over open it is opened relative to its parent (or the working directory).
+	if (directory->fd == -1) {
+		int parentFd = AT_FDCWD;
+		if (directory->parent != NULL) {
+			parentFd = directory->parent->fd;
+		}
+		directory->fd = openat(parentFd, directory->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (threadInfo->statistics != NULL) {
+			threadInfo->statistics->openCalls++;
+		}
+		
+		// Error checks the opening of the directory.
+		if (directory->fd == -1) {
+			reportItemError(threadInfo, directory, NULL);
+			setExitFailure(threadInfo);
+		}
+		else {
+			atomic_fetch_add_explicit(threadInfo->openDirectories, 1, memory_order_relaxed);
+		}
+		
+		// The parents file descriptor is no longer needed once the directory has been opened.
+		if (directory->parent != NULL) {
+			closeItem(threadInfo, directory->parent);
+		}
+		
+		// Continues with the next directory if this one could not be opened.
+		if (directory->fd == -1) {
+			closeItem(threadInfo, directory);
+			return;
+		}
+	}
+	
+	// If the directory has not changed since the last search its files are taken from the cache.
+	struct fileAttributes directoryAttributes;
+	const char *cachedNames = NULL;
+	int cachedAmount = 0;
+	blkcnt_t totalBlockAmount = 0;
+	const struct cacheEntry *cached = lookUpDirectory(threadInfo, directory->fd, &directoryAttributes);
+	if (cached != NULL) {
+		cachedNames = getCacheEntryNames(threadInfo->cache, cached);
+		cachedAmount = cached->subdirectoryAmount;
+		totalBlockAmount = cached->fileBlocks;
+	}
+	
+	long long entryAmount = 0;
+	int batchCheck = 0;
+	// Goes through the directory one batch of entries at a time (only the subdirectories if it is cached, until the search fails).
+	while (!isScanFailed(threadInfo) && (batchCheck = readDirectoryBatch(threadInfo, directory->fd, cached, &cachedNames, &cachedAmount)) > 0) {
+		
+		// A directory with more than one batch of entries is large, so the idle threads get a share of it.
+		if (entryAmount > 0 && cached == NULL) {
+			shareEntryBatch(threadInfo, directory);
+		}
+		entryAmount = entryAmount + batchCheck;
+		totalBlockAmount = checkEntryBatch(threadInfo, directory) + totalBlockAmount;
+	}
+	
+	// Error checks the reading of the directory (which stops the search).
+	if (batchCheck == -1) {
+		setScanError(threadInfo, MDU_ERROR_READ, getItemPath(directory));
+	}
+	
+	// Adds the directory to the new cache.
+	if (threadInfo->cacheWriter != NULL) {
+		if (directoryAttributes.inode != 0 && !isScanFailed(threadInfo)) {
+			addCacheEntry(threadInfo->cacheWriter, &directoryAttributes, totalBlockAmount, threadInfo->cacheNames.names, threadInfo->cacheNames.used, threadInfo->cacheNames.amount);
+		}
+		clearNameList(&threadInfo->cacheNames);
+	}
+	
+	// Adds the block amount of the files in the directory to the directories total.
+	atomic_fetch_add_explicit(&directory->blocks, totalBlockAmount, memory_order_relaxed);
+	addProgress(threadInfo->progress, entryAmount, 1, ownBlockAmount + totalBlockAmount);
+	// The time of a directory that is searched in line is already part of the time of the directory it is in.
+	if (threadInfo->tuning != NULL) {
+		addTunerSample(threadInfo->tuning, entryAmount, threadInfo->inlineDepth == 0 ? getStatisticsTime() - directoryStart : 0);
+	}
+	
+	// Releases the directory (it is closed once all its subdirectories have been opened).
+	closeItem(threadInfo, directory);
+}
+
+/**
+ * Searches directories in parallel (the directories of all the files/directories
+ * in the program arguments are searched by the same threads). The block amount
+ * of each directory is added to the file/directory in the program arguments
+ * that it belongs to.
+ *
+ * @param info	The information that each thread needs in order to do the search.
+ */
+static void *searchDirectoryParallel(void *info) {
+	
+	// Stores the thread info in local variables (for easier use).
+	struct threadInformation *threadInfo = (struct threadInformation*)info;
+	
+	// A thread without a reader can not search, but it still helps to let go of the directories.
+	if (setUpThread(threadInfo) == -1) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+	}
+	
+	// Loop that will iterate until all directories have been searched.
+	while (1) {
+		
+		// Gets a directory from the deques.
+		struct directoryItem *directory = getNextDirectory(threadInfo);
+		
+		// Exits the loop so the thread can exit.
+		if (directory == NULL) {
+			break;
+		}
+		
+		// Once the search has failed the directories that are left are only let go of.
+		if (isScanFailed(threadInfo)) {
+			dropDirectoryItem(threadInfo, directory);
+			finishPendingDirectory(threadInfo->work);
+			continue;
+		}
+		
+		// A chunk of a large directory that another thread has handed over.
+		if (directory->entryAmount > 0) {
+			searchEntryChunk(threadInfo, directory);
+			finishPendingDirectory(threadInfo->work);
+			continue;
+		}
+		
+		searchDirectoryItem(threadInfo, directory);
+		finishPendingDirectory(threadInfo->work);
+	}
+	
+	flushResults(threadInfo);
+	tearDownThread(threadInfo);
+	
+	return NULL;
+}
+
+/**
+ * Opens a directory relative to its parent and hands over an error if it can't.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param parentFd		The file descriptor of the parent directory.
+ * @param path			The path of the directory (its name is relative to the parent).
+ * @return directoryFd	The file descriptor of the directory or -1 if it can not be opened. 
+ */
+static int openDirectory(struct threadInformation *threadInfo, int parentFd, struct pathLink *path) {
+
+	// Opens the directory.
+	int directoryFd = openat(parentFd, path->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	
+	// Error checks the opening of the directory.
+	if (directoryFd == -1) {
+		reportDirectoryError(threadInfo, path);
+	}
+	
+	return directoryFd;
+}
+
+/**
+ * Gets the limit on open files of the process. The limit is only read, it is
+ * up to the program to raise it (the directories that the search keeps open
+ * are kept within it).
+ *
+ * @return limit	The amount of files that can be open.
+ */
+static int getOpenFileLimit(void) {
+	
+	struct rlimit fileLimit;
+	if (getrlimit(RLIMIT_NOFILE, &fileLimit) == -1) {
+		return 1024;
+	}
+	
+	if (fileLimit.rlim_cur == RLIM_INFINITY || fileLimit.rlim_cur > 1048576) {
+		return 1048576;
+	}
+	return fileLimit.rlim_cur;
+}
+
+/**
+ * Gets the name and the parent of a link in the chain of names of a path
+ * (for getChainPath).
+ *
+ * @param link		The link.
+ * @param parent	Where its parent is stored.
+ * @return name		The name of the link.
+ */
+static const char *getPathLinkName(const void *link, const void **parent) {
+	
+	const struct pathLink *path = link;
+	*parent = path->parent;
+	return path->name;
+}
+
+/**
+ * Puts together the full path of a directory from the chain of names that
+ * leads up to it.
+ *
+ * @param path		The path of the directory.
+ * @return fullPath	The full path (has to be freed by the caller, NULL if there was no memory for it).
+ */
+static char *getFullPath(struct pathLink *path) {
+	return getChainPath(path, getPathLinkName);
+}
+
+/**
+ * Hands a directory that can not be read to the error callback (with the
+ * reason from errno).
+ *
+ * @param threadInfo	The information about the thread.
+ * @param path			The path of the directory.
+ */
+static void reportDirectoryError(struct threadInformation *threadInfo, struct pathLink *path) {
+	
+	if (threadInfo->scanner->callbacks.error == NULL) {
+		return;
+	}
+	
+	// Saves the error before the path is put together.
+	int error = errno;
+	char *fullPath = getFullPath(path);
+	errno = error;
+	
+	if (fullPath == NULL) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return;
+	}
+	reportError(threadInfo, fullPath);
+	free(fullPath);
+}
+
+/**
+ * Hands the disk usage of a file/directory that is below one of the
+ * files/directories of the search to the callbacks.
+ *
+ * @param threadInfo	The information about the thread.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param directory		If it is a directory.
+ */
+static void reportPathUsage(struct threadInformation *threadInfo, struct pathLink *path, blkcnt_t blockAmount, int directory) {
+	
+	if (!isUsageWanted(threadInfo, directory)) {
+		return;
+	}
+	
+	char *fullPath = getFullPath(path);
+	if (fullPath == NULL) {
+		setScanError(threadInfo, MDU_ERROR_MEMORY, NULL);
+		return;
+	}
+	reportUsage(threadInfo, fullPath, blockAmount, path->depth, directory);
+	free(fullPath);
+}
+
+/**
+ * Gets the flags for the file attributes that the search needs.
+ *
+ * @param options			The options for the search.
+ * @return attributeFlags	The flags for getFileAttributes.
+ */
+int getAttributeFlags(struct scanOptions *options) {
+	
+	int attributeFlags = 0;
+	
+	// The file system may answer from its cache if the user has asked for a fast search.
+	if (options->fast == 1) {
+		attributeFlags = attributeFlags | ATTRIBUTES_DONT_SYNC;
+	}
+	
+	// The link count (and the inode) of the files is needed to count each file only once.
+	if (options->countLinks == 0) {
+		attributeFlags = attributeFlags | ATTRIBUTES_INODE;
+	}
+	
+	return attributeFlags;
+}
+
+/**
+ * Sets up a scanner with the default options: a recursive search where only
+ * the totals of the files/directories of the search are handed over, and no
+ * callbacks.
+ *
+ * @param scanner	The scanner.
+ */
+void mduInitScanner(struct mduScanner *scanner) {
+	
+	memset(scanner, 0, sizeof(*scanner));
+	scanner->options.progressFd = -1;
+}
+
+/**
+ * Frees what the last search left in a scanner (the path of its error and its
+ * statistics). The scanner can still be used for another search.
+ *
+ * @param scanner	The scanner.
+ */
+void mduFreeScanner(struct mduScanner *scanner) {
+	
+	free(scanner->errorPath);
+	free(scanner->statistics);
+	scanner->errorPath = NULL;
+	scanner->statistics = NULL;
+	scanner->statisticsAmount = 0;
+	
+	for (int index = 0; index < scanner->topFileAmount; index++) {
+		free(scanner->topFiles[index].path);
+	}
+	for (int index = 0; index < scanner->topDirectoryAmount; index++) {
+		free(scanner->topDirectories[index].path);
+	}
+	free(scanner->topFiles);
+	free(scanner->topDirectories);
+	scanner->topFiles = NULL;
+	scanner->topDirectories = NULL;
+	scanner->topFileAmount = 0;
+	scanner->topDirectoryAmount = 0;
+	
+	free(scanner->estimates);
+	scanner->estimates = NULL;
+	scanner->estimateAmount = 0;
+}
+
+/**
+ * Searches a list of files/directories and stores the total of each one. The
+ * totals are also handed to the directory callback (at depth 0) in the order
+ * of the list, and everything below them that is wanted to the other
+ * callbacks while the search goes on. If the search fails the files before
+ * the one that failed may have been handed over already.
+ *
+ * @param scanner		The scanner.
+ * @param files			The list of files/directories.
+ * @param fileAmount	The amount of files/directories.
+ * @param blockAmounts	Where the total of each file/directory is stored (NULL if only the callbacks are used).
+ * @return result		MDU_SUCCESS, MDU_INCOMPLETE or the error that stopped the search.
+ */
+int mduScan(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts) {
+	
+	mduFreeScanner(scanner);
+	scanner->errorNumber = 0;
+	scanner->nanoseconds = 0;
+	
+	// Checks that the options go together (watching is left to the program, since it never ends).
+	struct scanOptions *options = &scanner->options;
+	if (scanner->threadAmount < 0 || options->maxDepth < 0 || options->maxQueue < 0 || options->topAmount < 0 || options->watchInterval != 0 || options->progressFd < -1 ||
+		(options->maximumThreads > 0 && (options->minimumThreads < 1 || options->minimumThreads > options->maximumThreads || scanner->threadAmount != options->maximumThreads))) {
+		scanner->errorNumber = EINVAL;
+		return MDU_ERROR_OPTIONS;
+	}
+	
+	// An estimate only hands over the totals (and its budget has to end it somehow).
+	if (options->estimate != 0 && (options->allFiles != 0 || options->maxDepth != 0 || options->topAmount != 0 || options->cachePath != NULL || options->statistics != 0 ||
+		options->progressFd != -1 || options->estimateAccuracy < 0 || options->estimateSeconds < 0 || (options->estimateAccuracy == 0 && options->estimateSeconds == 0))) {
+		scanner->errorNumber = EINVAL;
+		return MDU_ERROR_OPTIONS;
+	}
+	
+	// A cache would not know what was left out, so it can not be used with exclude patterns or -x, and it only keeps sizes that count every link.
+	if (options->excludeAmount < 0 || (options->cachePath != NULL && (options->excludeAmount > 0 || options->oneFileSystem != 0 || options->countLinks == 0))) {
+		scanner->errorNumber = EINVAL;
+		return MDU_ERROR_OPTIONS;
+	}
+	
+	// The exclude patterns are sorted into a matcher once, for all the threads.
+	struct excludeMatcher exclude;
+	if (createExcludeMatcher(&exclude, options->excludePatterns, options->excludeAmount) == -1) {
+		scanner->errorNumber = errno;
+		return errno == EINVAL ? MDU_ERROR_OPTIONS : MDU_ERROR_MEMORY;
+	}
+	const struct excludeMatcher *matcher = options->excludeAmount > 0 ? &exclude : NULL;
+	
+	int result;
+	if (options->estimate != 0) {
+		result = estimateSizeOnDisk(scanner, files, fileAmount, blockAmounts, matcher);
+	}
+	else if (scanner->threadAmount == 0) {
+		result = calculateSizeOnDiskRecursive(scanner, files, fileAmount, blockAmounts, matcher);
+	}
+	else {
+		result = calculateSizeOnDiskParallel(scanner, files, fileAmount, blockAmounts, matcher, NULL, NULL);
+	}
+	
+	freeExcludeMatcher(&exclude);
+	return result;
+}
+
+/**
+ * Gets a description of an error code.
+ *
+ * @param error			The error code.
+ * @return description	The description (a constant string).
+ */
+const char *mduErrorString(int error) {
+	
+	switch (error) {
+		case MDU_SUCCESS:
+			return "success";
+		case MDU_INCOMPLETE:
+			return "some directories could not be read";
+		case MDU_ERROR_STAT:
+			return "a file could not be checked";
+		case MDU_ERROR_READ:
+			return "a directory could not be read";
+		case MDU_ERROR_MEMORY:
+			return "out of memory";
+		case MDU_ERROR_THREAD:
+			return "a thread could not be created";
+		case MDU_ERROR_OPTIONS:
+			return "invalid options";
+		case MDU_ERROR_CACHE:
+			return "the cache could not be written";
+		default:
+			return "unknown error";
+	}
+}
@@ -0,0 +1,197 @@
+/**
+ * This is the header file for libmdu, the library that the mdu program is
+ * built on. A search is set up in a scanner (the options, the amount of
+ * threads and the callbacks that get the results) and run with mduScan. The
+ * library never exits the program, so several searches can run in the same
+ * process at the same time (each with its own scanner), and a failed search
+ * only returns an error code. Its only global state is a flag that is set
+ * once statx turns out to be missing from the kernel, after which every
+ * search in the process uses fstatat. It does not change the limit on open
+ * files either: the parallel search keeps at most half of the limit open in
+ * directories, so a program that searches deep trees should raise
+ * RLIMIT_NOFILE itself (the way mdu does).
+ *
+ * @file libmdu.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef LIBMDU_H
+#define LIBMDU_H
+
+#include <sys/types.h>
+
+// The search went fine.
+#define MDU_SUCCESS 0
+
+// Some directories could not be read, the totals are given without them (like the exit value 1 of du).
+#define MDU_INCOMPLETE 1
+
+// A file could not be checked (the errno and the path of the file are in the scanner).
+#define MDU_ERROR_STAT -1
+
+// A directory could not be read after it had been opened.
+#define MDU_ERROR_READ -2
+
+// Memory could not be allocated.
+#define MDU_ERROR_MEMORY -3
+
+// A thread (or its lock) could not be created.
+#define MDU_ERROR_THREAD -4
+
+// The scanner has options that do not go together.
+#define MDU_ERROR_OPTIONS -5
+
+// The cache file could not be written (only passed to the error callback, the search itself went fine).
+#define MDU_ERROR_CACHE -6
+
+// The options for a search.
+struct scanOptions {
+
+	// Lets the file system answer from its cache (the sizes might be slightly stale).
+	int fast;
+
+	// Checks the files in batches through io_uring (in the parallel search).
+	int ioUring;
+
+	// How many levels below the files/directories in the program arguments directories are printed (0 prints only them).
+	int maxDepth;
+
+	// Prints the files as well as the directories.
+	int allFiles;
+
+	// The cache file that unchanged directories are taken from (NULL if no cache is used, it can only be used with countLinks).
+	char *cachePath;
+
+	// How many seconds there are between the prints in watch mode (0 if the program does not watch).
+	double watchInterval;
+
+	// The format that the statistics of the search are printed in (0 if they are not kept).
+	int statistics;
+
+	// The file descriptor that the progress of the search is written to (-1 if it is not shown).
+	int progressFd;
+
+	// The bounds for the amount of active threads when the amount is tuned during the search (both 0 if it is fixed).
+	int minimumThreads;
+	int maximumThreads;
+
+	// Checks the entries of each batch (and opens the subdirectories) in the order of their inode numbers.
+	int inodeOrder;
+
+	// How many directories may wait to be searched in the parallel search before new ones are searched in line (0 for the default).
+	long maxQueue;
+
+	// How many of the largest files and of the largest directories below the files/directories of the search are kept (0 if none).
+	int topAmount;
+
+	// The patterns (fnmatch globs on the names, without a '/') of the entries that are left out without being checked, and their amount.
+	char **excludePatterns;
+	int excludeAmount;
+
+	// Leaves out the directories that are on another file system than the file/directory of the search they are in.
+	int oneFileSystem;
+
+	// Counts the blocks of a file with more than one hard link for every link (by default only the first link that is found counts).
+	int countLinks;
+
+	// Estimates the sizes from random samples of the directories below the top of each file/directory instead of searching everything.
+	int estimate;
+
+	// The estimate stops once half its 95% confidence interval is at most this part of it (0 for no accuracy goal), or after this many seconds in all (0 for no time limit).
+	double estimateAccuracy;
+	double estimateSeconds;
+};
+
+// A file/directory in the lists of the largest ones.
+struct mduTopEntry {
+	char *path;
+	blkcnt_t blocks;
+};
+
+// The estimate of a file/directory (its blocks are also handed over as its total).
+struct mduEstimate {
+	blkcnt_t blocks;
+
+	// Half the width of the 95% confidence interval around the blocks (0 if everything was counted, -1 if there were too few probes to tell).
+	blkcnt_t margin;
+
+	// The blocks that were counted exactly (the directories near the top, which were read whole).
+	blkcnt_t exactBlocks;
+
+	// The amount of random probes, and the amount of directories that were read in all.
+	long long probes;
+	long long directories;
+};
+
+/**
+ * The callbacks that get the results of a search (a callback that is NULL is
+ * left out). The path is only valid during the call. In a parallel search the
+ * callbacks are called by the searching threads, possibly at the same time.
+ */
+struct mduCallbacks {
+
+	// Gets each file below the files/directories of the search (only with allFiles and above the max depth).
+	void (*file)(void *data, const char *path, blkcnt_t blocks);
+
+	// Gets each directory once its total is known (down to the max depth) and each file/directory of the search (depth 0).
+	void (*directory)(void *data, const char *path, blkcnt_t blocks, int depth);
+
+	// Gets a directory that could not be read (MDU_INCOMPLETE) or a cache file that could not be written (MDU_ERROR_CACHE).
+	void (*error)(void *data, int error, const char *path, int errorNumber);
+
+	// Called by a thread of the search when it runs out of work for now and when it is done (results that it has buffered can be written out).
+	void (*flush)(void *data);
+
+	// Passed on to every callback.
+	void *data;
+};
+
+// The statistics of the threads of a search.
+struct scanStatistics;
+
+/**
+ * A search and its settings. The scanner is set up with mduInitScanner, the
+ * options and callbacks are filled in and the search is run with mduScan. A
+ * scanner can be used for any amount of searches, but only one at a time.
+ */
+struct mduScanner {
+	struct scanOptions options;
+	struct mduCallbacks callbacks;
+
+	// The amount of threads (0 searches recursively in the calling thread, with options.maximumThreads it is the largest amount).
+	int threadAmount;
+
+	// What made the last search fail: the errno and the path of the file (NULL if it has none).
+	int errorNumber;
+	char *errorPath;
+
+	// The statistics of each thread of the last search and how long it took (only with options.statistics).
+	struct scanStatistics *statistics;
+	int statisticsAmount;
+	long long nanoseconds;
+
+	// The largest files and directories of the last search, from the largest down (only with options.topAmount).
+	struct mduTopEntry *topFiles;
+	int topFileAmount;
+	struct mduTopEntry *topDirectories;
+	int topDirectoryAmount;
+
+	// The estimate of each file/directory of the last search (only with options.estimate).
+	struct mduEstimate *estimates;
+	int estimateAmount;
+};
+
+// Sets up a scanner with the default options (a recursive search with nothing printed below the files/directories).
+void mduInitScanner(struct mduScanner *scanner);
+
+// Frees what the last search left in a scanner (the error path, the statistics, the lists of the largest files/directories and the estimates).
+void mduFreeScanner(struct mduScanner *scanner);
+
+// Searches a list of files/directories and stores the total of each one.
+int mduScan(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts);
+
+// Gets a description of an error code.
+const char *mduErrorString(int error);
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * This is the implementation file for the link set. A file is hashed once,
+ * the top bits of the hash pick the shard and the bottom bits the slot in the
+ * shards table, so a thread only ever holds the lock of one shard and only
+ * for a few comparisons. Only the files with more than one link are looked
+ * up at all, so a tree without hard links never touches the set.
+ *
+ * @file links.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "links.h"
+
+// The size of the table of a shard when the first file is added to it.
+#define FIRST_SHARD_SIZE 64
+
+/**
+ * Hashes a file (the device and the inode are mixed so that inodes that
+ * follow each other end up far apart).
+ *
+ * @param device	The device of the file.
+ * @param inode		The inode of the file.
+ * @return hash		The hash.
+ */
+static uint64_t hashLink(dev_t device, ino_t inode) {
+
+	uint64_t hash = (uint64_t)inode ^ ((uint64_t)device*0x9e3779b97f4a7c15ULL);
+	hash = (hash ^ (hash >> 30))*0xbf58476d1ce4e5b9ULL;
+	hash = (hash ^ (hash >> 27))*0x94d049bb133111ebULL;
+	return hash ^ (hash >> 31);
+}
+
+/**
+ * Creates an empty link set (the tables of the shards are only allocated
+ * once a file is added to them).
+ *
+ * @param set	The set.
+ */
+void createLinkSet(struct linkSet *set) {
+
+	for (int index = 0; index < LINK_SHARDS; index++) {
+		pthread_mutex_init(&set->shards[index].mutex, NULL);
+		set->shards[index].keys = NULL;
+		set->shards[index].amount = 0;
+		set->shards[index].size = 0;
+	}
+}
+
+/**
+ * Frees a link set.
+ *
+ * @param set	The set.
+ */
+void freeLinkSet(struct linkSet *set) {
+
+	for (int index = 0; index < LINK_SHARDS; index++) {
+		pthread_mutex_destroy(&set->shards[index].mutex);
+		free(set->shards[index].keys);
+		set->shards[index].keys = NULL;
+	}
+}
+
+/**
+ * Finds the slot of a file in a table, or the empty slot where it belongs.
+ *
+ * @param keys		The table.
+ * @param size		The size of the table (a power of two).
+ * @param hash		The hash of the file.
+ * @param device	The device of the file.
+ * @param inode		The inode of the file.
+ * @return slot		The index of the slot.
+ */
+static size_t findLinkSlot(const struct linkKey *keys, size_t size, uint64_t hash, dev_t device, ino_t inode) {
+
+	size_t slot = hash & (size - 1);
+	while (keys[slot].inode != 0 && (keys[slot].inode != inode || keys[slot].device != device)) {
+		slot = (slot + 1) & (size - 1);
+	}
+	return slot;
+}
+
+/**
+ * Doubles the table of a shard (the caller holds the lock).
+ *
+ * @param shard		The shard.
+ * @return 0 or -1	0 on success, -1 if there was no memory for the new table.
+ */
+static int growLinkShard(struct linkShard *shard) {
+
+	size_t newSize = shard->size == 0 ? FIRST_SHARD_SIZE : 2*shard->size;
+	struct linkKey *newKeys = calloc(newSize, sizeof(struct linkKey));
+	if (newKeys == NULL) {
+		return -1;
+	}
+
+	// Moves the files over to their slots in the new table.
+	for (size_t index = 0; index < shard->size; index++) {
+		if (shard->keys[index].inode != 0) {
+			uint64_t hash = hashLink(shard->keys[index].device, shard->keys[index].inode);
+			newKeys[findLinkSlot(newKeys, newSize, hash, shard->keys[index].device, shard->keys[index].inode)] = shard->keys[index];
+		}
+	}
+
+	free(shard->keys);
+	shard->keys = newKeys;
+	shard->size = newSize;
+	return 0;
+}
+
+/**
+ * Adds a file to the set. The threads cache is checked first, and the file
+ * is put in the cache once it has been found in (or added to) the set, since
+ * it is then in the set for good.
+ *
+ * @param set		The set.
+ * @param cache		The cache of the thread (NULL if it has none).
+ * @param device	The device of the file.
+ * @param inode		The inode of the file.
+ * @return first	1 if the file had not been seen before, 0 if it had and -1 if there was no memory to add it.
+ */
+int addLink(struct linkSet *set, struct linkCache *cache, dev_t device, ino_t inode) {
+
+	uint64_t hash = hashLink(device, inode);
+	struct linkKey *cached = NULL;
+	if (cache != NULL) {
+		cached = &cache->keys[(hash >> 32) & (LINK_CACHE_SIZE - 1)];
+		if (cached->inode == inode && cached->device == device) {
+			return 0;
+		}
+	}
+
+	struct linkShard *shard = &set->shards[hash >> 58];
+	pthread_mutex_lock(&shard->mutex);
+
+	// The table is kept at most half full, so that the searches stay short.
+	if (2*(shard->amount + 1) > shard->size && growLinkShard(shard) == -1) {
+		pthread_mutex_unlock(&shard->mutex);
+		return -1;
+	}
+
+	int first = 0;
+	size_t slot = findLinkSlot(shard->keys, shard->size, hash, device, inode);
+	if (shard->keys[slot].inode == 0) {
+		shard->keys[slot].device = device;
+		shard->keys[slot].inode = inode;
+		shard->amount++;
+		first = 1;
+	}
+	pthread_mutex_unlock(&shard->mutex);
+
+	if (cached != NULL) {
+		cached->device = device;
+		cached->inode = inode;
+	}
+	return first;
+}
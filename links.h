@@ -0,0 +1,66 @@
+/**
+ * This is the header file for the link set, which remembers the files with
+ * more than one hard link that the search has already counted, so that the
+ * blocks of such a file are only counted for its first link (the same way as
+ * du does).
+ *
+ * @file links.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef LINKS_H
+#define LINKS_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+// The amount of shards that the set is split into (a power of two, so that the threads seldom want the same lock).
+#define LINK_SHARDS 64
+
+// The amount of files that each threads own cache of counted files holds (a power of two).
+#define LINK_CACHE_SIZE 256
+
+// A file that has been counted (an inode number is never 0, so an empty slot has inode 0).
+struct linkKey {
+	dev_t device;
+	ino_t inode;
+};
+
+/**
+ * A part of the set with a lock of its own. The files are kept in an open
+ * addressing hash table that doubles in size when it is half full. Each
+ * shard has its own cache line, so the locks do not slow each other down.
+ */
+struct linkShard {
+	_Alignas(64) pthread_mutex_t mutex;
+	struct linkKey *keys;
+	size_t amount;
+	size_t size;
+};
+
+// The files with more than one link that have been counted, shared by all the threads.
+struct linkSet {
+	struct linkShard shards[LINK_SHARDS];
+};
+
+/**
+ * The files that one thread has recently found in the set (a direct mapped
+ * cache without a lock). A file that is in the cache has been counted
+ * already, so a thread that sees the same files again does not have to take
+ * a lock to find that out.
+ */
+struct linkCache {
+	struct linkKey keys[LINK_CACHE_SIZE];
+};
+
+// Creates an empty link set.
+void createLinkSet(struct linkSet *set);
+
+// Frees a link set.
+void freeLinkSet(struct linkSet *set);
+
+// Adds a file to the set and tells if it was the first time it was seen.
+int addLink(struct linkSet *set, struct linkCache *cache, dev_t device, ino_t inode);
+
+#endif
@@ -1,5 +1,9 @@
 /**
- * This is the implementation file for the mdu program.
+ * This is the implementation file for the mdu program. The program reads its
+ * options into a scanner and lets libmdu do the search, and the callbacks of
+ * the scanner write the results as they come in (each thread of the search
+ * into a buffer of its own, which is written out when it is full, when the
+ * thread runs out of work and when the thread is done).
  *  
  * @file mdu.c
  * @author Jakob Mukka
@@ -7,704 +11,559 @@
  */
 
 #include "mdu.h"
-#include "stacks.h"
+#include "watch.h"
+#include "stats.h"
+#include "output.h"
+
+// The records of the thread that have not been written yet (every thread of the search has its own).
+static _Thread_local struct outputBuffer threadBuffer;
  
-/** 
- * Struct that keeps information that each thread needs,
- * if the search is to be done in parallel.
+/**
+ * Writes the disk usage of a file (the file callback of the scanner).
+ *
+ * @param data			The output writer.
+ * @param path			The path of the file.
+ * @param blockAmount	The amount of blocks the file takes on the disk.
  */
-struct threadInformation {
-	int threadNumber;
-	int threadAmount;
-	char startDirectory[PATH_MAX];
-	pthread_cond_t *cond;
-	pthread_mutex_t *mutex;
-	int *exitValuePointer;
-};
+static void printFileUsage(void *data, const char *path, blkcnt_t blockAmount) {
+	writeUsageRecord((struct outputWriter *)data, &threadBuffer, path, blockAmount, 0);
+}
 
 /**
- * Main method for the mdu program.
+ * Writes the disk usage of a directory (the directory callback of the scanner).
  *
- * @param argc			The amount of arguments for the program.
- * @param argv  		The list of arguments for the program.
- * @return exitValue	The exit value for the program.
+ * @param data			The output writer.
+ * @param path			The path of the directory.
+ * @param blockAmount	The amount of blocks the directory takes on the disk.
+ * @param depth			How deep the directory is (not needed, the scanner only hands over what is printed).
  */
-int main (int argc, char **argv) {
-		
-	char *threadAmountString = NULL;
-	int threadAmount;
-	int option;
-	int jflag = 0;
-	// Goes through the arguments in order to find the -j option (for multiple threads).
-	while((option = getopt(argc, argv, "j:")) != -1) {
-		switch (option) {	
-			case 'j':
-				jflag = 1;
-				threadAmountString = strdup(optarg);
-				break;
-		}
-	}
-	
-	// Sets the thread amount.
-	if (threadAmountString != NULL) {
-		sscanf(threadAmountString, "%d", &threadAmount);
-		free(threadAmountString);
-	}
+static void printDirectoryUsage(void *data, const char *path, blkcnt_t blockAmount, int depth) {
 	
-	/* The amount of files/directories that the user has entered,
-	 * gets set via a pointer in the getFiles method.
-	 */
-	int fileAmount = 0;
-	int *fileAmountPointer = &fileAmount;
-	
-	// Gets the files from the program arguments.
-	char **files = getFiles(argc, argv, argv[optind-1], fileAmountPointer);
-		
-	int exitValue;
-	// If the search is to be done recursively.
-	if (jflag == 0) {	
-		exitValue = calculateSizeOnDiskRecursive(files, fileAmount);
-	}
-	
-	// If the search is to be done in parallel.
-	else if (jflag == 1) {
-		exitValue = calculateSizeOnDiskParallel(files, fileAmount, threadAmount);
-	}
-	
-	exit(exitValue);
+	(void)depth;
+	writeUsageRecord((struct outputWriter *)data, &threadBuffer, path, blockAmount, 1);
 }
 
 /**
- * Gets the files/directories from the program arguments.
+ * Writes out the records of the thread (the flush callback of the scanner).
  *
- * @param argc				The amount of arguments.
- * @param argv				The list of arguments.
- * @param optind			The option argument (ex -j3).
- * @param fileAmountPointer	The pointer to the fileAmount variable.
- * @return files			The list of files/directories.
+ * @param data	The output writer.
  */
-char **getFiles(int argc, char **argv, char *optind, int *fileAmountPointer) {
-		
-	// Allocates memory for the list of files/directories.
-	char **files = malloc(argc*sizeof(char*));
+static void flushUsage(void *data) {
+	flushOutputBuffer((struct outputWriter *)data, &threadBuffer);
+}
+
+/**
+ * Prints out a directory that can not be read or a cache that can not be
+ * written (the error callback of the scanner).
+ *
+ * @param data			Not used.
+ * @param error			MDU_INCOMPLETE or MDU_ERROR_CACHE.
+ * @param path			The path of the directory/cache.
+ * @param errorNumber	The reason (an errno).
+ */
+static void printScanError(void *data, int error, const char *path, int errorNumber) {
 	
-	// Error checks the allocation of memory for the list of files/directories.
-	if (files == NULL) {
-		perror("Fatal Error:");
-		exit(EXIT_FAILURE);
+	(void)data;
+	if (error == MDU_ERROR_CACHE) {
+		fprintf(stderr, "mdu: cannot write cache '%s': %s\n", path, strerror(errorNumber));
 	}
-	
-	int fileIndex = 0;
-	int argumentIndex = 1;
-	// Goes through the arguments one by one.
-	while (argumentIndex < argc) {
-		
-		// If the file is not equal to the option argument it gets added to the list.
-		if (strcmp(argv[argumentIndex], optind) != 0) {				
-			files[fileIndex] = argv[argumentIndex];
-			fileIndex++;
-		}	
-		
-		argumentIndex++;
+	else {
+		fprintf(stderr, "du: cannot read directory '%s': %s\n", path, strerror(errorNumber));
 	}
-	
-	*fileAmountPointer = fileIndex;
-	
-	return files;
 }
 
 /**
- * Calculates the size a list of files/directories takes on the disk recursively.
+ * Prints out why a search failed, the same way the program always has.
  *
- * @param files			The list of files/directories.
- * @param fileAmount	The amount of files/directories.
- * @return exitVal		The exit value of the program.
+ * @param scanner	The scanner of the search.
+ * @param result	The error code of the search.
  */
-int calculateSizeOnDiskRecursive(char **files, int fileAmount) {
-	
-	// String to store the current path in the search.
-	char currentPath[PATH_MAX];
+static void printScanFailure(struct mduScanner *scanner, int result) {
 	
-	/**
-	 * Pointer to the current path string which gets sent in to,
-	 * the searchDirectoryRecursive function.
-	 */
-	char *pathPointer = currentPath;
+	errno = scanner->errorNumber;
+	switch (result) {
+		case MDU_ERROR_STAT:
+			perror("stat");
+			break;
+		case MDU_ERROR_READ:
+			fprintf(stderr, "du: cannot read directory '%s': %s\n", scanner->errorPath != NULL ? scanner->errorPath : "?", strerror(scanner->errorNumber));
+			break;
+		case MDU_ERROR_MEMORY:
+			perror("Fatal Error:");
+			break;
+		case MDU_ERROR_THREAD:
+			perror("pthread_create");
+			break;
+		default:
+			fprintf(stderr, "mdu: %s\n", mduErrorString(result));
+			break;
+	}
+}
 
-	// Sets the default exit value to success.
-	int exitVal = EXIT_SUCCESS;
-	
-	/**
-	 * Pointer to the exit value which gets sent in to,
-	 * the searchDirectoryRecursive function.
-	 */
-	int *exitValuePointer = &exitVal;
-	
-	// The total block amount for all files.
-	blkcnt_t  totalBlockAmount = 0;
+/**
+ * Writes the largest files and directories that the search found, from the
+ * largest down. In text the two lists have headings, in JSON the records
+ * have their rank instead.
+ *
+ * @param writer	The output writer.
+ * @param scanner	The scanner that did the search.
+ */
+static void printTopLists(struct outputWriter *writer, struct mduScanner *scanner) {
 	
-	// The block amount for one individual file.
-	blkcnt_t  blockAmountForFile = 0;
+	writeHeadingRecord(writer, &threadBuffer, "largest files:");
+	for (int index = 0; index < scanner->topFileAmount; index++) {
+		writeTopRecord(writer, &threadBuffer, scanner->topFiles[index].path, scanner->topFiles[index].blocks, 0, index + 1);
+	}
 	
-	struct stat fileStat;
-	int index = 0;
-	// Goes through the list of files.
-	while (index < fileAmount) {
-			
-		// Stores the file info in the fileStat struct.
-		int statCheck = lstat(files[index], &fileStat);
+	writeHeadingRecord(writer, &threadBuffer, "largest directories:");
+	for (int index = 0; index < scanner->topDirectoryAmount; index++) {
+		writeTopRecord(writer, &threadBuffer, scanner->topDirectories[index].path, scanner->topDirectories[index].blocks, 1, index + 1);
+	}
+}
 
-		// Error checks the storing of the file info.
-		if (statCheck == -1) {
-			perror("stat");
-			free(files);
-			exit(EXIT_FAILURE);
+/**
+ * Reads the budget of an estimate: a comma separated list of an accuracy
+ * ("2%") and/or a time limit in seconds ("30" or "30s"). What is not given
+ * keeps its default, and the estimate stops at whichever comes first.
+ *
+ * @param budget	The budget.
+ * @param options	The options that the accuracy and time limit are stored in.
+ * @return 0 or -1	0 on success, -1 if the budget is invalid.
+ */
+static int parseEstimateBudget(const char *budget, struct scanOptions *options) {
+	
+	const char *token = budget;
+	while (*token != '\0') {
+		double value;
+		int length;
+		if (sscanf(token, "%lf%n", &value, &length) != 1 || !(value >= 0)) {
+			return -1;
 		}
-			
-		// Checks if the current file is a directory.
-		int fileCheck = S_ISDIR(fileStat.st_mode);
+		token = token + length;
 		
-		// If the current file is a directory.
-		if (fileCheck != 0) {
-			
-			// Copies the file into the current path.
-			strcpy(pathPointer, files[index]);
-			
-			// Checks if the directory can be opened.
-			int directoryCheck = checkDirectory(files[index], pathPointer);
-			
-			// If the directory can be opened it can be recursively searched.
-			if (directoryCheck == 0) {
-				
-				// Starts the recursive search of the directory.				
-				totalBlockAmount = searchDirectoryRecursive(files[index], 0, exitValuePointer, pathPointer);
-				
-				// Changes back to the previous directory.
-				int changeDirectoryCheck = chdir("..");
-				
-				// Error checks the directory change.
-				if (changeDirectoryCheck == -1) {
-					perror("Fatal Error:");
-					exit(EXIT_FAILURE);
-				} 
-			}
-
-			/** 
-			 * If the directory can not be opened the exit value is set to failure,
-             * and the function continues to the next file instead. 
-			 */
-			else if (directoryCheck == 1) {
-				exitVal = EXIT_FAILURE;
+		if (*token == '%') {
+			options->estimateAccuracy = value/100;
+			token++;
+		}
+		else {
+			options->estimateSeconds = value;
+			if (*token == 's') {
+				token++;
 			}
 		}
 		
-		// Gets the number of blocks allocated to the file.
-		blockAmountForFile = fileStat.st_blocks;
-				
-		// Adds it to the total amount of blocks.
-		totalBlockAmount = blockAmountForFile + totalBlockAmount;
-			
-		// Prints out the disk usage of the current file.
-		printf("%ld	%s\n", totalBlockAmount, files[index]);
-		
-		// Resets the block amount.
-		totalBlockAmount = 0;
-			
-		index++;
+		if (*token == ',') {
+			token++;
+		}
+		else if (*token != '\0') {
+			return -1;
+		}
 	}
-		
-	free(files);
-	return exitVal;
+	
+	// Something has to end the estimate.
+	if (options->estimateAccuracy == 0 && options->estimateSeconds == 0) {
+		return -1;
+	}
+	return 0;
 }
 
 /**
- * Calculates the size a directory takes on the disk recursively.
+ * Prints how good the estimate of each file/directory is (to stderr, so that
+ * the totals on stdout stay the same as without an estimate).
  *
- * @param directory			The directory to be searched.
- * @param totalBlockAmount	The amount of blocks the directory takes on the disk.
- * @param exitValuePointer	A pointer to the programs exit value.
- * @param pathPointer		A pointer to the current path in the search.
- * @return totalBlockAmount The amount of blocks the directory takes on the disk.
+ * @param scanner	The scanner that did the estimate.
+ * @param files		The files/directories of the estimate.
  */
-blkcnt_t searchDirectoryRecursive(char *directory, blkcnt_t totalBlockAmount, int *exitValuePointer, char *pathPointer) {
+static void printEstimates(struct mduScanner *scanner, char **files) {
 	
-	// Opens the directory.
-	DIR *directoryPointer;	
-	directoryPointer = opendir(directory);
+	for (int index = 0; index < scanner->estimateAmount; index++) {
+		struct mduEstimate *estimate = &scanner->estimates[index];
 		
-	// Error checks the opening of the directory.
-	if (directoryPointer == NULL) {
-		perror("Fatal Error:");
-		exit(EXIT_FAILURE);
+		// The margin is unknown if the time ran out before there were enough probes.
+		char margin[32];
+		if (estimate->margin < 0) {
+			snprintf(margin, sizeof(margin), "unknown");
+		}
+		else {
+			snprintf(margin, sizeof(margin), "%lld", (long long)estimate->margin);
+		}
+		fprintf(stderr, "mdu: estimate for %s: %lld +- %s blocks (95%% confidence), %lld counted exactly, %lld probes, %lld directories read%s\n", files[index],
+			(long long)estimate->blocks, margin, (long long)estimate->exactBlocks, estimate->probes, estimate->directories,
+			estimate->probes > 0 && scanner->options.countLinks == 0 ? " (the sampled part counts every hard link)" : "");
 	}
+}
+
+/**
+ * Raises the limit on open files of the program as far as it goes, since the
+ * searches keep directories open (the library only reads the limit).
+ */
+static void raiseOpenFileLimit(void) {
 	
-	/* The amount of files/directories in the directory,
-	 * gets set via a pointer in the getFilesInDirectory method.
-	 */
-	int fileAmount = 0;
-	int *fileAmountPointer = &fileAmount;
-	
-	// Gets the files in the directory.
-	char **files = getFilesInDirectory(directoryPointer, fileAmountPointer);
-		
-	// Changes the current working directory to the directory to be searched.
-	int changeDirectoryCheck = chdir(directory);
-	
-	// Error checks the directory change.
-	if (changeDirectoryCheck == -1) {
-		perror("Fatal Error:");
-		exit(EXIT_FAILURE);
+	struct rlimit fileLimit;
+	if (getrlimit(RLIMIT_NOFILE, &fileLimit) == -1) {
+		return;
 	}
 	
-	// Variable to hold the block count for each file.
-	blkcnt_t  blockAmountForFile;
-	
-	int index = 0;
-	// Goes through each file in the directory.
-	while (index < fileAmount) {
+	// Raises the soft limit to the hard limit (but not beyond what an int can hold).
+	rlim_t newLimit = fileLimit.rlim_max;
+	if (newLimit == RLIM_INFINITY || newLimit > 1048576) {
+		newLimit = 1048576;
+	}
+	if (newLimit > fileLimit.rlim_cur) {
+		fileLimit.rlim_cur = newLimit;
+		setrlimit(RLIMIT_NOFILE, &fileLimit);
+	}
+}
+
+/**
+ * Main method for the mdu program.
+ *
+ * @param argc			The amount of arguments for the program.
+ * @param argv  		The list of arguments for the program.
+ * @return exitValue	The exit value for the program.
+ */
+int main (int argc, char **argv) {
 		
-		// Struct to store info about the current file.
-		struct stat fileStat;
+	char *threadAmountString = NULL;
+	char *maxDepthString = NULL;
+	char *watchIntervalString = NULL;
+	int watchFlag = 0;
+	char *estimateString = NULL;
+	int threadAmount = 0;
+	int option;
+	int jflag = 0;
+	int outputFormat = OUTPUT_TEXT;
+	
+	// The scanner that does the search (everything is off by default), the results are printed as they come in.
+	struct mduScanner scanner;
+	mduInitScanner(&scanner);
+	scanner.callbacks.file = printFileUsage;
+	scanner.callbacks.directory = printDirectoryUsage;
+	scanner.callbacks.error = printScanError;
+	scanner.callbacks.flush = flushUsage;
+	
+	// The long versions of the options.
+	struct option longOptions[] = {
+		{"fast", no_argument, NULL, 'f'},
+		{"io-uring", no_argument, NULL, 'u'},
+		{"all", no_argument, NULL, 'a'},
+		{"max-depth", required_argument, NULL, 'd'},
+		{"cache", required_argument, NULL, 'c'},
+		{"watch", optional_argument, NULL, 'w'},
+		{"stats", optional_argument, NULL, 's'},
+		{"progress", optional_argument, NULL, 'p'},
+		{"inode-order", no_argument, NULL, 'i'},
+		{"max-queue", required_argument, NULL, 'q'},
+		{"null", no_argument, NULL, '0'},
+		{"json", no_argument, NULL, 'J'},
+		{"top", required_argument, NULL, 't'},
+		{"exclude", required_argument, NULL, 'e'},
+		{"one-file-system", no_argument, NULL, 'x'},
+		{"count-links", no_argument, NULL, 'l'},
+		{"estimate", optional_argument, NULL, 'E'},
+		{NULL, 0, NULL, 0}
+	};
+	
+	// Goes through the arguments in order to find the options.
+	while((option = getopt_long(argc, argv, "j:fuad:c:0xl", longOptions, NULL)) != -1) {
+		switch (option) {	
+			case 'j':
+				jflag = 1;
+				threadAmountString = strdup(optarg);
+				break;
 			
-		// Stores the file info in the fileStat struct.
-		int statCheck = lstat(files[index], &fileStat);
-		
-		// Error checks the storing of the file info.
-		if (statCheck == -1) {
-			perror("stat");
-			exit(EXIT_FAILURE);
-		}
-		
-		// Checks if the current file is a directory.
-		int fileCheck = S_ISDIR(fileStat.st_mode);
-					
-		// If the current file is a directory.
-		if (fileCheck != 0) {
+			// Lets the file system answer from its cache (faster, but possibly slightly stale).
+			case 'f':
+				scanner.options.fast = 1;
+				break;
+			
+			// Checks the files with io_uring in the parallel search.
+			case 'u':
+				scanner.options.ioUring = 1;
+				break;
+			
+			// Prints the disk usage of every file and directory (down to the max depth).
+			case 'a':
+				scanner.options.allFiles = 1;
+				break;
 			
-			// Copies the current file into the current path.
-			strcat(pathPointer, "/");
-			strcat(pathPointer, files[index]);
+			// Prints the disk usage of the directories down to a number of levels.
+			case 'd':
+				free(maxDepthString);
+				maxDepthString = strdup(optarg);
+				break;
 			
-			// Checks if the directory can be opened.
-			int directoryCheck = checkDirectory(files[index], pathPointer);
+			// Reuses the unchanged directories from the cache file and writes a new one.
+			case 'c':
+				scanner.options.cachePath = optarg;
+				break;
 			
-			/**
-			 * If the directory can be opened the function continues with the,
-			 * recursive search of the directory.
-			 */
-			if (directoryCheck == 0) {
-								
-				// The method calls itself recursively with the current file as a directory.
-				totalBlockAmount = searchDirectoryRecursive(files[index], totalBlockAmount, exitValuePointer, pathPointer);
-				
-				// Changes back to the previous directory.
-				changeDirectoryCheck = chdir("..");
-				
-				// Error checks the directory change.
-				if (changeDirectoryCheck == -1) {
+			// Keeps the totals up to date from the file system events (only has a long version).
+			case 'w':
+				watchFlag = 1;
+				watchIntervalString = optarg;
+				break;
+			
+			// Prints what the search did and where the time went (only has a long version).
+			case 's':
+				if (optarg == NULL || strcmp(optarg, "text") == 0) {
+					scanner.options.statistics = STATISTICS_TEXT;
+				}
+				else if (strcmp(optarg, "json") == 0) {
+					scanner.options.statistics = STATISTICS_JSON;
+				}
+				else {
+					fprintf(stderr, "%s: invalid statistics format '%s' (text or json)\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			
+			// Shows how far the search has come on stderr or on a given file descriptor (only has a long version).
+			case 'p':
+				scanner.options.progressFd = STDERR_FILENO;
+				if (optarg != NULL && (sscanf(optarg, "%d", &scanner.options.progressFd) != 1 || scanner.options.progressFd < 0 || fcntl(scanner.options.progressFd, F_GETFD) == -1)) {
+					fprintf(stderr, "%s: invalid progress file descriptor '%s'\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			
+			// Checks the entries in the order of their inodes, for spinning disks (only has a long version).
+			case 'i':
+				scanner.options.inodeOrder = 1;
+				break;
+			
+			// Caps the directories that wait to be searched, the threads search new ones in line beyond it (only has a long version).
+			case 'q':
+				if (sscanf(optarg, "%ld", &scanner.options.maxQueue) != 1 || scanner.options.maxQueue < 1) {
+					fprintf(stderr, "%s: invalid queue size '%s'\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			
+			// Ends each record with a NUL instead of a newline, for paths that have newlines in them.
+			case '0':
+				outputFormat = OUTPUT_NULL;
+				break;
+			
+			// Writes each record as a line of JSON (only has a long version).
+			case 'J':
+				outputFormat = OUTPUT_JSON;
+				break;
+			
+			// Lists the largest files and directories after the search (only has a long version).
+			case 't':
+				if (sscanf(optarg, "%d", &scanner.options.topAmount) != 1 || scanner.options.topAmount < 1) {
+					fprintf(stderr, "%s: invalid top amount '%s'\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			
+			// Leaves out the entries whose names match a pattern, before they are checked (only has a long version, can be given many times).
+			case 'e':
+				if (optarg[0] == '\0' || strchr(optarg, '/') != NULL) {
+					fprintf(stderr, "%s: invalid exclude pattern '%s' (a pattern for names, which can not be empty or have a '/')\n", argv[0], optarg);
+					exit(EXIT_FAILURE);
+				}
+				char **patterns = realloc(scanner.options.excludePatterns, (scanner.options.excludeAmount + 1)*sizeof(char *));
+				if (patterns == NULL) {
 					perror("Fatal Error:");
 					exit(EXIT_FAILURE);
-				} 
-			}
+				}
+				scanner.options.excludePatterns = patterns;
+				scanner.options.excludePatterns[scanner.options.excludeAmount] = optarg;
+				scanner.options.excludeAmount++;
+				break;
 			
-			/**
-			 * If the directory can not be opened the exit value is set to failure,
-			 * and the function continues to the next file instead. 
-			 */
-			else if (directoryCheck == 1) {
-				*exitValuePointer = EXIT_FAILURE;
-			}
-		}
-				
-		// Gets the number of blocks allocated to the file.
-		blockAmountForFile = fileStat.st_blocks;
+			// Stays on the file system of each file/directory in the arguments.
+			case 'x':
+				scanner.options.oneFileSystem = 1;
+				break;
 			
-		// Adds it to the total amount of blocks.
-		totalBlockAmount = blockAmountForFile + totalBlockAmount;
-		
-		index++;
+			// Counts a file with more than one hard link for every link, instead of only for the first one.
+			case 'l':
+				scanner.options.countLinks = 1;
+				break;
+			
+			// Estimates the sizes from samples within a budget of accuracy and/or time (only has a long version).
+			case 'E':
+				scanner.options.estimate = 1;
+				estimateString = optarg;
+				break;
+			
+			// getopt has already printed out what was wrong with the option.
+			default:
+				fprintf(stderr, "Usage: %s [-j threads|auto[:min:max]] [-f|--fast] [-u|--io-uring] [-a|--all] [-d|--max-depth depth] [-c|--cache file] [--watch[=seconds]] [--stats[=text|json]] [--progress[=fd]] [--inode-order] [--max-queue directories] [-0|--null] [--json] [--top amount] [--exclude pattern] [-x|--one-file-system] [-l|--count-links] [--estimate[=accuracy%%,seconds]] file...\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
 	}
 	
-	// Removes the last directory in the current path.
-	for (int i = (strlen(pathPointer)-1); i >= 0; i--) {		
-		if (pathPointer[i] == '/') {
-			pathPointer[i] = '\0';
-			break;
+	// Sets the max depth (without one -a prints everything and otherwise only the files in the arguments are printed).
+	if (maxDepthString != NULL) {
+		if (sscanf(maxDepthString, "%d", &scanner.options.maxDepth) != 1 || scanner.options.maxDepth < 0) {
+			fprintf(stderr, "%s: invalid maximum depth '%s'\n", argv[0], maxDepthString);
+			exit(EXIT_FAILURE);
 		}
+		free(maxDepthString);
+	}
+	else if (scanner.options.allFiles == 1) {
+		scanner.options.maxDepth = INT_MAX;
 	}
 	
-	// Closes the directory and frees the files.
-	closedir(directoryPointer);
-	free(files);
-	
-	return totalBlockAmount;
-}
-
-/**
- * Calculates the size a list of files/directories takes on the disk in parallel.
- * 
- * @param files			The list of files/directories.
- * @param fileAmount	The amount of files/directories.
- * @param threadAmount	The amount of threads to be used.
- * @return exitVal		The exit value of the program.
- */
-int calculateSizeOnDiskParallel(char **files, int fileAmount, int threadAmount) {
-	
-	// Initiates the lock.
-	pthread_mutex_t mutex;
-	int lockCheck = pthread_mutex_init(&mutex, NULL);
+	// Sets how often the totals are printed in watch mode (every other second by default).
+	if (watchFlag == 1) {
+		scanner.options.watchInterval = 2;
+		if (watchIntervalString != NULL && (sscanf(watchIntervalString, "%lf", &scanner.options.watchInterval) != 1 || !(scanner.options.watchInterval > 0))) {
+			fprintf(stderr, "%s: invalid watch interval '%s'\n", argv[0], watchIntervalString);
+			exit(EXIT_FAILURE);
+		}
+	}
 	
-	// Error checks the initiation of the lock.
-	if (lockCheck != 0) {
-		perror("mutex");
+	// The watch mode keeps only the totals up to date, from one thread and without a cache.
+	if (watchFlag == 1 && (scanner.options.allFiles == 1 || scanner.options.maxDepth != 0 || scanner.options.cachePath != NULL || jflag == 1)) {
+		fprintf(stderr, "%s: -a, -d, -c and -j can not be used with --watch\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 	
-	// Initiates the conditional variable.
-	pthread_cond_t cond;
-	int conditionCheck = pthread_cond_init(&cond, NULL);
-	
-	// Error checks the initiation of the conditional variable.
-	if (conditionCheck != 0) {
-		perror("condition variable");
+	// A cache would not know what was left out, and watch mode keeps track of everything.
+	if ((scanner.options.excludeAmount > 0 || scanner.options.oneFileSystem == 1) && (scanner.options.cachePath != NULL || watchFlag == 1)) {
+		fprintf(stderr, "%s: --exclude and -x can not be used with --cache or --watch\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 	
-	// Gets the current working directory of where the program was started from.
-	char startingDirectory[PATH_MAX];
-	getcwd(startingDirectory, sizeof(startingDirectory));
-		
-	// Error checks the getting of the current working directory.
-	if (startingDirectory == NULL) {
-		perror("getcwd");
+	// The cache keeps sizes that count every link of a file (a cached directory can not tell when a file in it gets another link), so it has to be asked for with -l.
+	if (scanner.options.cachePath != NULL && scanner.options.countLinks == 0) {
+		fprintf(stderr, "%s: --cache counts every hard link, so it can only be used with -l\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
-		
-	// Creates an array of thread info structs.
-	struct threadInformation threadInfos[threadAmount];
 	
-	// Sets the default exit value to be EXIT_SUCCESS.
-	int exitval = EXIT_SUCCESS;
+	// Sets the budget of an estimate (2% or 30 seconds by default), which only hands over the totals.
+	if (scanner.options.estimate == 1) {
+		scanner.options.estimateAccuracy = 0.02;
+		scanner.options.estimateSeconds = 30;
+		if (estimateString != NULL && parseEstimateBudget(estimateString, &scanner.options) == -1) {
+			fprintf(stderr, "%s: invalid estimate budget '%s' (an accuracy like 2%%, seconds like 30s, or both separated by a comma)\n", argv[0], estimateString);
+			exit(EXIT_FAILURE);
+		}
+		if (scanner.options.allFiles == 1 || scanner.options.maxDepth != 0 || scanner.options.topAmount > 0 || scanner.options.cachePath != NULL || scanner.options.statistics != 0 ||
+			scanner.options.progressFd != -1 || watchFlag == 1) {
+			fprintf(stderr, "%s: --estimate can not be used with -a, -d, --top, --cache, --stats, --progress or --watch\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
 	
-	int threadIndex = 0;
-	// Adds default wait statuses (-1).
-	while (threadIndex <= threadAmount) {
-		addWaitStatus(threadIndex, -1);	
-		threadIndex++;
+	// Sets the thread amount (with auto the threads are tuned during the search, by default between 1 and 8 for each processor, but at least up to 32).
+	if (threadAmountString != NULL && strncmp(threadAmountString, "auto", 4) == 0) {
+		scanner.options.minimumThreads = 1;
+		scanner.options.maximumThreads = 8*sysconf(_SC_NPROCESSORS_ONLN);
+		if (scanner.options.maximumThreads < 32) {
+			scanner.options.maximumThreads = 32;
+		}
+		char extra;
+		if (strcmp(threadAmountString, "auto") != 0 && (sscanf(threadAmountString, "auto:%d:%d%c", &scanner.options.minimumThreads, &scanner.options.maximumThreads, &extra) != 2 || scanner.options.minimumThreads < 1 || scanner.options.maximumThreads < scanner.options.minimumThreads)) {
+			fprintf(stderr, "%s: invalid thread amount '%s' (a number, auto or auto:min:max)\n", argv[0], threadAmountString);
+			exit(EXIT_FAILURE);
+		}
+		threadAmount = scanner.options.maximumThreads;
+		free(threadAmountString);
+	}
+	else if (threadAmountString != NULL) {
+		sscanf(threadAmountString, "%d", &threadAmount);
+		free(threadAmountString);
 	}
 	
-	// Initiates an array of threads.
-	pthread_t threads[threadAmount];
+	/* The amount of files/directories that the user has entered,
+	 * gets set via a pointer in the getFiles method.
+	 */
+	int fileAmount = 0;
+	int *fileAmountPointer = &fileAmount;
 	
-	// The total block amount for one of the files/directories in the files list.
-	blkcnt_t  totalBlockAmount = 0;
+	// Gets the files from the program arguments.
+	char **files = getFiles(argc, argv, optind, fileAmountPointer);
+		
+	// Deep directories keep one directory open for each level (the library only stays within the limit).
+	raiseOpenFileLimit();
 	
-	// Block amount for a single file/directory.
-	blkcnt_t  blockAmountForFile = 0;
+	// The results are written through the output writer, straight to stdout.
+	struct outputWriter writer;
+	createOutputWriter(&writer, STDOUT_FILENO, outputFormat);
 	
-	// Block amount for a whole directory.
-	blkcnt_t  blockAmountForDirectory = 0;
+	int exitValue;
+	// If the totals are to be kept up to date (searched by one thread).
+	if (watchFlag == 1) {
+		exitValue = watchSizeOnDisk(files, fileAmount, &scanner.options, &writer, &threadBuffer);
+		if (writer.error != 0) {
+			fprintf(stderr, "mdu: write error: %s\n", strerror(writer.error));
+			exitValue = EXIT_FAILURE;
+		}
+		freeOutputWriter(&writer);
+	}
 	
-	int index = 0;
-	// Goes through the list of files/directories.
-	while (index < fileAmount) {
+	// Otherwise the search is done once, recursively (0 threads) or in parallel.
+	else {
 		
 		/**
-		 * Resets the block amounts (block amount for file does not need resetting,
-		 * as it gets assigned a new value each iteration)
-		 */
-		blockAmountForDirectory = 0;
-		totalBlockAmount = 0;
-				
-		// Struct to store info about the current file.
-		struct stat fileStat;
-		
-		// Stores the file info in the fileStat struct.
-		int statCheck = lstat(files[index], &fileStat);
-
-		// Error checks the storing of the file info.
-		if (statCheck == -1) {
-			perror("stat");
-			free(files);
-			exit(EXIT_FAILURE);
+		 * The program should always run with it atleast 1 thread, 
+		 * so if the user has specified 0 threads (-j0) the program will,
+		 * execute with 1 thread instead.
+		 */ 
+		if (jflag == 1 && threadAmount < 1) {
+			threadAmount = 1;
 		}
+		scanner.threadAmount = threadAmount;
+		scanner.callbacks.data = &writer;
 		
-		// Checks if the current file is a directory.
-		int fileCheck = S_ISDIR(fileStat.st_mode);
+		int result = mduScan(&scanner, files, fileAmount, NULL);
 		
-		// If the current file is a directory.
-		if (fileCheck == 1) {
-			
-			// Adds the first directory to the stack.
-			addDirectory(files[index]);
-	
-			threadIndex = 0;
-			// Goes through each thread.
-			while (threadIndex <= threadAmount) {
-								
-				/**
-				 * The program should always run with it atleast 1 thread, 
-				 * so if the user has specified 0 threads (-j0) the program will,
-				 * execute with 1 thread instead.
-				 */ 
-				if (threadAmount == 0) {
-					threadInfos[threadIndex].threadAmount = 1;
-				}
-				
-				// If the thread amount is not 0.
-				else {
-					threadInfos[threadIndex].threadAmount = threadAmount;
-				}
-				
-				// Prepares the rest of the thread info struct that gets sent into the function.
-				threadInfos[threadIndex].threadNumber = threadIndex;
-				strcpy(threadInfos[threadIndex].startDirectory, startingDirectory);
-				threadInfos[threadIndex].cond = &cond;
-				threadInfos[threadIndex].mutex = &mutex;
-				threadInfos[threadIndex].exitValuePointer = &exitval;
-				
-				// Creates a thread to run the searchDirectoryParallel function.
-				int createCheck = pthread_create(&threads[threadIndex], NULL, searchDirectoryParallel, &threadInfos[threadIndex]);
-
-				// Error checks the creation of the thread.
-				if (createCheck != 0) {
-					perror("pthread_create");
-					exit(EXIT_FAILURE);
-				}
-				
-				if ((threadIndex == threadAmount-1) || (threadAmount == 0)) {
-					break;
-				}
-				
-				threadIndex++;
-			}
-			
-			threadIndex = 0;
-			// Goes through each thread.
-			while (threadIndex <= threadAmount) {
-				
-				void *sumPointer;
-				
-				// Waits for the thread to terminate.
-				int joinCheck = pthread_join(threads[threadIndex], &sumPointer);
-				
-				// Error checks the waiting of the thread.
-				if (joinCheck != 0) {
-					perror("pthread_join");
-					exit(EXIT_FAILURE);
-				}
-				
-				// Adds the block amount that the thread has summed to the block amount for the directory.
-				blockAmountForDirectory = blockAmountForDirectory + (blkcnt_t)sumPointer;
-				
-				if ((threadIndex == threadAmount-1) || (threadAmount == 0)) {
-					break;
-				}
-				
-				threadIndex++;
-			}
-			
-			// Changes back to the start directory.
-			int changeDirectoryCheck = chdir(startingDirectory);
-			
-			// Error checks the switch to the start directory.
-			if (changeDirectoryCheck != 0) {
-				perror("chdir");
-				exit(EXIT_FAILURE);
-			}
+		// Lists the largest files and directories after the rest of the results (only if the search went through).
+		if (scanner.options.topAmount > 0 && result >= 0) {
+			printTopLists(&writer, &scanner);
 		}
+		flushOutputBuffer(&writer, &threadBuffer);
 		
-		// Gets the number of blocks allocated to the file.
-		blockAmountForFile = fileStat.st_blocks;
-				
-		// Adds the block amount for the file/directory to the total block amount.
-		totalBlockAmount = blockAmountForFile + blockAmountForDirectory;
-			
-		// Prints out the disk usage of the current file.
-		printf("%ld	%s\n", totalBlockAmount, files[index]);
-				
-		index++;
-	}
-	
-	// Destroys the lock and the condition variable.
-	pthread_mutex_destroy(&mutex);	
-	pthread_cond_destroy(&cond);	
-
-	// Frees the files and the wait statuses.
-	free(files);
-	freeWaitStatuses();
-	
-	return exitval;
-}
-
-/**
- * Calculates the size a directory takes on the disk in parallel.
- *
- * @param info	The information that each thread needs in order to do the search.
- */
-void *searchDirectoryParallel(void *info) {
-	
-	// Stores the thread info in local variables (for easier use).
-	struct threadInformation *threadInfo = (struct threadInformation*)info;
-	int threadNumber = (*threadInfo).threadNumber;
-	int threadAmount = (*threadInfo).threadAmount;
-	char startdir[PATH_MAX];
-	strcpy(startdir, (*threadInfo).startDirectory);	
-	pthread_mutex_t *mutex = (*threadInfo).mutex;
-	pthread_cond_t *cond = (*threadInfo).cond;
-	
-	// Sets the default exit value to success.
-	pthread_mutex_lock(mutex);
-	*(*threadInfo).exitValuePointer = EXIT_SUCCESS;
-	pthread_mutex_unlock(mutex);
-	
-	blkcnt_t totalBlockAmount = 0;
-	// Loop that will iterate until all threads are waiting.
-	while (1) {
-		
-		pthread_mutex_lock(mutex);
-		 
-		// Waits while the stack is empty.
-		int exitcondition = 1;
-		while (directoriesIsEmpty() == 0) {
-			
-			// Sets the wait status for the thread.
-			changeWaitStatus(threadNumber, 1);
-			
-			// Checks the wait statuses for all threads.
-			int waitCount = checkWaitStatuses();
-			
-			// If all threads are waiting.
-			if (waitCount == (threadAmount)) {
-				
-				// Sets the exit condition and wakes all other threads with a broadcast.
-				exitcondition = 0;
-				pthread_cond_broadcast(cond);
-				pthread_mutex_unlock(mutex);		
-				break;
-			}
-			pthread_cond_wait(cond, mutex);
+		// Prints the statistics of the threads (to stderr, so that they don't mix with the sizes).
+		if (scanner.statistics != NULL) {
+			printStatistics(stderr, scanner.options.statistics, scanner.statistics, scanner.statisticsAmount, scanner.nanoseconds);
 		}
 		
-		// Exits the loop so the thread can exit.
-		if (exitcondition == 0) {
-			break;
+		// Prints the confidence interval of each estimate.
+		if (scanner.estimates != NULL) {
+			printEstimates(&scanner, files);
 		}
 		
-		// If the thread gets here its no longer waiting so the status gets changed to active.
-		changeWaitStatus(threadNumber, 0);
-		
-		// Gets a directory from the stack.
-		char *directory = getDirectory();
-		
-		pthread_mutex_unlock(mutex);
-		
-		// Opens the directory
-		DIR *directoryPointer = opendir(directory);
-		
-		// Error checks the opening of the directory.
-		if (directoryPointer == NULL) {			
-			char errorString[PATH_MAX];
-			strcpy(errorString, "du: cannot read directory '");
-			strcat(errorString, directory);
-			perror(errorString);
-			exit(EXIT_FAILURE);
-		}
-
-		struct stat fileStat;
-		struct dirent *entry;
-		// Goes through each entry in the directory.
-		while ((entry = readdir(directoryPointer)) != NULL) {
-			
-			// If the current entry is not "." (link to current directory) or ".." (link to previous directory).
-			if ((strcmp(entry->d_name, ".") != 0) && (strcmp(entry->d_name, "..") != 0)) {
-								
-				// Creates the path for the file.
-				char fileToCheck[PATH_MAX];
-				strcpy(fileToCheck, directory);
-				strcat(fileToCheck, "/");
-				strcat(fileToCheck, entry->d_name);
-				
-				// Stores the file info in the fileStat struct.
-				int statCheck = lstat(fileToCheck, &fileStat);
-				
-				// Error checks the storing of the file info.
-				if (statCheck == -1) {
-					perror("stat");
-					exit(EXIT_FAILURE);
-				}
-				
-				// Adds the files block amount to the total block amount.
-				totalBlockAmount = fileStat.st_blocks + totalBlockAmount;
-				
-				// Checks if the file is a directory.
-				int directoryCheck = S_ISDIR(fileStat.st_mode);
-				
-				// If the file is a directory.
-				if (directoryCheck == 1) {
-					
-					// Opens the directory.
-					DIR *directoryPointer = opendir(fileToCheck);
-					
-					// If the directory can't be opened.
-					if (directoryPointer == NULL) {
-						
-						// Prepares the error message.
-						char errorString[PATH_MAX];
-						strcpy(errorString, "du: cannot read directory '");
-						strcat(errorString, fileToCheck);
-						strcat(errorString, "'");
-						
-						pthread_mutex_lock(mutex);
-						// Sets the exit value to failure.
-						*(*threadInfo).exitValuePointer = EXIT_FAILURE;
-						pthread_mutex_unlock(mutex);
-						
-						// Prints out the error message and closes the directory.
-						perror(errorString);
-						closedir(directoryPointer);
-					}
-					
-					// If the directory can be opened.
-					else {
-						// Closes the directory.
-						closedir(directoryPointer);
-						
-						// Prepares the new directory (with it's path) to be added to the stack.
-						char newDirectory[PATH_MAX];
-						strcpy(newDirectory, directory); 					
-						strcat(newDirectory, "/");
-						strcat(newDirectory, entry->d_name);
-						
-						pthread_mutex_lock(mutex);
-						// Adds the directory to the stack and wakes the next thread.
-						addDirectory(newDirectory);
-						pthread_cond_signal(cond);
-						pthread_mutex_unlock(mutex);
-					}
-				}	
-			}
+		if (result < 0) {
+			printScanFailure(&scanner, result);
 		}
+		exitValue = result == MDU_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
 		
-		// Frees and closes the directory.
-		free(directory);
-		closedir(directoryPointer);
+		// Results that could not be written make the program fail as well.
+		if (writer.error != 0) {
+			fprintf(stderr, "mdu: write error: %s\n", strerror(writer.error));
+			exitValue = EXIT_FAILURE;
+		}
+		freeOutputWriter(&writer);
+		mduFreeScanner(&scanner);
+		free(scanner.options.excludePatterns);
+		free(files);
 	}
 	
-	return (void*)totalBlockAmount;
+	exit(exitValue);
 }
 
 /**
- * Gets all the files/subdirectories in a directory.
+ * Gets the files/directories from the program arguments. getopt moves all
+ * the options in front of the files, so the files are the arguments that
+ * are left after the options.
  *
- * @param dirp				The directory pointer.
+ * @param argc				The amount of arguments.
+ * @param argv				The list of arguments.
+ * @param firstFile			The index of the first argument that is not an option.
  * @param fileAmountPointer	The pointer to the fileAmount variable.
- * @return files			The files/subdirectories in the directory.
+ * @return files			The list of files/directories.
  */
-char **getFilesInDirectory(DIR *dirp, int *fileAmountPointer) {
+char **getFiles(int argc, char **argv, int firstFile, int *fileAmountPointer) {
 		
 	// Allocates memory for the list of files/directories.
-	char **files = malloc(1*sizeof(char*));
+	char **files = malloc(argc*sizeof(char*));
 	
 	// Error checks the allocation of memory for the list of files/directories.
 	if (files == NULL) {
@@ -712,73 +571,17 @@ char **getFilesInDirectory(DIR *dirp, int *fileAmountPointer) {
 		exit(EXIT_FAILURE);
 	}
 	
-	struct dirent *entry;
-	int index = 0;
-	// Goes through the files in the directory.
-	while ((entry = readdir(dirp)) != NULL) {
-				
-		// Error checks the reading of the next entry.
-		if (entry == NULL) {
-			perror("readdir");
-			exit(EXIT_FAILURE);
-		}
-		
-		/**
-		 * If the current file is not "." or ".." (which are placeholders,
-		 * for the current directory and the parent directory) the file gets,
-		 * added to the list of files.
-		 */	
-		if ((strcmp(entry->d_name, ".") != 0) && (strcmp(entry->d_name, "..") != 0)) {
-			
-			files[index] = entry->d_name;
-			
-			files = realloc(files, (index+2)*sizeof(char*));
-			index++;
-		}
+	int fileIndex = 0;
+	int argumentIndex = firstFile;
+	// Goes through the arguments one by one.
+	while (argumentIndex < argc) {
+		files[fileIndex] = argv[argumentIndex];
+		fileIndex++;
+		argumentIndex++;
 	}
 	
-	*fileAmountPointer = index;
+	*fileAmountPointer = fileIndex;
 	
 	return files;
 }
 
-/**
- * Checks if a directory can be opened.
- *
- * @param directory		The directory to be checked.
- * @param pathPointer	The current path of the search.
- * @return 0 or 1		0 if it can be opened, 1 if it can not be opened. 
- */
-int checkDirectory(char *directory, char *pathPointer) {
-
-	// Opens the directory.
-	DIR *directoryPointer = opendir(directory);
-	
-	// Creates the error string.
-	char errorString[PATH_MAX];
-	strcpy(errorString, "du: cannot read directory '");
-	strcat(errorString, pathPointer);
-	strcat(errorString, "'");
-	
-	// Error checks the opening of the directory.
-	if (directoryPointer == NULL) {		
-		perror(errorString);
-		closedir(directoryPointer);
-		return 1;
-	}
-	
-	// Closes the directory.
-	closedir(directoryPointer);
-	return 0;
-}
-
-
-
-
-
-
-
-
-
-
-
@@ -5,7 +5,10 @@
  * @author Jakob Mukka
  * @date 2022-11-19
  */
-  
+
+#ifndef MDU_H
+#define MDU_H
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <stdint.h>
@@ -21,31 +24,13 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <limits.h>
+#include "libmdu.h"
 
 // Gets the files/directories that the user has specified.
-char **getFiles(int argc, char **argv, char *optind, int *fileAmountPointer);
-
-// Calculates the size a list of files takes on the disk recursively.
-int calculateSizeOnDiskRecursive(char **files, int fileAmount);
-
-// Does a recursive search of a directory.
-blkcnt_t searchDirectoryRecursive(char *directory, blkcnt_t totalBlockAmount, int *exitValuePointer, char *pathPointer);
-
-// Calculates the size a list of files takes on the disk in parallel.
-int calculateSizeOnDiskParallel(char **files, int fileAmount, int threadAmount);
-
-// Does a parallel search of a directory.
-void *searchDirectoryParallel(void *info);
-					
-// Gets the files in the directory.
-char **getFilesInDirectory(DIR *dirp, int *fileAmountPointer);
-
-// Checks if a directory can be opened.
-int checkDirectory(char *directory, char *pathPointer);
-
-
-
-
-
-
+char **getFiles(int argc, char **argv, int firstFile, int *fileAmountPointer);
 
+#endif
@@ -0,0 +1,433 @@
+/**
+ * This is the benchmark harness for the mdu program. It generates the trees
+ * with gentree (once, they are kept for the next runs), runs the recursive
+ * search and the parallel search with 1, 2, 4 ... threads on each of them,
+ * both with a cold cache (if the caches can be dropped) and a warm one, and
+ * prints a report. Every run is checked against du -s --block-size=512.
+ *
+ * The report has the time of each run (the median of the warm runs), the
+ * entries searched per second, the system calls per entry (if strace is
+ * installed), the peak memory use and the scaling efficiency, which is the
+ * speedup over -j1 divided by the amount of threads.
+ *
+ * Usage: ./mdubench [-d directory] [-s scale] [-j threads] [-r repeats] [-w]
+ *
+ * @file mdubench.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// The size of the buffer that the output of a command is read into.
+#define OUTPUT_SIZE 4096
+
+// The shapes of the trees that are searched (see gentree.c).
+static const char *shapes[] = {"wide", "deep", "tiny", "huge"};
+
+// The options for the benchmarks.
+struct benchOptions {
+	char *directory;
+	double scale;
+	int maxThreads;
+	int repeats;
+	int cold;
+};
+
+// What a command did.
+struct runResult {
+	double seconds;
+	long maxResident;
+	int status;
+	char output[OUTPUT_SIZE];
+};
+
+/**
+ * Runs a command and waits for it. The output is kept (as much as fits), the
+ * time is measured around the whole run and the peak memory use comes from
+ * the kernel once the command has exited.
+ *
+ * @param arguments	The command and its arguments (ending with NULL).
+ * @param result	The struct that the result is stored in.
+ * @return status	The exit status of the command (127 if it could not be run).
+ */
+static int runCommand(char **arguments, struct runResult *result) {
+
+	int pipeFds[2];
+	if (pipe(pipeFds) == -1) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid_t child = fork();
+	if (child == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+
+	// The child runs the command with its output going to the pipe.
+	if (child == 0) {
+		dup2(pipeFds[1], STDOUT_FILENO);
+		close(pipeFds[0]);
+		close(pipeFds[1]);
+		execvp(arguments[0], arguments);
+		_exit(127);
+	}
+
+	// Reads all of the output (the part that does not fit is thrown away).
+	close(pipeFds[1]);
+	size_t used = 0;
+	char discard[OUTPUT_SIZE];
+	while (1) {
+		ssize_t length;
+		if (used < OUTPUT_SIZE - 1) {
+			length = read(pipeFds[0], result->output + used, OUTPUT_SIZE - 1 - used);
+		}
+		else {
+			length = read(pipeFds[0], discard, sizeof(discard));
+		}
+		if (length == -1 && errno == EINTR) {
+			continue;
+		}
+		if (length <= 0) {
+			break;
+		}
+		if (used < OUTPUT_SIZE - 1) {
+			used = used + length;
+		}
+	}
+	result->output[used] = '\0';
+	close(pipeFds[0]);
+
+	int status;
+	struct rusage usage;
+	if (wait4(child, &status, 0, &usage) == -1) {
+		perror("wait4");
+		exit(EXIT_FAILURE);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+	result->maxResident = usage.ru_maxrss;
+	result->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+
+	return result->status;
+}
+
+/**
+ * Drops the page cache, the dentries and the inodes, so that the next run
+ * has to read everything from the disk.
+ *
+ * @return dropCheck	0 if the caches were dropped and -1 if they could not be.
+ */
+static int dropCaches(void) {
+
+	sync();
+
+	int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+
+	int writeCheck = write(fd, "3\n", 2) == 2 ? 0 : -1;
+	close(fd);
+	return writeCheck;
+}
+
+/**
+ * Makes sure that a tree of the right shape and scale exists. A tree that has
+ * been generated before is reused, its size is kept in a file next to it.
+ *
+ * @param options		The options for the benchmarks.
+ * @param shape			The shape of the tree.
+ * @param treePath		The path of the tree.
+ * @return entryAmount	The amount of files and directories in the tree.
+ */
+static long long prepareTree(struct benchOptions *options, const char *shape, const char *treePath) {
+
+	char infoPath[4096 + 16];
+	snprintf(infoPath, sizeof(infoPath), "%s.info", treePath);
+
+	// Reuses the tree if it has been generated with the same scale.
+	FILE *infoFile = fopen(infoPath, "r");
+	if (infoFile != NULL) {
+		double scale;
+		long long entryAmount;
+		int readCheck = fscanf(infoFile, "%lf %lld", &scale, &entryAmount);
+		fclose(infoFile);
+		if (readCheck == 2 && scale == options->scale) {
+			return entryAmount;
+		}
+	}
+
+	struct runResult result;
+	char *removeArguments[] = {"rm", "-rf", (char *)treePath, NULL};
+	runCommand(removeArguments, &result);
+	unlink(infoPath);
+
+	char scaleString[64];
+	snprintf(scaleString, sizeof(scaleString), "%.17g", options->scale);
+	char *generateArguments[] = {"./gentree", (char *)shape, (char *)treePath, scaleString, NULL};
+	fprintf(stderr, "mdubench: generating '%s' (scale %s)\n", treePath, scaleString);
+	if (runCommand(generateArguments, &result) != 0) {
+		fprintf(stderr, "mdubench: could not generate '%s'\n", treePath);
+		exit(EXIT_FAILURE);
+	}
+
+	long long entryAmount = atoll(result.output);
+	infoFile = fopen(infoPath, "w");
+	if (infoFile == NULL) {
+		perror("fopen");
+		exit(EXIT_FAILURE);
+	}
+	fprintf(infoFile, "%.17g %lld\n", options->scale, entryAmount);
+	fclose(infoFile);
+
+	return entryAmount;
+}
+
+/**
+ * Counts the system calls of a command (all threads) with strace.
+ *
+ * @param arguments	The command and its arguments (ending with NULL).
+ * @return calls	The amount of system calls or -1 if strace could not be used.
+ */
+static long long countSystemCalls(char **arguments) {
+
+	char summaryPath[] = "/tmp/mdubench-strace-XXXXXX";
+	int summaryFd = mkstemp(summaryPath);
+	if (summaryFd == -1) {
+		return -1;
+	}
+	close(summaryFd);
+
+	char *straceArguments[32] = {"strace", "-f", "-c", "-o", summaryPath, "--"};
+	int argumentAmount = 6;
+	for (int index = 0; arguments[index] != NULL && argumentAmount < 31; index++) {
+		straceArguments[argumentAmount] = arguments[index];
+		argumentAmount++;
+	}
+	straceArguments[argumentAmount] = NULL;
+
+	struct runResult result;
+	long long calls = -1;
+	if (runCommand(straceArguments, &result) == 0) {
+
+		/**
+		 * The calls are in the column that ends where the "calls" heading ends
+		 * (the other columns differ between the versions of strace).
+		 */
+		FILE *summary = fopen(summaryPath, "r");
+		char line[512];
+		size_t callsEnd = 0;
+		while (summary != NULL && fgets(line, sizeof(line), summary) != NULL) {
+			char *heading = strstr(line, "calls");
+			if (callsEnd == 0 && heading != NULL) {
+				callsEnd = heading - line + strlen("calls");
+			}
+			else if (callsEnd > 0 && strstr(line, " total") != NULL && strlen(line) > callsEnd) {
+				size_t start = callsEnd;
+				while (start > 0 && line[start - 1] >= '0' && line[start - 1] <= '9') {
+					start--;
+				}
+				if (start < callsEnd) {
+					calls = atoll(line + start);
+				}
+			}
+		}
+		if (summary != NULL) {
+			fclose(summary);
+		}
+	}
+
+	unlink(summaryPath);
+	return calls;
+}
+
+/**
+ * Compares two times (for qsort).
+ *
+ * @param first		The first time.
+ * @param second	The second time.
+ * @return order	Less than, equal to or greater than zero.
+ */
+static int compareSeconds(const void *first, const void *second) {
+
+	double difference = *(const double *)first - *(const double *)second;
+	return (difference > 0) - (difference < 0);
+}
+
+/**
+ * Runs one mode of mdu on a tree, checks the result and prints a row of the report.
+ *
+ * @param options		The options for the benchmarks.
+ * @param shape			The shape of the tree.
+ * @param arguments		The mdu command and its arguments (ending with NULL).
+ * @param mode			The name of the mode.
+ * @param cold			If the caches are dropped before the run.
+ * @param entryAmount	The amount of files and directories in the tree.
+ * @param expected		The blocks that du counted.
+ * @param baseline		The warm time with -j1 (0 if it is not known yet).
+ * @param threads		The amount of threads (0 for the recursive search).
+ * @return seconds		The time of the run (the median for warm runs) or -1 if the result was wrong.
+ */
+static double benchmarkMode(struct benchOptions *options, const char *shape, char **arguments, const char *mode, int cold, long long entryAmount, long long expected, double baseline, int threads) {
+
+	int runAmount = cold ? 1 : options->repeats;
+	double times[runAmount];
+	long maxResident = 0;
+	int correct = 1;
+
+	// A warm run is preceded by one that fills the caches.
+	struct runResult result;
+	if (cold) {
+		dropCaches();
+	}
+	else {
+		runCommand(arguments, &result);
+	}
+
+	for (int run = 0; run < runAmount; run++) {
+		if (runCommand(arguments, &result) != 0 || atoll(result.output) != expected) {
+			correct = 0;
+		}
+		times[run] = result.seconds;
+		if (result.maxResident > maxResident) {
+			maxResident = result.maxResident;
+		}
+		if (cold && run + 1 < runAmount) {
+			dropCaches();
+		}
+	}
+	qsort(times, runAmount, sizeof(double), compareSeconds);
+	double seconds = times[runAmount/2];
+
+	// The system calls are counted in a run of their own (strace slows the run down).
+	char callsString[32] = "-";
+	if (!cold) {
+		long long calls = countSystemCalls(arguments);
+		if (calls >= 0) {
+			snprintf(callsString, sizeof(callsString), "%.2f", (double)calls/entryAmount);
+		}
+	}
+
+	char efficiencyString[32] = "-";
+	if (!cold && threads > 0 && baseline > 0) {
+		snprintf(efficiencyString, sizeof(efficiencyString), "%.0f%%", 100*baseline/(seconds*threads));
+	}
+
+	printf("%-6s %-10s %-5s %9.3f %12.0f %14s %10.1f %10s  %s\n", shape, mode, cold ? "cold" : "warm", seconds, entryAmount/seconds, callsString, maxResident/1024.0, efficiencyString, correct ? "ok" : "WRONG");
+	fflush(stdout);
+
+	return correct ? seconds : -1;
+}
+
+/**
+ * Main method for the benchmarks.
+ *
+ * @param argc			The amount of arguments for the program.
+ * @param argv			The list of arguments for the program.
+ * @return exitValue	The exit value for the program (failure if any result was wrong).
+ */
+int main(int argc, char **argv) {
+
+	struct benchOptions options = {"/tmp/mdu-bench", 0.1, 0, 3, 1};
+	options.maxThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int option;
+	while ((option = getopt(argc, argv, "d:s:j:r:w")) != -1) {
+		switch (option) {
+			case 'd':
+				options.directory = optarg;
+				break;
+			case 's':
+				options.scale = atof(optarg);
+				break;
+			case 'j':
+				options.maxThreads = atoi(optarg);
+				break;
+			case 'r':
+				options.repeats = atoi(optarg);
+				break;
+			case 'w':
+				options.cold = 0;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-d directory] [-s scale] [-j threads] [-r repeats] [-w]\n", argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+	if (options.scale <= 0 || options.maxThreads < 1 || options.repeats < 1) {
+		fprintf(stderr, "%s: the scale, the threads and the repeats have to be above zero\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	// Cold runs need to be able to drop the caches (which needs root).
+	if (options.cold && dropCaches() == -1) {
+		fprintf(stderr, "mdubench: cannot drop the caches (%s), only warm runs are done\n", strerror(errno));
+		options.cold = 0;
+	}
+
+	if (mkdir(options.directory, 0755) == -1 && errno != EEXIST) {
+		fprintf(stderr, "mdubench: cannot create '%s': %s\n", options.directory, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	int exitValue = EXIT_SUCCESS;
+	printf("%-6s %-10s %-5s %9s %12s %14s %10s %10s  %s\n", "tree", "mode", "cache", "seconds", "entries/s", "syscalls/entry", "RSS (MiB)", "efficiency", "check");
+
+	// Goes through each shape of tree.
+	for (size_t shapeIndex = 0; shapeIndex < sizeof(shapes)/sizeof(shapes[0]); shapeIndex++) {
+		char treePath[4096];
+		snprintf(treePath, sizeof(treePath), "%s/%s", options.directory, shapes[shapeIndex]);
+		long long entryAmount = prepareTree(&options, shapes[shapeIndex], treePath);
+
+		// The correct answer.
+		struct runResult result;
+		char *duArguments[] = {"du", "-s", "--block-size=512", treePath, NULL};
+		if (runCommand(duArguments, &result) != 0) {
+			fprintf(stderr, "mdubench: du failed on '%s'\n", treePath);
+			exit(EXIT_FAILURE);
+		}
+		long long expected = atoll(result.output);
+
+		// The recursive search and then the parallel search with 1, 2, 4 ... threads (and the most threads).
+		for (int cold = options.cold; cold >= 0; cold--) {
+			char *recursiveArguments[] = {"./mdu", treePath, NULL};
+			if (benchmarkMode(&options, shapes[shapeIndex], recursiveArguments, "recursive", cold, entryAmount, expected, 0, 0) < 0) {
+				exitValue = EXIT_FAILURE;
+			}
+
+			double baseline = 0;
+			for (int threads = 1; threads <= options.maxThreads; threads = threads < options.maxThreads && threads*2 > options.maxThreads ? options.maxThreads : threads*2) {
+				char threadString[32];
+				snprintf(threadString, sizeof(threadString), "-j%d", threads);
+				char *parallelArguments[] = {"./mdu", threadString, treePath, NULL};
+
+				double seconds = benchmarkMode(&options, shapes[shapeIndex], parallelArguments, threadString, cold, entryAmount, expected, baseline, threads);
+				if (seconds < 0) {
+					exitValue = EXIT_FAILURE;
+				}
+				if (threads == 1) {
+					baseline = seconds;
+				}
+			}
+		}
+	}
+
+	return exitValue;
+}
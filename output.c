@@ -0,0 +1,370 @@
+/**
+ * This is the implementation file for the output writer. The records are
+ * formatted by hand (no printf) straight into the buffer of the thread, and a
+ * full buffer is written out with as few write calls as the file descriptor
+ * allows. The lock is only taken to write a buffer out, so that the writes of
+ * different threads never mix (a pipe only keeps writes of up to PIPE_BUF
+ * bytes together on its own).
+ *
+ * @file output.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "output.h"
+
+// The most bytes that a record takes apart from its path: {"path": and the quotes, ,"blocks": and a 64-bit number with its sign, ,"rank": and an int, and ,"type":"directory"} with the newline.
+#define RECORD_OVERHEAD (8 + 2 + 10 + 20 + 8 + 11 + 21)
+
+/**
+ * Gets the time in nanoseconds from a coarse clock that never jumps.
+ *
+ * @return nanoseconds	The time.
+ */
+static long long getOutputTime(void) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Sets up an output writer.
+ *
+ * @param writer	The writer.
+ * @param fd		Where the records are written.
+ * @param format	The output format (OUTPUT_TEXT, OUTPUT_NULL or OUTPUT_JSON).
+ */
+void createOutputWriter(struct outputWriter *writer, int fd, int format) {
+
+	writer->fd = fd;
+	writer->format = format;
+	writer->error = 0;
+	pthread_mutex_init(&writer->mutex, NULL);
+}
+
+/**
+ * Frees an output writer (the buffers have to be written out first).
+ *
+ * @param writer	The writer.
+ */
+void freeOutputWriter(struct outputWriter *writer) {
+	pthread_mutex_destroy(&writer->mutex);
+}
+
+/**
+ * Writes bytes to the writers file descriptor (the caller holds the lock).
+ * Once a write has failed nothing more is written.
+ *
+ * @param writer	The writer.
+ * @param data		The bytes.
+ * @param size		The amount of bytes.
+ */
+static void writeOutput(struct outputWriter *writer, const char *data, size_t size) {
+
+	while (size > 0 && writer->error == 0) {
+		ssize_t written = write(writer->fd, data, size);
+		if (written == -1) {
+			if (errno != EINTR) {
+				writer->error = errno;
+			}
+			continue;
+		}
+		data = data + written;
+		size = size - written;
+	}
+}
+
+/**
+ * Gets the length of the UTF-8 character at the start of a string.
+ *
+ * @param string	The string.
+ * @return length	The length of the character (1 to 4) or 0 if the bytes are not valid UTF-8.
+ */
+static int getCharacterLength(const unsigned char *string) {
+
+	int length;
+	unsigned int character;
+	if (string[0] < 0x80) {
+		return 1;
+	}
+	else if ((string[0] & 0xe0) == 0xc0) {
+		length = 2;
+		character = string[0] & 0x1f;
+	}
+	else if ((string[0] & 0xf0) == 0xe0) {
+		length = 3;
+		character = string[0] & 0x0f;
+	}
+	else if ((string[0] & 0xf8) == 0xf0) {
+		length = 4;
+		character = string[0] & 0x07;
+	}
+	else {
+		return 0;
+	}
+
+	for (int index = 1; index < length; index++) {
+		if ((string[index] & 0xc0) != 0x80) {
+			return 0;
+		}
+		character = (character << 6) | (string[index] & 0x3f);
+	}
+
+	// Overlong forms, surrogates and characters beyond the last code point are not valid.
+	unsigned int smallest[] = {0, 0, 0x80, 0x800, 0x10000};
+	if (character < smallest[length] || (character >= 0xd800 && character <= 0xdfff) || character > 0x10ffff) {
+		return 0;
+	}
+	return length;
+}
+
+/**
+ * Writes a path as a JSON string (with the quotes). Control characters,
+ * quotes and backslashes are escaped, and a byte that is not part of valid
+ * UTF-8 is written as the escape of the code point with the same value (a
+ * path is any bytes, but JSON has to be UTF-8).
+ *
+ * @param out		Where the string is written (room for six bytes for each byte of the path and the quotes).
+ * @param path		The path.
+ * @return length	The amount of bytes written.
+ */
+static size_t formatJsonString(char *out, const char *path) {
+
+	const char *hexadecimal = "0123456789abcdef";
+	const unsigned char *byte = (const unsigned char *)path;
+	size_t length = 0;
+
+	out[length++] = '"';
+	while (*byte != '\0') {
+		int characterLength = getCharacterLength(byte);
+		if (*byte == '"' || *byte == '\\') {
+			out[length++] = '\\';
+			out[length++] = *byte;
+		}
+		else if (*byte == '\n') {
+			out[length++] = '\\';
+			out[length++] = 'n';
+		}
+		else if (*byte == '\t') {
+			out[length++] = '\\';
+			out[length++] = 't';
+		}
+		else if (*byte < 0x20 || *byte == 0x7f || characterLength == 0) {
+			memcpy(out + length, "\\u00", 4);
+			out[length + 4] = hexadecimal[*byte >> 4];
+			out[length + 5] = hexadecimal[*byte & 0x0f];
+			length = length + 6;
+		}
+		else {
+			memcpy(out + length, byte, characterLength);
+			length = length + characterLength;
+			byte = byte + characterLength;
+			continue;
+		}
+		byte++;
+	}
+	out[length++] = '"';
+
+	return length;
+}
+
+/**
+ * Writes a block amount in decimal.
+ *
+ * @param out			Where the number is written (room for 20 bytes).
+ * @param blockAmount	The block amount.
+ * @return length		The amount of bytes written.
+ */
+static size_t formatBlockAmount(char *out, blkcnt_t blockAmount) {
+
+	char digits[24];
+	int digitAmount = 0;
+	unsigned long long value = blockAmount < 0 ? -(unsigned long long)blockAmount : (unsigned long long)blockAmount;
+	do {
+		digits[digitAmount++] = '0' + value % 10;
+		value = value/10;
+	} while (value > 0);
+
+	size_t length = 0;
+	if (blockAmount < 0) {
+		out[length++] = '-';
+	}
+	while (digitAmount > 0) {
+		out[length++] = digits[--digitAmount];
+	}
+	return length;
+}
+
+/**
+ * Formats the record of a file/directory.
+ *
+ * @param out			Where the record is written (room for RECORD_OVERHEAD bytes and six for each byte of the path).
+ * @param format		The output format.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param directory		If it is a directory.
+ * @param rank			Where the file/directory is in a list of the largest ones (0 if it is not in one, only written in JSON).
+ * @return length		The length of the record.
+ */
+static size_t formatUsageRecord(char *out, int format, const char *path, blkcnt_t blockAmount, int directory, int rank) {
+
+	size_t length = 0;
+	if (format == OUTPUT_JSON) {
+		memcpy(out, "{\"path\":", 8);
+		length = 8;
+		length = length + formatJsonString(out + length, path);
+		memcpy(out + length, ",\"blocks\":", 10);
+		length = length + 10;
+		length = length + formatBlockAmount(out + length, blockAmount);
+		if (rank > 0) {
+			memcpy(out + length, ",\"rank\":", 8);
+			length = length + 8;
+			length = length + formatBlockAmount(out + length, rank);
+		}
+		const char *type = directory ? ",\"type\":\"directory\"}\n" : ",\"type\":\"file\"}\n";
+		size_t typeLength = strlen(type);
+		memcpy(out + length, type, typeLength);
+		return length + typeLength;
+	}
+
+	length = formatBlockAmount(out, blockAmount);
+	out[length++] = '\t';
+	size_t pathLength = strlen(path);
+	memcpy(out + length, path, pathLength);
+	length = length + pathLength;
+	out[length++] = format == OUTPUT_NULL ? '\0' : '\n';
+	return length;
+}
+
+/**
+ * Adds a record to a threads buffer. A buffer that does not have room for the
+ * record is written out first, and a record that would not fit in a buffer at
+ * all is written out on its own. A buffer whose first record has waited for
+ * too long is written out after the record, so that a slow search still sends its results
+ * along.
+ *
+ * @param writer		The writer.
+ * @param buffer		The threads buffer.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param directory		If it is a directory.
+ * @param rank			Where the file/directory is in a list of the largest ones (0 if it is not in one).
+ */
+static void writeRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *path, blkcnt_t blockAmount, int directory, int rank) {
+
+	// The largest the record can get (only JSON escapes make a path longer).
+	size_t pathLength = strlen(path);
+	size_t largest = RECORD_OVERHEAD + (writer->format == OUTPUT_JSON ? 6*pathLength : pathLength);
+
+	if (largest > OUTPUT_BUFFER_SIZE - buffer->used) {
+		flushOutputBuffer(writer, buffer);
+	}
+
+	if (largest <= OUTPUT_BUFFER_SIZE) {
+
+		// The wait is counted from the first record of the buffer, so a lone record is not written out on its own.
+		long long now = getOutputTime();
+		if (buffer->used == 0) {
+			buffer->firstRecordTime = now;
+		}
+		buffer->used = buffer->used + formatUsageRecord(buffer->data + buffer->used, writer->format, path, blockAmount, directory, rank);
+		if (now - buffer->firstRecordTime > OUTPUT_FLUSH_INTERVAL) {
+			flushOutputBuffer(writer, buffer);
+		}
+		return;
+	}
+
+	char *record = malloc(largest);
+
+	// A record that there is no memory for is lost, just like a record that can not be written.
+	if (record == NULL) {
+		pthread_mutex_lock(&writer->mutex);
+		if (writer->error == 0) {
+			writer->error = ENOMEM;
+		}
+		pthread_mutex_unlock(&writer->mutex);
+		return;
+	}
+
+	size_t length = formatUsageRecord(record, writer->format, path, blockAmount, directory, rank);
+	pthread_mutex_lock(&writer->mutex);
+	writeOutput(writer, record, length);
+	pthread_mutex_unlock(&writer->mutex);
+	free(record);
+}
+
+/**
+ * Adds the disk usage of a file/directory to a threads buffer.
+ *
+ * @param writer		The writer.
+ * @param buffer		The threads buffer.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param directory		If it is a directory.
+ */
+void writeUsageRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *path, blkcnt_t blockAmount, int directory) {
+	writeRecord(writer, buffer, path, blockAmount, directory, 0);
+}
+
+/**
+ * Adds a file/directory from a list of the largest ones to a threads buffer.
+ * The record looks like any other, except that in JSON it also has the rank.
+ *
+ * @param writer		The writer.
+ * @param buffer		The threads buffer.
+ * @param path			The path of the file/directory.
+ * @param blockAmount	The amount of blocks the file/directory takes on the disk.
+ * @param directory		If it is a directory.
+ * @param rank			Where it is in the list (from 1).
+ */
+void writeTopRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *path, blkcnt_t blockAmount, int directory, int rank) {
+	writeRecord(writer, buffer, path, blockAmount, directory, rank);
+}
+
+/**
+ * Adds a heading to a threads buffer, as a record of its own without a tab
+ * (so it can not be taken for a file/directory). JSON has no headings, the
+ * records there have a type and a rank instead.
+ *
+ * @param writer	The writer.
+ * @param buffer	The threads buffer.
+ * @param heading	The heading.
+ */
+void writeHeadingRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *heading) {
+	
+	size_t length = strlen(heading);
+	if (writer->format == OUTPUT_JSON || length + 1 > OUTPUT_BUFFER_SIZE) {
+		return;
+	}
+	if (length + 1 > OUTPUT_BUFFER_SIZE - buffer->used) {
+		flushOutputBuffer(writer, buffer);
+	}
+	memcpy(buffer->data + buffer->used, heading, length);
+	buffer->data[buffer->used + length] = writer->format == OUTPUT_NULL ? '\0' : '\n';
+	buffer->used = buffer->used + length + 1;
+}
+
+/**
+ * Writes out the records in a threads buffer.
+ *
+ * @param writer	The writer.
+ * @param buffer	The threads buffer.
+ */
+void flushOutputBuffer(struct outputWriter *writer, struct outputBuffer *buffer) {
+
+	if (buffer->used == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->mutex);
+	writeOutput(writer, buffer->data, buffer->used);
+	pthread_mutex_unlock(&writer->mutex);
+	buffer->used = 0;
+}
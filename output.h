@@ -0,0 +1,72 @@
+/**
+ * This is the header file for the output writer, which writes the disk usage
+ * of the files/directories in one of the output formats. Each thread formats
+ * its records into a buffer of its own, and the buffers are written out whole
+ * (one write at a time) when they are full or when the thread is done, so a
+ * record is never split and the threads do not wait for each other for every
+ * record.
+ *
+ * @file output.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <sys/types.h>
+#include <pthread.h>
+
+// The records are lines of the block amount, a tab and the path.
+#define OUTPUT_TEXT 0
+
+// The records are the block amount, a tab and the path, ended by a NUL (a path can hold anything but a NUL).
+#define OUTPUT_NULL 1
+
+// The records are lines of JSON objects with the path, the block amount and the type.
+#define OUTPUT_JSON 2
+
+// The size of the buffer of each thread.
+#define OUTPUT_BUFFER_SIZE (64*1024)
+
+// How many nanoseconds a record may wait in a buffer before the buffer is written out (if more records come).
+#define OUTPUT_FLUSH_INTERVAL 100000000LL
+
+// Where the records are written and the lock that keeps the writes of the threads apart.
+struct outputWriter {
+	int fd;
+	int format;
+	pthread_mutex_t mutex;
+
+	// The errno of the first write that failed (0 if none has, nothing is written after it).
+	int error;
+};
+
+// The records of one thread that have not been written yet.
+struct outputBuffer {
+	size_t used;
+
+	// When the oldest record in the buffer was added (from a coarse clock, which is cheap enough to read for every record).
+	long long firstRecordTime;
+	char data[OUTPUT_BUFFER_SIZE];
+};
+
+// Sets up an output writer.
+void createOutputWriter(struct outputWriter *writer, int fd, int format);
+
+// Frees an output writer.
+void freeOutputWriter(struct outputWriter *writer);
+
+// Adds the disk usage of a file/directory to a buffer (the buffer is written out first if it is full).
+void writeUsageRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *path, blkcnt_t blockAmount, int directory);
+
+// Adds a file/directory from a list of the largest ones to a buffer (JSON records also get the rank).
+void writeTopRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *path, blkcnt_t blockAmount, int directory, int rank);
+
+// Adds a heading to a buffer (not in JSON).
+void writeHeadingRecord(struct outputWriter *writer, struct outputBuffer *buffer, const char *heading);
+
+// Writes out the records in a buffer.
+void flushOutputBuffer(struct outputWriter *writer, struct outputBuffer *buffer);
+
+#endif
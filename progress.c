@@ -0,0 +1,265 @@
+/**
+ * This is the implementation file for the progress reporter. The reporter is
+ * a thread of its own that wakes up every second, adds up the counters of
+ * the searching threads and writes a status line with the entries,
+ * directories and blocks found so far, how fast the search is going and,
+ * from the directories that are still waiting, how long it might take.
+ *
+ * @file progress.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "progress.h"
+#include "stats.h"
+
+// How many nanoseconds there are between the status lines.
+#define PROGRESS_INTERVAL 1000000000LL
+
+/**
+ * Adds what a thread has searched to its counters. The thread is the only one
+ * that writes to them, so a relaxed load and store is enough (no locked
+ * instruction is needed).
+ *
+ * @param counters		The threads counters (nothing is done if it is NULL).
+ * @param entries		The amount of entries that were read.
+ * @param directories	The amount of directories that were searched.
+ * @param blocks		The amount of blocks that were found.
+ */
+void addProgress(struct progressCounters *counters, long long entries, long long directories, long long blocks) {
+
+	if (counters == NULL) {
+		return;
+	}
+
+	atomic_store_explicit(&counters->entries, atomic_load_explicit(&counters->entries, memory_order_relaxed) + entries, memory_order_relaxed);
+	atomic_store_explicit(&counters->directories, atomic_load_explicit(&counters->directories, memory_order_relaxed) + directories, memory_order_relaxed);
+	atomic_store_explicit(&counters->blocks, atomic_load_explicit(&counters->blocks, memory_order_relaxed) + blocks, memory_order_relaxed);
+}
+
+/**
+ * Changes the amount of directories that a thread has found but not searched
+ * yet (the recursive search has no work tracker that could be asked).
+ *
+ * @param counters		The threads counters (nothing is done if it is NULL).
+ * @param difference	How much the amount changes.
+ */
+void addPendingProgress(struct progressCounters *counters, long long difference) {
+
+	if (counters == NULL) {
+		return;
+	}
+
+	atomic_store_explicit(&counters->pending, atomic_load_explicit(&counters->pending, memory_order_relaxed) + difference, memory_order_relaxed);
+}
+
+/**
+ * Writes an amount of bytes with a unit that suits it.
+ *
+ * @param buffer	The buffer that the size is written to.
+ * @param size		The size of the buffer.
+ * @param bytes		The amount of bytes.
+ */
+static void formatBytes(char *buffer, size_t size, double bytes) {
+
+	const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB", "PiB"};
+	int unit = 0;
+	while (bytes >= 1024 && unit < 5) {
+		bytes = bytes/1024;
+		unit++;
+	}
+	snprintf(buffer, size, "%.1f %s", bytes, units[unit]);
+}
+
+/**
+ * Writes the status line.
+ *
+ * @param reporter		The reporter.
+ * @param rate			The entries per second (the last line has the average instead).
+ * @param directoryRate	The directories per second (used for the estimate).
+ * @param final			If it is the last line (the search is done).
+ */
+static void writeProgress(struct progressReporter *reporter, double rate, double directoryRate, int final) {
+
+	long long entries = 0;
+	long long directories = 0;
+	long long blocks = 0;
+	long long pending = 0;
+	for (int index = 0; index < reporter->counterAmount; index++) {
+		entries = entries + atomic_load_explicit(&reporter->counters[index].entries, memory_order_relaxed);
+		directories = directories + atomic_load_explicit(&reporter->counters[index].directories, memory_order_relaxed);
+		blocks = blocks + atomic_load_explicit(&reporter->counters[index].blocks, memory_order_relaxed);
+		pending = pending + atomic_load_explicit(&reporter->counters[index].pending, memory_order_relaxed);
+	}
+	if (reporter->pendingDirectories != NULL) {
+		pending = atomic_load_explicit(reporter->pendingDirectories, memory_order_relaxed);
+	}
+
+	char size[32];
+	formatBytes(size, sizeof(size), blocks*512.0);
+
+	// The estimate assumes that the waiting directories are searched as fast as the last ones were.
+	char estimate[64];
+	if (final) {
+		double seconds = (getStatisticsTime() - reporter->startTime)/1e9;
+		snprintf(estimate, sizeof(estimate), "done in %.1f s", seconds);
+		rate = seconds > 0 ? entries/seconds : 0;
+	}
+	else if (directoryRate > 0 && pending >= 0) {
+		long long seconds = (long long)(pending/directoryRate);
+		snprintf(estimate, sizeof(estimate), "ETA %lld:%02lld:%02lld", seconds/3600, seconds/60%60, seconds%60);
+	}
+	else {
+		snprintf(estimate, sizeof(estimate), "ETA ?");
+	}
+
+	char line[256];
+	int length = snprintf(line, sizeof(line), "%s%lld entries, %lld directories, %s, %.0f entries/s, %lld waiting, %s%s", reporter->terminal ? "\r" : "", entries, directories, size, rate, pending, estimate, reporter->terminal ? "\033[K" : "\n");
+	if (length > (int)sizeof(line) - 1) {
+		length = sizeof(line) - 1;
+	}
+
+	// A status line that can not be written is simply skipped.
+	if (write(reporter->fd, line, length) == -1) {
+		return;
+	}
+}
+
+/**
+ * The reporter thread. It sleeps for a second at a time (or until it is
+ * stopped) and writes a status line each time it wakes up.
+ *
+ * @param info	The reporter.
+ */
+static void *reportProgress(void *info) {
+
+	struct progressReporter *reporter = (struct progressReporter *)info;
+
+	long long lastTime = reporter->startTime;
+	long long lastEntries = 0;
+	long long lastDirectories = 0;
+	double rate = 0;
+	double directoryRate = 0;
+
+	pthread_mutex_lock(&reporter->mutex);
+	long long wakeTime = reporter->startTime + PROGRESS_INTERVAL;
+	while (reporter->stopping == 0) {
+		struct timespec wake = {wakeTime/1000000000LL, wakeTime%1000000000LL};
+		int waitCheck = pthread_cond_timedwait(&reporter->condition, &reporter->mutex, &wake);
+		if (reporter->stopping == 1 || waitCheck != ETIMEDOUT) {
+			continue;
+		}
+		wakeTime = wakeTime + PROGRESS_INTERVAL;
+
+		// The rates are smoothed over the last few seconds so that the estimate does not jump around.
+		long long now = getStatisticsTime();
+		long long entries = 0;
+		long long directories = 0;
+		for (int index = 0; index < reporter->counterAmount; index++) {
+			entries = entries + atomic_load_explicit(&reporter->counters[index].entries, memory_order_relaxed);
+			directories = directories + atomic_load_explicit(&reporter->counters[index].directories, memory_order_relaxed);
+		}
+		double seconds = (now - lastTime)/1e9;
+		if (seconds > 0) {
+			double newRate = (entries - lastEntries)/seconds;
+			double newDirectoryRate = (directories - lastDirectories)/seconds;
+			rate = lastEntries == 0 ? newRate : 0.7*rate + 0.3*newRate;
+			directoryRate = lastDirectories == 0 ? newDirectoryRate : 0.7*directoryRate + 0.3*newDirectoryRate;
+		}
+		lastTime = now;
+		lastEntries = entries;
+		lastDirectories = directories;
+
+		writeProgress(reporter, rate, directoryRate, 0);
+	}
+	pthread_mutex_unlock(&reporter->mutex);
+
+	// A terminal gets its line cleared, anything else gets the final totals.
+	if (reporter->terminal) {
+		if (write(reporter->fd, "\r\033[K", 4) == -1) {
+			return NULL;
+		}
+	}
+	else {
+		writeProgress(reporter, rate, directoryRate, 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * Starts the progress reporter.
+ *
+ * @param reporter				The reporter.
+ * @param fd					Where the status line is written.
+ * @param threadAmount			The amount of searching threads (each one gets its own counters).
+ * @param pendingDirectories	The directories that are waiting to be searched (NULL to add up the pending counters).
+ * @return 0 or -1				0 on success, -1 if the reporter could not be started (the search goes on without it).
+ */
+int startProgress(struct progressReporter *reporter, int fd, int threadAmount, atomic_long *pendingDirectories) {
+
+	reporter->counters = aligned_alloc(64, threadAmount*sizeof(struct progressCounters));
+
+	// Error checks the allocation of the counters.
+	if (reporter->counters == NULL) {
+		return -1;
+	}
+
+	for (int index = 0; index < threadAmount; index++) {
+		atomic_init(&reporter->counters[index].entries, 0);
+		atomic_init(&reporter->counters[index].directories, 0);
+		atomic_init(&reporter->counters[index].blocks, 0);
+		atomic_init(&reporter->counters[index].pending, 0);
+	}
+	reporter->counterAmount = threadAmount;
+	reporter->pendingDirectories = pendingDirectories;
+	reporter->fd = fd;
+	reporter->terminal = isatty(fd);
+	reporter->startTime = getStatisticsTime();
+	reporter->stopping = 0;
+
+	// The reporter sleeps on the same clock that the times come from.
+	pthread_condattr_t conditionAttributes;
+	pthread_condattr_init(&conditionAttributes);
+	pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&reporter->condition, &conditionAttributes);
+	pthread_condattr_destroy(&conditionAttributes);
+	pthread_mutex_init(&reporter->mutex, NULL);
+
+	int createCheck = pthread_create(&reporter->thread, NULL, reportProgress, reporter);
+
+	// Error checks the creation of the thread.
+	if (createCheck != 0) {
+		pthread_cond_destroy(&reporter->condition);
+		pthread_mutex_destroy(&reporter->mutex);
+		free(reporter->counters);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Stops the progress reporter and waits for it to write its last line.
+ *
+ * @param reporter	The reporter.
+ */
+void stopProgress(struct progressReporter *reporter) {
+
+	pthread_mutex_lock(&reporter->mutex);
+	reporter->stopping = 1;
+	pthread_cond_signal(&reporter->condition);
+	pthread_mutex_unlock(&reporter->mutex);
+
+	pthread_join(reporter->thread, NULL);
+	pthread_cond_destroy(&reporter->condition);
+	pthread_mutex_destroy(&reporter->mutex);
+	free(reporter->counters);
+}
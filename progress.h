@@ -0,0 +1,61 @@
+/**
+ * This is the header file for the progress reporter, which prints a status
+ * line every second while a long search is running.
+ *
+ * @file progress.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * The progress of one thread. Only the thread itself writes to its counters
+ * (once per directory, with relaxed atomics), and each thread has its own
+ * cache line, so the search does not slow down from being watched.
+ */
+struct progressCounters {
+	_Alignas(64) atomic_llong entries;
+	atomic_llong directories;
+	atomic_llong blocks;
+
+	// The directories that have been found but not searched yet (only used by the recursive search).
+	atomic_llong pending;
+};
+
+// The thread that prints the progress and what it needs.
+struct progressReporter {
+	struct progressCounters *counters;
+	int counterAmount;
+
+	// The directories that are waiting to be searched (NULL to add up the pending counters instead).
+	atomic_long *pendingDirectories;
+
+	// Where the status line is written and if it is a terminal (the line is then rewritten in place).
+	int fd;
+	int terminal;
+
+	long long startTime;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t condition;
+	int stopping;
+};
+
+// Starts the progress reporter (with one set of counters for each thread).
+int startProgress(struct progressReporter *reporter, int fd, int threadAmount, atomic_long *pendingDirectories);
+
+// Stops the progress reporter.
+void stopProgress(struct progressReporter *reporter);
+
+// Adds what a thread has searched to its counters.
+void addProgress(struct progressCounters *counters, long long entries, long long directories, long long blocks);
+
+// Changes the amount of directories that a thread has waiting.
+void addPendingProgress(struct progressCounters *counters, long long difference);
+
+#endif
@@ -0,0 +1,27 @@
+/**
+ * This is the header file for the parts of the search that the modules built
+ * on top of it share: the estimate runs the parallel search one level at a
+ * time, and the watch mode checks the files the same way as the search. It is
+ * private to libmdu and the program (a program that uses the library only
+ * needs libmdu.h).
+ *
+ * @file search.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <sys/types.h>
+#include "libmdu.h"
+#include "exclude.h"
+#include "links.h"
+
+// Calculates the size a list of files takes on the disk in parallel.
+int calculateSizeOnDiskParallel(struct mduScanner *scanner, char **files, int fileAmount, blkcnt_t *blockAmounts, const struct excludeMatcher *exclude, struct nameList *frontiers, struct linkSet *links);
+
+// Gets the flags for the file attributes that the search needs.
+int getAttributeFlags(struct scanOptions *options);
+
+#endif
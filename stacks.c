@@ -1,191 +1,700 @@
 /**
- * This is the implementation file for the two stacks (directories and wait statuses),
+ * This is the implementation file for the directory deques and the work tracker,
  * that the program uses.
  *
  * @file stacks.c
  * @author Jakob Mukka
  * @date 2022-11-19
  */
-  
+
 #include "stacks.h"
+#include "entries.h"
+
+// The initial amount of directories that fits in a deque.
+#define INITIAL_DEQUE_SIZE 64
+
+// The size of the chunks that directory items are cut from.
+#define ITEM_CHUNK_SIZE (64*1024)
+
+// A chunk of memory for directory items.
+struct itemChunk {
 
-// The directories stack.
-struct directory {
-    char directoryName[PATH_MAX];
-    struct directory *next;
+	// The items that have not been released (and one more while the chunk is an arenas current chunk).
+	atomic_long items;
+	size_t used;
+	size_t size;
+	_Alignas(struct directoryItem) char memory[];
 };
 
-// The wait statuses stack.
-struct waitStatus {
-	int threadNumber;
-	int status;
-	struct waitStatus *next;
+// The circular array that holds the directories of a deque.
+struct directoryArray {
+	long size;
+	struct directoryArray *next;
+	_Atomic(struct directoryItem *) directories[];
 };
 
-// Pointer to the top of the directories stack.
-struct directory *directoryTop;
-
-// Pointer to the top of the wait statuses stack.
-struct waitStatus *waitStatusTop;
-
-/**
- * Adds a directory to the directories stack.
- *
- * @param dirName	The name of the directory.
- */
-void addDirectory(char *dirName) {
-	
-	// Creates a new directory.
-    struct directory *newdirectory;
-    newdirectory = (struct directory *)malloc(sizeof(struct directory));
-	strcpy(newdirectory->directoryName, dirName);
-	
-	// If the stack is empty.
-    if (directoryTop == NULL) {
-        newdirectory->next = NULL;
-    } 
-	
-	// If the stack is not empty.
-	else {
-        newdirectory->next = directoryTop; 
-    }
-	
-    directoryTop = newdirectory;
+/**
+ * Creates a circular array for a deque.
+ *
+ * @param size		The amount of directories that fits in the array.
+ * @return array	The new array (NULL if it could not be allocated).
+ */
+static struct directoryArray *createDirectoryArray(long size) {
+
+	struct directoryArray *array = malloc(sizeof(struct directoryArray) + size*sizeof(struct directoryItem*));
+
+	// Error checks the allocation of the array.
+	if (array == NULL) {
+		return NULL;
+	}
+
+	array->size = size;
+	array->next = NULL;
+	return array;
+}
+
+/**
+ * Creates the directory deques, one for each thread.
+ *
+ * @param dequeAmount	The amount of deques.
+ * @return deques		The deques (NULL if they could not be allocated).
+ */
+struct directoryDeque *createDirectoryDeques(int dequeAmount) {
+
+	// The deques are aligned so that each of them starts on its own cache line.
+	struct directoryDeque *deques = aligned_alloc(_Alignof(struct directoryDeque), dequeAmount*sizeof(struct directoryDeque));
+
+	// Error checks the allocation of the deques.
+	if (deques == NULL) {
+		return NULL;
+	}
+
+	for (int i = 0; i < dequeAmount; i++) {
+		struct directoryArray *array = createDirectoryArray(INITIAL_DEQUE_SIZE);
+
+		// Error checks the allocation of the array (the deques that already have one are freed).
+		if (array == NULL) {
+			freeDirectoryDeques(deques, i);
+			return NULL;
+		}
+
+		atomic_init(&deques[i].top, 0);
+		atomic_init(&deques[i].bottom, 0);
+		atomic_init(&deques[i].array, array);
+		deques[i].retired = NULL;
+	}
+
+	return deques;
+}
+
+/**
+ * Frees the directory deques (the deques should be empty).
+ *
+ * @param deques		The deques.
+ * @param dequeAmount	The amount of deques.
+ */
+void freeDirectoryDeques(struct directoryDeque *deques, int dequeAmount) {
+
+	for (int i = 0; i < dequeAmount; i++) {
+
+		// Frees the current array and the arrays that it has replaced.
+		struct directoryArray *array = atomic_load(&deques[i].array);
+		array->next = deques[i].retired;
+		while (array != NULL) {
+			struct directoryArray *temp = array;
+			array = array->next;
+			free(temp);
+		}
+	}
+
+	free(deques);
 	return;
 }
 
 /**
- * Gets a directory from the directories stack. 
+ * Replaces a full array with one that is twice as big. The old array is kept
+ * until the deque is freed since a thief might still be reading from it.
  *
- * @return tempDirectoryName	The name of the directory.
+ * @param deque		The deque.
+ * @param top		The top of the deque.
+ * @param bottom	The bottom of the deque.
+ * @return newArray	The new array (NULL if it could not be allocated, the old one is kept then).
  */
-char *getDirectory(void) {
-	
-	// Temporary pointer to the current top.
-	struct directory *temp = directoryTop;
-	
-	// Gets the directory name of the current top.
-	char *tempDirectoryName = malloc(PATH_MAX*sizeof(char*));
-	strcpy(tempDirectoryName, directoryTop->directoryName);
-	
-	// Sets the new top.
-    directoryTop = directoryTop->next;
-	
-    free(temp);
-	return tempDirectoryName;
+static struct directoryArray *growDirectoryArray(struct directoryDeque *deque, long top, long bottom) {
+
+	struct directoryArray *oldArray = atomic_load_explicit(&deque->array, memory_order_relaxed);
+	struct directoryArray *newArray = createDirectoryArray(oldArray->size*2);
+	if (newArray == NULL) {
+		return NULL;
+	}
+
+	// Copies the directories that are still in the deque.
+	for (long i = top; i < bottom; i++) {
+		struct directoryItem *directory = atomic_load_explicit(&oldArray->directories[i % oldArray->size], memory_order_relaxed);
+		atomic_store_explicit(&newArray->directories[i % newArray->size], directory, memory_order_relaxed);
+	}
+
+	oldArray->next = deque->retired;
+	deque->retired = oldArray;
+	atomic_store_explicit(&deque->array, newArray, memory_order_release);
+
+	return newArray;
 }
 
 /**
- * Adds a threads wait status to the wait statuses stack.
+ * Adds a directory to the bottom of a deque. Only the thread that owns the
+ * deque may call this function.
  *
- * @param thread		The thread number.
- * @param threadStatus  The threads wait status.
+ * @param deque			The deque.
+ * @param newDirectory	The directory.
+ * @return 0 or -1		0 on success, -1 if the deque was full and could not grow.
  */
-void addWaitStatus(int thread, int threadStatus) {
-	
-	// Creates a new wait status.
-	struct waitStatus *newWaitStatus;
-	newWaitStatus = (struct waitStatus *)malloc(sizeof(struct waitStatus));
-	newWaitStatus->threadNumber = thread;
-	newWaitStatus->status = threadStatus;
-	
-	// If the stack is empty.
-	if (waitStatusTop == NULL) {
-		newWaitStatus->next = NULL;
+int addDirectory(struct directoryDeque *deque, struct directoryItem *newDirectory) {
+
+	long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	struct directoryArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+	// If the deque is full it gets a bigger array.
+	if (bottom - top > array->size - 1) {
+		array = growDirectoryArray(deque, top, bottom);
+		if (array == NULL) {
+			return -1;
+		}
 	}
-	
-	// If the stack is not empty.
-	else {
-		newWaitStatus->next = waitStatusTop;
+
+	// The directory is published to the thieves by the release store of the new bottom.
+	atomic_store_explicit(&array->directories[bottom % array->size], newDirectory, memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+	return 0;
+}
+
+/**
+ * Gets a directory from the bottom of a deque. Only the thread that owns the
+ * deque may call this function.
+ *
+ * @param deque		The deque.
+ * @return directory	The directory or NULL if the deque is empty.
+ */
+struct directoryItem *getDirectory(struct directoryDeque *deque) {
+
+	long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	struct directoryArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	// If the deque is empty.
+	if (top > bottom) {
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		return NULL;
 	}
-	
-	waitStatusTop = newWaitStatus;
-	return;
+
+	struct directoryItem *directory = atomic_load_explicit(&array->directories[bottom % array->size], memory_order_relaxed);
+
+	// If this is the last directory a thief might be trying to take it at the same time.
+	if (top == bottom) {
+		if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+			directory = NULL;
+		}
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	}
+
+	return directory;
 }
 
 /**
- * Changes a threads wait status.
+ * Tries to steal a directory from the top of a deque.
  *
- * @param thread		The thread number.
- * @param threadStatus  The threads new wait status.
+ * @param deque		The deque to steal from.
+ * @param retry		Is set to 1 if another thread took the directory first.
+ * @return directory	The directory or NULL if nothing was stolen.
  */
-void changeWaitStatus(int thread, int threadStatus) {
-	
-	// Goes through the stack.
-	struct waitStatus *temp = waitStatusTop;
-	while (temp->next != NULL) {
+static struct directoryItem *stealFromDeque(struct directoryDeque *deque, int *retry) {
+
+	long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
 
-		// Changes the wait status if the current thread is the one to be changed.
-		if (temp->threadNumber == thread) {
-			temp->status = threadStatus;
+	// If the deque is empty.
+	if (top >= bottom) {
+		return NULL;
+	}
+
+	struct directoryArray *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+	struct directoryItem *directory = atomic_load_explicit(&array->directories[top % array->size], memory_order_relaxed);
+
+	// Another thread (the owner or a thief) got the directory first.
+	if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+		*retry = 1;
+		return NULL;
+	}
+
+	return directory;
+}
+
+/**
+ * Steals a directory from one of the other threads deques. The deques are
+ * tried in order starting with the one after the thiefs own deque.
+ *
+ * @param deques		The deques.
+ * @param dequeAmount	The amount of deques.
+ * @param thief			The number of the thread that is stealing.
+ * @return directory	The directory or NULL if all deques are empty.
+ */
+struct directoryItem *stealDirectory(struct directoryDeque *deques, int dequeAmount, int thief) {
+
+	int retry = 1;
+	// Goes through the deques until all of them have been seen empty.
+	while (retry == 1) {
+		retry = 0;
+		for (int i = 1; i <= dequeAmount; i++) {
+			struct directoryItem *directory = stealFromDeque(&deques[(thief + i) % dequeAmount], &retry);
+			if (directory != NULL) {
+				return directory;
+			}
 		}
-		temp = temp->next;
 	}
-	
-	// Changes the wait status if the last thread is the one to be changed.
-	if (temp->threadNumber == thread) {
-		temp->status = threadStatus;
+
+	return NULL;
+}
+
+/**
+ * Initiates a threads item arena.
+ *
+ * @param arena	The arena.
+ */
+void createItemArena(struct itemArena *arena) {
+	arena->chunk = NULL;
+	return;
+}
+
+/**
+ * Lets go of a chunk. The chunk is freed if it was the last reference to it.
+ *
+ * @param chunk	The chunk.
+ */
+static void releaseItemChunk(struct itemChunk *chunk) {
+
+	if (atomic_fetch_sub_explicit(&chunk->items, 1, memory_order_acq_rel) == 1) {
+		free(chunk);
+	}
+	return;
+}
+
+/**
+ * Lets go of a threads item arena. Items that are still in use keep their
+ * chunks until they are released.
+ *
+ * @param arena	The arena.
+ */
+void freeItemArena(struct itemArena *arena) {
+
+	if (arena->chunk != NULL) {
+		releaseItemChunk(arena->chunk);
+		arena->chunk = NULL;
 	}
-	
 	return;
 }
 
 /**
- * Checks how many threads are waiting.
+ * Cuts memory for a directory item from the arenas current chunk, a new chunk
+ * is started if the item does not fit in the current one.
  *
- * @return waitCount	The amount of threads that are currently waiting.
+ * @param arena		The arena.
+ * @param size		The size of the item (including its name).
+ * @return item		The memory for the item (NULL if a new chunk could not be allocated).
  */
-int checkWaitStatuses(void) {
-	 
-	int waitCount = 0;
-	struct waitStatus *temp = waitStatusTop;
-	// Goes through the stack.
-	while (temp->next != NULL) {
-		
-		// Increments the wait count if the threads status is in waiting mode.
-		if (temp->status == 1) {
-			waitCount++;
+static struct directoryItem *allocateItem(struct itemArena *arena, size_t size) {
+
+	// Keeps the next item aligned.
+	size = (size + _Alignof(struct directoryItem) - 1) & ~(_Alignof(struct directoryItem) - 1);
+
+	struct itemChunk *chunk = arena->chunk;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+
+		// A name that is longer than a whole chunk gets a chunk of its own size.
+		size_t chunkSize = ITEM_CHUNK_SIZE;
+		if (size > chunkSize) {
+			chunkSize = size;
+		}
+		struct itemChunk *newChunk = malloc(sizeof(struct itemChunk) + chunkSize);
+
+		// Error checks the allocation of the chunk.
+		if (newChunk == NULL) {
+			return NULL;
 		}
-		temp = temp->next;
+
+		// The arena holds on to its current chunk so that it is not freed while items are cut from it.
+		atomic_init(&newChunk->items, 1);
+		newChunk->used = 0;
+		newChunk->size = chunkSize;
+		if (chunk != NULL) {
+			releaseItemChunk(chunk);
+		}
+		chunk = newChunk;
+		arena->chunk = chunk;
+	}
+
+	struct directoryItem *item = (struct directoryItem *)(chunk->memory + chunk->used);
+	chunk->used = chunk->used + size;
+	atomic_fetch_add_explicit(&chunk->items, 1, memory_order_relaxed);
+	item->chunk = chunk;
+
+	return item;
+}
+
+/**
+ * Creates a directory item for a directory. The item keeps a reference to its
+ * parent so that the full path can be put together for error messages. If
+ * the directory has not been opened yet the parents file descriptor is also
+ * kept open until the directory has been opened relative to it.
+ *
+ * @param arena		The arena of the thread that found the directory.
+ * @param parent	The parent directory (NULL for a directory from the program arguments).
+ * @param name		The name of the directory relative to the parent.
+ * @param fd		The file descriptor of the directory (-1 if it has not been opened).
+ * @param operand	The index of the file/directory in the program arguments that the directory belongs to.
+ * @param blocks	The amount of blocks the directory itself takes on the disk.
+ * @return item		The new directory item (NULL if there was no memory for it).
+ */
+struct directoryItem *createDirectoryItem(struct itemArena *arena, struct directoryItem *parent, char *name, int fd, int operand, blkcnt_t blocks) {
+
+	size_t nameLength = strlen(name);
+	struct directoryItem *item = allocateItem(arena, sizeof(struct directoryItem) + nameLength + 1);
+	if (item == NULL) {
+		return NULL;
+	}
+
+	if (parent != NULL) {
+		atomic_fetch_add_explicit(&parent->references, 1, memory_order_relaxed);
+
+		// The parent stays open if the directory still has to be opened relative to it.
+		if (fd == -1) {
+			atomic_fetch_add_explicit(&parent->fdReferences, 1, memory_order_relaxed);
+		}
+	}
+
+	item->parent = parent;
+	item->fd = fd;
+	item->operand = operand;
+	item->depth = 0;
+	if (parent != NULL) {
+		item->depth = parent->depth + 1;
+	}
+	atomic_init(&item->blocks, blocks);
+	atomic_init(&item->fdReferences, 1);
+	atomic_init(&item->references, 1);
+	item->entryAmount = 0;
+	memcpy(item->name, name, nameLength + 1);
+
+	return item;
+}
+
+/**
+ * Creates an item for a chunk of a directories entries, so that the entries
+ * of a very large directory can be checked by several threads. The names are
+ * copied into the item one after the other. The chunk keeps its parent open
+ * (the entries are checked relative to it) and its blocks are added to the
+ * parent once the chunk has been checked.
+ *
+ * @param arena		The arena of the thread that read the entries.
+ * @param parent	The directory that the entries are in.
+ * @param names		The names of the entries.
+ * @param amount	The amount of entries.
+ * @return item		The new chunk item (NULL if there was no memory for it).
+ */
+struct directoryItem *createEntryChunk(struct itemArena *arena, struct directoryItem *parent, char **names, int amount) {
+
+	size_t namesLength = 0;
+	for (int index = 0; index < amount; index++) {
+		namesLength = namesLength + strlen(names[index]) + 1;
 	}
-	
-	// Checks if the last status is in waiting mode.
-	if (temp->status == 1) {
-		waitCount++;
+	struct directoryItem *item = allocateItem(arena, sizeof(struct directoryItem) + namesLength);
+	if (item == NULL) {
+		return NULL;
+	}
+
+	atomic_fetch_add_explicit(&parent->references, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&parent->fdReferences, 1, memory_order_relaxed);
+
+	item->parent = parent;
+	item->fd = -1;
+	item->operand = parent->operand;
+	item->depth = parent->depth + 1;
+	atomic_init(&item->blocks, 0);
+	atomic_init(&item->fdReferences, 1);
+	atomic_init(&item->references, 1);
+	item->entryAmount = amount;
+
+	char *name = item->name;
+	for (int index = 0; index < amount; index++) {
+		size_t nameLength = strlen(names[index]) + 1;
+		memcpy(name, names[index], nameLength);
+		name = name + nameLength;
 	}
-	
-	return waitCount;
+
+	return item;
 }
 
 /**
- * Checks if the directories stack is empty.
+ * Releases a reference to a directory items file descriptor. When the last
+ * reference is gone the directory is closed, and the caller has to release
+ * the items own reference.
  *
- * @return 0 or 1	0 if the stack is empty, else 1.
+ * @param item				The directory item.
+ * @param openDirectories	The amount of open directories (lowered when the directory is closed).
+ * @return closed			1 if the directory was closed, otherwise 0.
  */
-int directoriesIsEmpty(void) {
-	
-	if (directoryTop == NULL) {
+int closeDirectoryItem(struct directoryItem *item, atomic_int *openDirectories) {
+
+	if (atomic_fetch_sub_explicit(&item->fdReferences, 1, memory_order_acq_rel) != 1) {
 		return 0;
 	}
-	
-	else {
-		return 1;
+
+	if (item->fd != -1) {
+		close(item->fd);
+		item->fd = -1;
+		atomic_fetch_sub_explicit(openDirectories, 1, memory_order_relaxed);
 	}
+	return 1;
+}
+
+/**
+ * Releases a reference to a directory item. When the last reference is gone
+ * the directory and everything in it has been searched, and the caller has
+ * to free the item (and release its reference to the parent).
+ *
+ * @param item		The directory item.
+ * @return finished	1 if it was the last reference, otherwise 0.
+ */
+int releaseDirectoryItem(struct directoryItem *item) {
+	return atomic_fetch_sub_explicit(&item->references, 1, memory_order_acq_rel) == 1;
 }
 
+/**
+ * Frees a directory item that has no references left by giving it back to
+ * its chunk.
+ *
+ * @param item	The directory item.
+ */
+void freeDirectoryItem(struct directoryItem *item) {
+	releaseItemChunk(item->chunk);
+	return;
+}
 
 /**
- * Frees the wait status stack. 
+ * Gets the name and the parent of a directory item (for getChainPath).
+ *
+ * @param link		The directory item.
+ * @param parent	Where its parent is stored.
+ * @return name		The name of the directory item.
  */
-void freeWaitStatuses(void) {
-	
-	struct waitStatus *temp;
-	// Goes through the stack and frees each wait status.
-	while (waitStatusTop != NULL) {	
-		temp = waitStatusTop;
-		waitStatusTop = waitStatusTop->next;		
-		free(temp);
+static const char *getItemName(const void *link, const void **parent) {
+
+	const struct directoryItem *item = link;
+	*parent = item->parent;
+	return item->name;
+}
+
+/**
+ * Puts together the full path of a directory item from its name and the
+ * names of its parents.
+ *
+ * @param item		The directory item.
+ * @return fullPath	The full path (has to be freed by the caller, NULL if there was no memory for it).
+ */
+char *getItemPath(struct directoryItem *item) {
+	return getChainPath(item, getItemName);
+}
+
+/**
+ * Initiates a work tracker.
+ *
+ * @param tracker				The work tracker.
+ * @param pendingDirectories	The amount of directories that are already waiting to be searched.
+ */
+void createWorkTracker(struct workTracker *tracker, long pendingDirectories) {
+	atomic_init(&tracker->pendingDirectories, pendingDirectories);
+	atomic_init(&tracker->idleThreads, 0);
+	atomic_init(&tracker->wakeups, 0);
+	atomic_init(&tracker->activeThreads, INT_MAX);
+	atomic_init(&tracker->activeChanges, 0);
+	return;
+}
+
+/**
+ * Counts a directory that has been found. Has to be called before the
+ * directory that it was found in is marked as searched, so that the count
+ * can not reach zero while there is still work left.
+ *
+ * @param tracker	The work tracker.
+ */
+void addPendingDirectory(struct workTracker *tracker) {
+	atomic_fetch_add_explicit(&tracker->pendingDirectories, 1, memory_order_relaxed);
+	return;
+}
+
+/**
+ * Bumps the event count and wakes threads that are sleeping on it.
+ *
+ * @param tracker	The work tracker.
+ * @param amount	The amount of threads to wake.
+ */
+static void wakeThreads(struct workTracker *tracker, int amount) {
+	atomic_fetch_add_explicit(&tracker->wakeups, 1, memory_order_seq_cst);
+	syscall(SYS_futex, &tracker->wakeups, FUTEX_WAKE_PRIVATE, amount, NULL, NULL, 0);
+	return;
+}
+
+/**
+ * Bumps the event count of the parked threads and wakes all of them.
+ *
+ * @param tracker	The work tracker.
+ */
+static void wakeParkedThreads(struct workTracker *tracker) {
+	atomic_fetch_add_explicit(&tracker->activeChanges, 1, memory_order_seq_cst);
+	syscall(SYS_futex, &tracker->activeChanges, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	return;
+}
+
+/**
+ * Marks a directory as searched. If it was the last directory the search is
+ * done and all idle and parked threads are woken so that they can exit.
+ *
+ * @param tracker	The work tracker.
+ */
+void finishPendingDirectory(struct workTracker *tracker) {
+	if (atomic_fetch_sub_explicit(&tracker->pendingDirectories, 1, memory_order_acq_rel) == 1) {
+		wakeThreads(tracker, INT_MAX);
+		wakeParkedThreads(tracker);
 	}
+	return;
+}
+
+/**
+ * Wakes one idle thread after a directory has been added to a deque. Nothing
+ * but an atomic load is done if no thread is idle.
+ *
+ * @param tracker	The work tracker.
+ */
+void wakeIdleThread(struct workTracker *tracker) {
+
+	// The fence pairs with the one in startIdling (either the directory or the idle thread is seen).
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&tracker->idleThreads, memory_order_relaxed) > 0) {
+		wakeThreads(tracker, 1);
+	}
+	return;
+}
+
+/**
+ * Marks the calling thread as idle. The thread has to check the deques (and
+ * if the work is done) once more after this call before it goes to sleep.
+ *
+ * @param tracker	The work tracker.
+ * @return wakeups	The event count to pass on to waitForWork.
+ */
+unsigned int startIdling(struct workTracker *tracker) {
+
+	// The event count is read first so that any wakeup after this point stops the sleep.
+	unsigned int wakeups = atomic_load_explicit(&tracker->wakeups, memory_order_seq_cst);
+	atomic_fetch_add_explicit(&tracker->idleThreads, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	return wakeups;
+}
+
+/**
+ * Sleeps until the event count changes. Returns right away if it already has.
+ *
+ * @param tracker	The work tracker.
+ * @param wakeups	The event count from startIdling.
+ */
+void waitForWork(struct workTracker *tracker, unsigned int wakeups) {
+	syscall(SYS_futex, &tracker->wakeups, FUTEX_WAIT_PRIVATE, wakeups, NULL, NULL, 0);
+	return;
+}
+
+/**
+ * Marks the calling thread as no longer idle.
+ *
+ * @param tracker	The work tracker.
+ */
+void stopIdling(struct workTracker *tracker) {
+	atomic_fetch_sub_explicit(&tracker->idleThreads, 1, memory_order_relaxed);
+	return;
+}
+
+/**
+ * Checks if all directories have been searched.
+ *
+ * @param tracker	The work tracker.
+ * @return done		1 if the search is done, otherwise 0.
+ */
+int isWorkDone(struct workTracker *tracker) {
+	return atomic_load_explicit(&tracker->pendingDirectories, memory_order_acquire) == 0;
+}
 
+/**
+ * Sets how many threads are active. The threads with a higher number park
+ * the next time they look for a directory (the directories in their deques
+ * are stolen by the active threads meanwhile), and parked threads with a
+ * lower number are woken.
+ *
+ * @param tracker		The work tracker.
+ * @param threadAmount	The amount of active threads.
+ */
+void setActiveThreads(struct workTracker *tracker, int threadAmount) {
+	atomic_store_explicit(&tracker->activeThreads, threadAmount, memory_order_relaxed);
+	wakeParkedThreads(tracker);
 	return;
-}
\ No newline at end of file
+}
+
+/**
+ * Checks if a thread is active (only an atomic load, since it is done for
+ * every directory).
+ *
+ * @param tracker		The work tracker.
+ * @param threadNumber	The number of the thread.
+ * @return active		1 if the thread is active, otherwise 0.
+ */
+int isThreadActive(struct workTracker *tracker, int threadNumber) {
+	return threadNumber < atomic_load_explicit(&tracker->activeThreads, memory_order_relaxed);
+}
+
+/**
+ * Sleeps until a parked thread is active again or until the search is done.
+ *
+ * @param tracker		The work tracker.
+ * @param threadNumber	The number of the thread.
+ */
+void waitUntilActive(struct workTracker *tracker, int threadNumber) {
+
+	// The event count is read before the checks so that a change after them stops the sleep.
+	unsigned int changes = atomic_load_explicit(&tracker->activeChanges, memory_order_seq_cst);
+	while (!isThreadActive(tracker, threadNumber) && !isWorkDone(tracker)) {
+		syscall(SYS_futex, &tracker->activeChanges, FUTEX_WAIT_PRIVATE, changes, NULL, NULL, 0);
+		changes = atomic_load_explicit(&tracker->activeChanges, memory_order_seq_cst);
+	}
+	return;
+}
+
+/**
+ * Sleeps until the search is done or until the given time has passed
+ * (whichever comes first).
+ *
+ * @param tracker		The work tracker.
+ * @param nanoseconds	The longest time to sleep.
+ * @return done			1 if the search is done, otherwise 0.
+ */
+int waitForWorkDone(struct workTracker *tracker, long long nanoseconds) {
+
+	unsigned int changes = atomic_load_explicit(&tracker->activeChanges, memory_order_seq_cst);
+	if (isWorkDone(tracker)) {
+		return 1;
+	}
+
+	struct timespec timeout = {nanoseconds/1000000000LL, nanoseconds%1000000000LL};
+	syscall(SYS_futex, &tracker->activeChanges, FUTEX_WAIT_PRIVATE, changes, &timeout, NULL, 0);
+	return isWorkDone(tracker);
+}
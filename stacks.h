@@ -1,33 +1,186 @@
 /**
- * This is the header file for the two stacks (directories and wait statuses),
+ * This is the header file for the directory deques and the work tracker,
  * that the program uses.
  *
  * @file stacks.h
  * @author Jakob Mukka
  * @date 2022-11-19
  */
-  
+
+#ifndef STACKS_H
+#define STACKS_H
+
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <limits.h>
 #include <linux/limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+/**
+ * A directory that is waiting to be searched. The directory is usually opened
+ * by the thread that found it and handed over open. If too many directories
+ * are open it is instead opened relative to its parents file descriptor by
+ * the thread that searches it. Only the name of the directory is stored, the
+ * full path is put together from the names of the parents when an error has
+ * to be printed.
+ */
+struct directoryItem {
+	
+	// The parent directory (NULL for a directory from the program arguments).
+	struct directoryItem *parent;
+
+	// The chunk of memory that the item was cut from.
+	struct itemChunk *chunk;
+
+	// The directories file descriptor (-1 until the directory has been opened).
+	int fd;
+
+	// The index of the file/directory in the program arguments that the directory belongs to.
+	int operand;
+
+	// How many levels below the file/directory in the program arguments the directory is.
+	int depth;
+
+	// The blocks of the directory and of everything in it that has been searched so far.
+	_Atomic(blkcnt_t) blocks;
+
+	// The search of the directory and the subdirectories that have to be opened relative to it.
+	atomic_int fdReferences;
+
+	// The item itself and the items of its subdirectories (the whole subtree is searched when it reaches zero).
+	atomic_int references;
+
+	// The amount of entries if the item is a chunk of its parents entries that another thread checks (0 for a directory).
+	int entryAmount;
+
+	// The name of the directory relative to the parent (or the names of the entries of a chunk, one after the other).
+	char name[];
+};
+
+/**
+ * A threads arena for directory items. The items are cut from the current
+ * chunk, and a chunk is freed once all of its items have been released (by
+ * any thread) and the arena has moved on to a new chunk.
+ */
+struct itemArena {
+	struct itemChunk *chunk;
+};
+
+/**
+ * A work-stealing deque of directories (Chase-Lev). Each thread owns one deque,
+ * the owner adds and gets directories at the bottom without any lock and the
+ * other threads steal from the top when they run out of work.
+ */
+struct directoryDeque {
+
+	// The thieves end and the owners end are kept on different cache lines.
+	_Alignas(64) atomic_long top;
+	_Alignas(64) atomic_long bottom;
+	_Atomic(struct directoryArray *) array;
+
+	// Arrays that have been replaced by a bigger one (freed with the deque).
+	struct directoryArray *retired;
+};
+
+/**
+ * Keeps track of how much work is left and lets threads without work sleep.
+ * Every directory is counted from the moment it is found until it has been
+ * searched, so the search is done when the count reaches zero. Idle threads
+ * sleep on a futex (an event count) that is bumped whenever there is a
+ * reason for them to look for work again.
+ */
+struct workTracker {
+
+	// The directories that have been found but not fully searched.
+	_Alignas(64) atomic_long pendingDirectories;
+
+	// The amount of threads that are idle and the event count that they sleep on.
+	_Alignas(64) atomic_int idleThreads;
+	atomic_uint wakeups;
+
+	// The threads with a lower number than this are active, the rest are parked (and sleep on their own event count).
+	_Alignas(64) atomic_int activeThreads;
+	atomic_uint activeChanges;
+};
+
+// Creates the directory deques (one for each thread).
+struct directoryDeque *createDirectoryDeques(int dequeAmount);
+
+// Frees the directory deques.
+void freeDirectoryDeques(struct directoryDeque *deques, int dequeAmount);
+
+// Adds a directory to the bottom of a deque (only called by the owner).
+int addDirectory(struct directoryDeque *deque, struct directoryItem *value);
+
+// Gets a directory from the bottom of a deque (only called by the owner).
+struct directoryItem *getDirectory(struct directoryDeque *deque);
+
+// Steals a directory from the top of one of the other threads deques.
+struct directoryItem *stealDirectory(struct directoryDeque *deques, int dequeAmount, int thief);
+
+// Initiates a threads item arena.
+void createItemArena(struct itemArena *arena);
+
+// Lets go of a threads item arena (the chunks are freed once their items are released).
+void freeItemArena(struct itemArena *arena);
+
+// Creates a directory item for a directory.
+struct directoryItem *createDirectoryItem(struct itemArena *arena, struct directoryItem *parent, char *name, int fd, int operand, blkcnt_t blocks);
+
+// Creates an item for a chunk of a directories entries (so that they can be checked by another thread).
+struct directoryItem *createEntryChunk(struct itemArena *arena, struct directoryItem *parent, char **names, int amount);
+
+// Releases a reference to a directory items file descriptor (returns 1 if it was the last one).
+int closeDirectoryItem(struct directoryItem *item, atomic_int *openDirectories);
+
+// Releases a reference to a directory item (returns 1 if it was the last one).
+int releaseDirectoryItem(struct directoryItem *item);
+
+// Frees a directory item that has no references left.
+void freeDirectoryItem(struct directoryItem *item);
+
+// Puts together the full path of a directory item.
+char *getItemPath(struct directoryItem *item);
+
+// Initiates a work tracker.
+void createWorkTracker(struct workTracker *tracker, long pendingDirectories);
+
+// Counts a directory that has been found but not searched yet.
+void addPendingDirectory(struct workTracker *tracker);
+
+// Marks a directory as searched and wakes all threads if it was the last one.
+void finishPendingDirectory(struct workTracker *tracker);
+
+// Wakes one idle thread if there is one (called after a directory has been added to a deque).
+void wakeIdleThread(struct workTracker *tracker);
+
+// Marks the calling thread as idle and returns the current wakeup count.
+unsigned int startIdling(struct workTracker *tracker);
+
+// Sleeps until the wakeup count changes from the given one (unless it already has).
+void waitForWork(struct workTracker *tracker, unsigned int wakeups);
 
-// Adds a directory to the stack.
-void addDirectory(char *value);
+// Marks the calling thread as no longer idle.
+void stopIdling(struct workTracker *tracker);
 
-// Gets a directory from the stack.
-char *getDirectory(void);
+// Checks if all directories have been searched.
+int isWorkDone(struct workTracker *tracker);
 
-// Adds a wait status to a thread.
-void addWaitStatus(int thread, int stat);
+// Sets how many threads are active (the others park once they are done with their directory).
+void setActiveThreads(struct workTracker *tracker, int threadAmount);
 
-// Changes a threads wait status.
-void changeWaitStatus(int thread, int threadStatus);
+// Checks if a thread is active.
+int isThreadActive(struct workTracker *tracker, int threadNumber);
 
-// Checks all the threads wait statuses.
-int checkWaitStatuses(void);
+// Sleeps until a parked thread is active again or the search is done.
+void waitUntilActive(struct workTracker *tracker, int threadNumber);
 
-// Checks if the directories stack is empty
-int directoriesIsEmpty(void);
+// Sleeps until the search is done or the given time has passed (returns 1 if the search is done).
+int waitForWorkDone(struct workTracker *tracker, long long nanoseconds);
 
-// Frees the wait statuses.
-void freeWaitStatuses(void);
\ No newline at end of file
+#endif
@@ -0,0 +1,210 @@
+/**
+ * This is the implementation file for the search statistics. The counters
+ * are plain integers in each threads own struct, and the clock is only read
+ * when the statistics have been asked for, so a search without --stats does
+ * not pay for them.
+ *
+ * @file stats.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/**
+ * Gets the time in nanoseconds from a clock that never jumps.
+ *
+ * @return nanoseconds	The time.
+ */
+long long getStatisticsTime(void) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Adds the latency of one stat call to the histogram (the bucket is the
+ * position of the highest bit that is set).
+ *
+ * @param statistics	The threads statistics.
+ * @param nanoseconds	How long the call took.
+ */
+void addStatLatency(struct scanStatistics *statistics, long long nanoseconds) {
+
+	int bucket = 0;
+	if (nanoseconds > 1) {
+		bucket = 63 - __builtin_clzll((unsigned long long)nanoseconds);
+	}
+	if (bucket >= LATENCY_BUCKETS) {
+		bucket = LATENCY_BUCKETS - 1;
+	}
+	statistics->latencyBuckets[bucket]++;
+}
+
+/**
+ * Adds the counters of one thread to the total.
+ *
+ * @param total	The total.
+ * @param part	The counters of the thread.
+ */
+void mergeStatistics(struct scanStatistics *total, const struct scanStatistics *part) {
+
+	total->directories = total->directories + part->directories;
+	total->entries = total->entries + part->entries;
+	total->statCalls = total->statCalls + part->statCalls;
+	total->openCalls = total->openCalls + part->openCalls;
+	total->readCalls = total->readCalls + part->readCalls;
+	total->inlineDirectories = total->inlineDirectories + part->inlineDirectories;
+	total->prunedEntries = total->prunedEntries + part->prunedEntries;
+	total->linkedEntries = total->linkedEntries + part->linkedEntries;
+	total->readNanoseconds = total->readNanoseconds + part->readNanoseconds;
+	total->statNanoseconds = total->statNanoseconds + part->statNanoseconds;
+	total->idleNanoseconds = total->idleNanoseconds + part->idleNanoseconds;
+	for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		total->latencyBuckets[bucket] = total->latencyBuckets[bucket] + part->latencyBuckets[bucket];
+	}
+}
+
+/**
+ * Writes a latency with a unit that suits it (for the text report).
+ *
+ * @param buffer		The buffer that the latency is written to.
+ * @param size			The size of the buffer.
+ * @param nanoseconds	The latency.
+ */
+static void formatLatency(char *buffer, size_t size, long long nanoseconds) {
+
+	if (nanoseconds < 1000) {
+		snprintf(buffer, size, "%lld ns", nanoseconds);
+	}
+	else if (nanoseconds < 1000000) {
+		snprintf(buffer, size, "%.1f us", nanoseconds/1e3);
+	}
+	else if (nanoseconds < 1000000000) {
+		snprintf(buffer, size, "%.1f ms", nanoseconds/1e6);
+	}
+	else {
+		snprintf(buffer, size, "%.1f s", nanoseconds/1e9);
+	}
+}
+
+/**
+ * Prints the statistics as text.
+ *
+ * @param stream		The stream to print to.
+ * @param total			The merged statistics.
+ * @param threads		The statistics of each thread.
+ * @param threadAmount	The amount of threads.
+ * @param nanoseconds	How long the whole search took.
+ */
+static void printStatisticsText(FILE *stream, const struct scanStatistics *total, const struct scanStatistics *threads, int threadAmount, long long nanoseconds) {
+
+	fprintf(stream, "mdu statistics (%d thread%s, %.3f s)\n", threadAmount, threadAmount == 1 ? "" : "s", nanoseconds/1e9);
+	fprintf(stream, "  directories      %lld\n", total->directories);
+	fprintf(stream, "  searched in line %lld\n", total->inlineDirectories);
+	fprintf(stream, "  left out         %lld\n", total->prunedEntries);
+	fprintf(stream, "  repeated links   %lld\n", total->linkedEntries);
+	fprintf(stream, "  entries          %lld\n", total->entries);
+	fprintf(stream, "  stat calls       %lld (%.3f s)\n", total->statCalls, total->statNanoseconds/1e9);
+	fprintf(stream, "  open calls       %lld\n", total->openCalls);
+	fprintf(stream, "  directory reads  %lld (%.3f s)\n", total->readCalls, total->readNanoseconds/1e9);
+	fprintf(stream, "  idle             %.3f s\n", total->idleNanoseconds/1e9);
+
+	// The histogram only shows the buckets between the first and the last one that have calls.
+	int first = 0;
+	int last = LATENCY_BUCKETS - 1;
+	while (first < LATENCY_BUCKETS && total->latencyBuckets[first] == 0) {
+		first++;
+	}
+	while (last >= 0 && total->latencyBuckets[last] == 0) {
+		last--;
+	}
+	long long largest = 1;
+	for (int bucket = first; bucket <= last; bucket++) {
+		if (total->latencyBuckets[bucket] > largest) {
+			largest = total->latencyBuckets[bucket];
+		}
+	}
+	if (first <= last) {
+		fprintf(stream, "  stat latency\n");
+	}
+	for (int bucket = first; bucket <= last; bucket++) {
+		char from[32];
+		char to[32];
+		formatLatency(from, sizeof(from), 1LL << bucket);
+		formatLatency(to, sizeof(to), 1LL << (bucket + 1));
+		int barLength = (int)(40*total->latencyBuckets[bucket]/largest);
+		fprintf(stream, "    %9s - %-9s %10lld%s%.*s\n", from, to, total->latencyBuckets[bucket], barLength > 0 ? " " : "", barLength, "########################################");
+	}
+
+	// Shows how evenly the work was spread over the threads.
+	if (threadAmount > 1) {
+		fprintf(stream, "  per thread       directories     entries      idle\n");
+		for (int index = 0; index < threadAmount; index++) {
+			fprintf(stream, "    %-14d %11lld %11lld %8.3f s\n", index, threads[index].directories, threads[index].entries, threads[index].idleNanoseconds/1e9);
+		}
+	}
+}
+
+/**
+ * Prints the statistics as JSON (on one line).
+ *
+ * @param stream		The stream to print to.
+ * @param total			The merged statistics.
+ * @param threads		The statistics of each thread.
+ * @param threadAmount	The amount of threads.
+ * @param nanoseconds	How long the whole search took.
+ */
+static void printStatisticsJson(FILE *stream, const struct scanStatistics *total, const struct scanStatistics *threads, int threadAmount, long long nanoseconds) {
+
+	fprintf(stream, "{\"threads\":%d,\"seconds\":%.6f,\"directories\":%lld,\"entries\":%lld,\"statCalls\":%lld,\"openCalls\":%lld,\"readCalls\":%lld,\"inlineDirectories\":%lld,\"prunedEntries\":%lld,\"linkedEntries\":%lld,", threadAmount, nanoseconds/1e9, total->directories, total->entries, total->statCalls, total->openCalls, total->readCalls, total->inlineDirectories, total->prunedEntries, total->linkedEntries);
+	fprintf(stream, "\"readSeconds\":%.6f,\"statSeconds\":%.6f,\"idleSeconds\":%.6f,", total->readNanoseconds/1e9, total->statNanoseconds/1e9, total->idleNanoseconds/1e9);
+
+	fprintf(stream, "\"statLatency\":[");
+	int printed = 0;
+	for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+		if (total->latencyBuckets[bucket] == 0) {
+			continue;
+		}
+		fprintf(stream, "%s{\"fromNanoseconds\":%lld,\"toNanoseconds\":%lld,\"calls\":%lld}", printed ? "," : "", 1LL << bucket, 1LL << (bucket + 1), total->latencyBuckets[bucket]);
+		printed = 1;
+	}
+
+	fprintf(stream, "],\"perThread\":[");
+	for (int index = 0; index < threadAmount; index++) {
+		fprintf(stream, "%s{\"directories\":%lld,\"entries\":%lld,\"statCalls\":%lld,\"openCalls\":%lld,\"idleSeconds\":%.6f}", index > 0 ? "," : "", threads[index].directories, threads[index].entries, threads[index].statCalls, threads[index].openCalls, threads[index].idleNanoseconds/1e9);
+	}
+	fprintf(stream, "]}\n");
+}
+
+/**
+ * Merges the statistics of the threads and prints them together with a
+ * summary of each thread.
+ *
+ * @param stream		The stream to print to.
+ * @param format		STATISTICS_TEXT or STATISTICS_JSON.
+ * @param threads		The statistics of each thread.
+ * @param threadAmount	The amount of threads.
+ * @param nanoseconds	How long the whole search took.
+ */
+void printStatistics(FILE *stream, int format, const struct scanStatistics *threads, int threadAmount, long long nanoseconds) {
+
+	struct scanStatistics total;
+	memset(&total, 0, sizeof(total));
+	for (int index = 0; index < threadAmount; index++) {
+		mergeStatistics(&total, &threads[index]);
+	}
+
+	if (format == STATISTICS_JSON) {
+		printStatisticsJson(stream, &total, threads, threadAmount, nanoseconds);
+	}
+	else {
+		printStatisticsText(stream, &total, threads, threadAmount, nanoseconds);
+	}
+	fflush(stream);
+}
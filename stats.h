@@ -0,0 +1,66 @@
+/**
+ * This is the header file for the search statistics, which counts what each
+ * thread does during a search (and how long it takes) so that a slow search
+ * can be explained.
+ *
+ * @file stats.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// The statistics are printed as text.
+#define STATISTICS_TEXT 1
+
+// The statistics are printed as JSON.
+#define STATISTICS_JSON 2
+
+// The amount of buckets in the latency histogram (bucket i has the calls that took 2^i to 2^(i+1) nanoseconds).
+#define LATENCY_BUCKETS 32
+
+/**
+ * The counters of one thread. Each thread only writes to its own counters
+ * (so no atomics are needed), and they are merged once the search is done.
+ */
+struct scanStatistics {
+	long long directories;
+	long long entries;
+	long long statCalls;
+	long long openCalls;
+	long long readCalls;
+
+	// The directories that were searched in line, since too many directories were waiting already.
+	long long inlineDirectories;
+
+	// The entries that were left out by an exclude pattern (before they were checked) or for being on another file system.
+	long long prunedEntries;
+
+	// The links to files that had already been counted through another link.
+	long long linkedEntries;
+
+	// The time spent reading directories, checking files and waiting for work.
+	long long readNanoseconds;
+	long long statNanoseconds;
+	long long idleNanoseconds;
+
+	// How long the stat calls took.
+	long long latencyBuckets[LATENCY_BUCKETS];
+};
+
+// Gets the time in nanoseconds (from a clock that never jumps).
+long long getStatisticsTime(void);
+
+// Adds the latency of one stat call to the histogram.
+void addStatLatency(struct scanStatistics *statistics, long long nanoseconds);
+
+// Adds the counters of one thread to the total.
+void mergeStatistics(struct scanStatistics *total, const struct scanStatistics *part);
+
+// Prints the merged statistics and a summary of each thread.
+void printStatistics(FILE *stream, int format, const struct scanStatistics *threads, int threadAmount, long long nanoseconds);
+
+#endif
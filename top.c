@@ -0,0 +1,162 @@
+/**
+ * This is the implementation file for the top lists. A list is a binary
+ * min-heap of at most its size, so a file/directory that is smaller than the
+ * smallest one in a full list is turned away with one comparison, and only
+ * the ones that make it in have their path put together.
+ *
+ * @file top.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "top.h"
+
+/**
+ * Creates a top list.
+ *
+ * @param list		The list.
+ * @param size		The amount of files/directories that the list keeps.
+ * @return 0 or -1	0 on success, -1 if there was no memory for the list.
+ */
+int createTopList(struct topList *list, int size) {
+
+	list->entries = malloc(size*sizeof(struct mduTopEntry));
+	list->amount = 0;
+	list->size = size;
+	if (list->entries == NULL) {
+		list->size = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Frees a top list and the paths in it.
+ *
+ * @param list	The list.
+ */
+void freeTopList(struct topList *list) {
+
+	for (int index = 0; index < list->amount; index++) {
+		free(list->entries[index].path);
+	}
+	free(list->entries);
+	list->entries = NULL;
+	list->amount = 0;
+}
+
+/**
+ * Checks if a file/directory would make it into the list, before its path is
+ * put together.
+ *
+ * @param list			The list.
+ * @param blockAmount	The block amount of the file/directory.
+ * @return candidate	1 if it would make it into the list, otherwise 0.
+ */
+int isTopCandidate(const struct topList *list, blkcnt_t blockAmount) {
+	return list->amount < list->size || (list->size > 0 && blockAmount > list->entries[0].blocks);
+}
+
+/**
+ * Moves an entry down the heap until both of its children are at least as
+ * large as it.
+ *
+ * @param list	The list.
+ * @param index	The index of the entry.
+ */
+static void siftDown(struct topList *list, int index) {
+
+	struct mduTopEntry entry = list->entries[index];
+	while (2*index + 1 < list->amount) {
+		int child = 2*index + 1;
+		if (child + 1 < list->amount && list->entries[child + 1].blocks < list->entries[child].blocks) {
+			child++;
+		}
+		if (list->entries[child].blocks >= entry.blocks) {
+			break;
+		}
+		list->entries[index] = list->entries[child];
+		index = child;
+	}
+	list->entries[index] = entry;
+}
+
+/**
+ * Adds a file/directory to the list. If the list is full the smallest one is
+ * pushed out (and its path freed), and if the new one is not larger than it
+ * the new one is freed instead.
+ *
+ * @param list			The list.
+ * @param path			The path of the file/directory (taken over by the list).
+ * @param blockAmount	The block amount of the file/directory.
+ */
+void addTopEntry(struct topList *list, char *path, blkcnt_t blockAmount) {
+
+	if (!isTopCandidate(list, blockAmount)) {
+		free(path);
+		return;
+	}
+
+	// A full list replaces its smallest entry and moves the new one down to its place.
+	if (list->amount == list->size) {
+		free(list->entries[0].path);
+		list->entries[0].path = path;
+		list->entries[0].blocks = blockAmount;
+		siftDown(list, 0);
+		return;
+	}
+
+	// Otherwise the new entry is added at the end and moved up for as long as its parent is larger.
+	int index = list->amount;
+	list->amount++;
+	while (index > 0 && list->entries[(index - 1)/2].blocks > blockAmount) {
+		list->entries[index] = list->entries[(index - 1)/2];
+		index = (index - 1)/2;
+	}
+	list->entries[index].path = path;
+	list->entries[index].blocks = blockAmount;
+}
+
+/**
+ * Moves the entries of one list into another (the part is left empty).
+ *
+ * @param total	The list that the entries are moved into.
+ * @param part	The list that the entries are taken from.
+ */
+void mergeTopLists(struct topList *total, struct topList *part) {
+
+	for (int index = 0; index < part->amount; index++) {
+		addTopEntry(total, part->entries[index].path, part->entries[index].blocks);
+	}
+	part->amount = 0;
+}
+
+/**
+ * Compares two entries so that the larger one comes first (and the paths
+ * decide between equal ones, so the order is always the same).
+ *
+ * @param first		The first entry.
+ * @param second	The second entry.
+ * @return order	Below 0 if the first one comes first, above 0 if the second one does.
+ */
+static int compareTopEntries(const void *first, const void *second) {
+
+	const struct mduTopEntry *firstEntry = first;
+	const struct mduTopEntry *secondEntry = second;
+	if (firstEntry->blocks != secondEntry->blocks) {
+		return firstEntry->blocks > secondEntry->blocks ? -1 : 1;
+	}
+	return strcmp(firstEntry->path, secondEntry->path);
+}
+
+/**
+ * Sorts a list from the largest file/directory to the smallest (it is no
+ * longer a heap after that, so nothing can be added to it).
+ *
+ * @param list	The list.
+ */
+void sortTopList(struct topList *list) {
+	qsort(list->entries, list->amount, sizeof(struct mduTopEntry), compareTopEntries);
+}
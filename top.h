@@ -0,0 +1,46 @@
+/**
+ * This is the header file for the top lists, which keep the largest files or
+ * directories that a thread has seen in a bounded min-heap, so that a search
+ * can report them without keeping every path.
+ *
+ * @file top.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef TOP_H
+#define TOP_H
+
+#include <sys/types.h>
+#include "libmdu.h"
+
+/**
+ * The largest files/directories seen so far, as a min-heap on the block
+ * amount (the smallest of them is first, so a new one only has to be
+ * compared with it). Each thread has its own lists, so no locks are needed.
+ */
+struct topList {
+	struct mduTopEntry *entries;
+	int amount;
+	int size;
+};
+
+// Creates a top list for a given amount of files/directories.
+int createTopList(struct topList *list, int size);
+
+// Frees a top list and the paths in it.
+void freeTopList(struct topList *list);
+
+// Checks if a file/directory with a block amount would make it into the list.
+int isTopCandidate(const struct topList *list, blkcnt_t blockAmount);
+
+// Adds a file/directory to the list (the smallest one is pushed out if the list is full).
+void addTopEntry(struct topList *list, char *path, blkcnt_t blockAmount);
+
+// Moves the entries of one list into another.
+void mergeTopLists(struct topList *total, struct topList *part);
+
+// Sorts a list from the largest file/directory to the smallest.
+void sortTopList(struct topList *list);
+
+#endif
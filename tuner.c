@@ -0,0 +1,215 @@
+/**
+ * This is the implementation file for the thread tuner. All the threads are
+ * created up front, but only some of them are active and the rest are parked.
+ * The tuner wakes up every tenth of a second, works out how many entries per
+ * second the active threads got through and moves the amount of active
+ * threads the way that made the search faster (hill climbing). If a move made
+ * no difference but the time per entry went up, the storage is already busy
+ * and the extra threads only wait, so the amount is moved back down.
+ *
+ * @file tuner.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tuner.h"
+#include "stats.h"
+
+// How many nanoseconds there are between the samples.
+#define TUNER_INTERVAL 100000000LL
+
+// The least amount of entries that a sample needs (otherwise the sample continues for another interval).
+#define TUNER_MINIMUM_ENTRIES 1000
+
+// How much the entries per second have to change for a move to count as better or worse.
+#define RATE_THRESHOLD 0.05
+
+// How much the time per entry has to go up for the storage to count as busy.
+#define LATENCY_THRESHOLD 0.15
+
+// The amount of samples without a move after which the tuner tries a move anyway.
+#define HOLD_LIMIT 5
+
+/**
+ * Creates a thread tuner and sets the first amount of active threads (a
+ * couple of threads, so that the search starts small).
+ *
+ * @param tuner		The thread tuner.
+ * @param work		The work tracker of the search.
+ * @param minimum	The least amount of active threads.
+ * @param maximum	The largest amount of active threads (and the amount of threads that are created).
+ * @return 0 or -1	0 on success, -1 if there was no memory for the counters (all threads stay active then).
+ */
+int createThreadTuner(struct threadTuner *tuner, struct workTracker *work, int minimum, int maximum) {
+
+	tuner->counters = aligned_alloc(64, maximum*sizeof(struct tunerCounters));
+
+	// Error checks the allocation of the counters.
+	if (tuner->counters == NULL) {
+		return -1;
+	}
+
+	for (int index = 0; index < maximum; index++) {
+		atomic_init(&tuner->counters[index].entries, 0);
+		atomic_init(&tuner->counters[index].busyNanoseconds, 0);
+	}
+	tuner->work = work;
+	tuner->counterAmount = maximum;
+	tuner->minimum = minimum;
+	tuner->maximum = maximum;
+	tuner->active = minimum > 2 ? minimum : 2;
+	if (tuner->active > maximum) {
+		tuner->active = maximum;
+	}
+	tuner->direction = 1;
+	tuner->step = 1;
+	tuner->holds = 0;
+	tuner->lastRate = -1;
+	tuner->lastLatency = 0;
+	tuner->lastEntries = 0;
+	tuner->lastBusyNanoseconds = 0;
+	tuner->lastTime = getStatisticsTime();
+
+	setActiveThreads(work, tuner->active);
+	return 0;
+}
+
+/**
+ * Frees a thread tuner.
+ *
+ * @param tuner	The thread tuner.
+ */
+void freeThreadTuner(struct threadTuner *tuner) {
+	free(tuner->counters);
+}
+
+/**
+ * Adds a searched directory to a threads counters (the same way as
+ * addProgress, since only the thread itself writes to them).
+ *
+ * @param counters		The threads counters (nothing is done if it is NULL).
+ * @param entries		The amount of entries in the directory.
+ * @param nanoseconds	How long the directory took.
+ */
+void addTunerSample(struct tunerCounters *counters, long long entries, long long nanoseconds) {
+
+	if (counters == NULL) {
+		return;
+	}
+
+	atomic_store_explicit(&counters->entries, atomic_load_explicit(&counters->entries, memory_order_relaxed) + entries, memory_order_relaxed);
+	atomic_store_explicit(&counters->busyNanoseconds, atomic_load_explicit(&counters->busyNanoseconds, memory_order_relaxed) + nanoseconds, memory_order_relaxed);
+}
+
+/**
+ * Picks the next amount of active threads from one sample.
+ *
+ * @param tuner		The thread tuner.
+ * @param rate		The entries per second since the last sample.
+ * @param latency	The nanoseconds per entry since the last sample.
+ * @return active	The next amount of active threads.
+ */
+static int tuneThreads(struct threadTuner *tuner, double rate, double latency) {
+
+	// The first sample has nothing to compare with, so the amount just goes up.
+	if (tuner->lastRate < 0) {
+		tuner->direction = 1;
+		tuner->step = 1;
+	}
+
+	// The last move made the search faster, so the next one goes the same way (and further).
+	else if (rate > tuner->lastRate*(1 + RATE_THRESHOLD)) {
+		tuner->holds = 0;
+		if (tuner->step*4 <= tuner->maximum) {
+			tuner->step = tuner->step*2;
+		}
+	}
+
+	// The last move made the search slower, so the amount goes back the other way.
+	else if (rate < tuner->lastRate*(1 - RATE_THRESHOLD)) {
+		tuner->holds = 0;
+		tuner->direction = -tuner->direction;
+		tuner->step = 1;
+	}
+
+	// More threads made no difference but each entry took longer, so the storage is already busy.
+	else if (tuner->direction == 1 && latency > tuner->lastLatency*(1 + LATENCY_THRESHOLD)) {
+		tuner->holds = 0;
+		tuner->direction = -1;
+		tuner->step = 1;
+	}
+
+	// Nothing changed, so the amount stays the same for a while before the tuner tries the other way.
+	else {
+		tuner->holds++;
+		if (tuner->holds < HOLD_LIMIT) {
+			return tuner->active;
+		}
+		tuner->holds = 0;
+		tuner->direction = -tuner->direction;
+		tuner->step = 1;
+	}
+
+	// More threads do not help if some of the active ones have nothing to do.
+	if (tuner->direction == 1 && atomic_load_explicit(&tuner->work->idleThreads, memory_order_relaxed) > 0) {
+		return tuner->active;
+	}
+
+	int active = tuner->active + tuner->direction*tuner->step;
+	if (active > tuner->maximum) {
+		active = tuner->maximum;
+		tuner->direction = -1;
+		tuner->step = 1;
+	}
+	if (active < tuner->minimum) {
+		active = tuner->minimum;
+		tuner->direction = 1;
+		tuner->step = 1;
+	}
+
+	return active;
+}
+
+/**
+ * Tunes the amount of active threads until the search is done (called by the
+ * thread that waits for the searching threads).
+ *
+ * @param tuner	The thread tuner.
+ */
+void runThreadTuner(struct threadTuner *tuner) {
+
+	while (!waitForWorkDone(tuner->work, TUNER_INTERVAL)) {
+
+		long long entries = 0;
+		long long busyNanoseconds = 0;
+		for (int index = 0; index < tuner->counterAmount; index++) {
+			entries = entries + atomic_load_explicit(&tuner->counters[index].entries, memory_order_relaxed);
+			busyNanoseconds = busyNanoseconds + atomic_load_explicit(&tuner->counters[index].busyNanoseconds, memory_order_relaxed);
+		}
+
+		// A sample with too few entries says nothing, so it continues for another interval.
+		if (entries - tuner->lastEntries < TUNER_MINIMUM_ENTRIES) {
+			continue;
+		}
+
+		long long now = getStatisticsTime();
+		double rate = (entries - tuner->lastEntries)/((now - tuner->lastTime)/1e9);
+		double latency = (double)(busyNanoseconds - tuner->lastBusyNanoseconds)/(entries - tuner->lastEntries);
+
+		int active = tuneThreads(tuner, rate, latency);
+		if (active != tuner->active) {
+			tuner->active = active;
+			setActiveThreads(tuner->work, active);
+		}
+
+		tuner->lastRate = rate;
+		tuner->lastLatency = latency;
+		tuner->lastEntries = entries;
+		tuner->lastBusyNanoseconds = busyNanoseconds;
+		tuner->lastTime = now;
+	}
+}
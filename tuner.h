@@ -0,0 +1,67 @@
+/**
+ * This is the header file for the thread tuner, which picks the amount of
+ * searching threads (for -j auto) from how fast the search goes with the
+ * threads that are active.
+ *
+ * @file tuner.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <stdatomic.h>
+#include "stacks.h"
+
+/**
+ * What one thread has searched so far. Only the thread itself writes to its
+ * counters (once per directory, with relaxed atomics) and each thread has its
+ * own cache line.
+ */
+struct tunerCounters {
+	_Alignas(64) atomic_llong entries;
+
+	// The time the thread has spent searching directories (the time per entry is the latency of the storage).
+	atomic_llong busyNanoseconds;
+};
+
+// The state of the hill climbing.
+struct threadTuner {
+	struct workTracker *work;
+	struct tunerCounters *counters;
+	int counterAmount;
+
+	// The bounds for the amount of active threads and the current amount.
+	int minimum;
+	int maximum;
+	int active;
+
+	// Which way the amount is moving (1 or -1) and by how much.
+	int direction;
+	int step;
+
+	// The samples that the amount has stayed the same for.
+	int holds;
+
+	// The last sample.
+	double lastRate;
+	double lastLatency;
+	long long lastEntries;
+	long long lastBusyNanoseconds;
+	long long lastTime;
+};
+
+// Creates a thread tuner (with one set of counters for each of the maximum amount of threads) and sets the first amount of active threads.
+int createThreadTuner(struct threadTuner *tuner, struct workTracker *work, int minimum, int maximum);
+
+// Frees a thread tuner.
+void freeThreadTuner(struct threadTuner *tuner);
+
+// Adds a searched directory to a threads counters.
+void addTunerSample(struct tunerCounters *counters, long long entries, long long nanoseconds);
+
+// Tunes the amount of active threads until the search is done.
+void runThreadTuner(struct threadTuner *tuner);
+
+#endif
@@ -0,0 +1,316 @@
+/**
+ * This is the implementation file for the io_uring stat engine. The statx
+ * calls for a batch of files are put on the submission queue of a ring and
+ * the kernel runs them in the background, so a single thread can have a few
+ * hundred of them in flight instead of waiting for one at a time. If the
+ * kernel has no io_uring (or it has been disabled) the batch is checked with
+ * one statx call at a time instead.
+ *
+ * @file uring.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+/**
+ * Checks if the kernel can do statx calls through io_uring.
+ *
+ * @param ringFd	The file descriptor of the ring.
+ * @return 0 or -1	0 if statx is supported, else -1.
+ */
+static int checkStatxSupport(int ringFd) {
+
+	size_t probeSize = sizeof(struct io_uring_probe) + 256*sizeof(struct io_uring_probe_op);
+	struct io_uring_probe *probe = calloc(1, probeSize);
+	if (probe == NULL) {
+		return -1;
+	}
+
+	int supported = -1;
+	if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+		if (probe->last_op >= IORING_OP_STATX && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED)) {
+			supported = 0;
+		}
+	}
+
+	free(probe);
+	return supported;
+}
+
+/**
+ * Creates a stat ring and maps its queues.
+ *
+ * @param ring		The ring to set up.
+ * @return 0 or -1	0 on success, -1 if io_uring can not be used.
+ */
+int createStatRing(struct statRing *ring) {
+
+	memset(ring, 0, sizeof(struct statRing));
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	ring->fd = syscall(__NR_io_uring_setup, STAT_RING_SIZE, &params);
+
+	// The kernel has no io_uring or it has been disabled.
+	if (ring->fd == -1) {
+		return -1;
+	}
+
+	if (checkStatxSupport(ring->fd) == -1) {
+		close(ring->fd);
+		return -1;
+	}
+
+	ring->entries = params.sq_entries;
+	ring->submissionSize = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+	ring->completionSize = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+
+	// Newer kernels map both queues with one mmap.
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->completionSize > ring->submissionSize) {
+			ring->submissionSize = ring->completionSize;
+		}
+		ring->completionSize = ring->submissionSize;
+	}
+
+	ring->submissionPointer = mmap(NULL, ring->submissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->completionPointer = ring->submissionPointer;
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) && ring->submissionPointer != MAP_FAILED) {
+		ring->completionPointer = mmap(NULL, ring->completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	}
+	ring->submissionEntries = mmap(NULL, params.sq_entries*sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	ring->results = malloc(STAT_RING_SIZE*sizeof(struct statx));
+
+	// Error checks the mapping of the queues.
+	if (ring->submissionPointer == MAP_FAILED || ring->completionPointer == MAP_FAILED || ring->submissionEntries == MAP_FAILED || ring->results == NULL) {
+		destroyStatRing(ring);
+		return -1;
+	}
+
+	char *submission = ring->submissionPointer;
+	ring->submissionHead = (unsigned int *)(submission + params.sq_off.head);
+	ring->submissionTail = (unsigned int *)(submission + params.sq_off.tail);
+	ring->submissionMask = (unsigned int *)(submission + params.sq_off.ring_mask);
+	ring->submissionArray = (unsigned int *)(submission + params.sq_off.array);
+
+	char *completion = ring->completionPointer;
+	ring->completionHead = (unsigned int *)(completion + params.cq_off.head);
+	ring->completionTail = (unsigned int *)(completion + params.cq_off.tail);
+	ring->completionMask = (unsigned int *)(completion + params.cq_off.ring_mask);
+	ring->completionEntries = (struct io_uring_cqe *)(completion + params.cq_off.cqes);
+
+	return 0;
+}
+
+/**
+ * Destroys a stat ring (also works on a ring that was only partly set up).
+ *
+ * @param ring	The ring.
+ */
+void destroyStatRing(struct statRing *ring) {
+
+	if (ring->submissionEntries != NULL && ring->submissionEntries != MAP_FAILED) {
+		munmap(ring->submissionEntries, ring->entries*sizeof(struct io_uring_sqe));
+	}
+	if (ring->completionPointer != NULL && ring->completionPointer != MAP_FAILED && ring->completionPointer != ring->submissionPointer) {
+		munmap(ring->completionPointer, ring->completionSize);
+	}
+	if (ring->submissionPointer != NULL && ring->submissionPointer != MAP_FAILED) {
+		munmap(ring->submissionPointer, ring->submissionSize);
+	}
+
+	free(ring->results);
+	close(ring->fd);
+	return;
+}
+
+/**
+ * Gets the attributes of a batch of files with one statx call at a time.
+ *
+ * @param directoryFd	The directory that the names are relative to.
+ * @param names			The names of the files.
+ * @param amount		The amount of files.
+ * @param flags			The flags for getFileAttributes.
+ * @param attributes	The attributes of each file.
+ * @param errors		The error of each file (0 if there was none).
+ * @param statistics	The threads statistics (NULL if they are not kept).
+ */
+static void getBatchAttributesOneByOne(int directoryFd, char **names, int amount, int flags, struct fileAttributes *attributes, int *errors, struct scanStatistics *statistics) {
+
+	for (int i = 0; i < amount; i++) {
+		long long start = statistics != NULL ? getStatisticsTime() : 0;
+
+		errors[i] = 0;
+		if (getFileAttributes(directoryFd, names[i], flags, &attributes[i]) == -1) {
+			errors[i] = errno;
+		}
+
+		if (statistics != NULL) {
+			long long latency = getStatisticsTime() - start;
+			addStatLatency(statistics, latency);
+			statistics->statNanoseconds = statistics->statNanoseconds + latency;
+		}
+	}
+}
+
+/**
+ * Waits for the calls that the kernel still has from a batch that failed, so
+ * that none of them writes into a result buffer or ends up in the results of
+ * a later batch. If the ring can not even be waited on, the result buffers are
+ * left to the kernel (they are never freed).
+ *
+ * @param ring		The ring.
+ * @param inFlight	The amount of calls that the kernel has taken and not completed.
+ */
+static void drainStatRing(struct statRing *ring, unsigned int inFlight) {
+
+	while (inFlight > 0) {
+		unsigned int head = *ring->completionHead;
+		unsigned int tail = atomic_load_explicit((_Atomic unsigned int *)ring->completionTail, memory_order_acquire);
+		while (head != tail && inFlight > 0) {
+			head++;
+			inFlight--;
+		}
+		atomic_store_explicit((_Atomic unsigned int *)ring->completionHead, head, memory_order_release);
+
+		if (inFlight > 0 && syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			ring->results = NULL;
+			return;
+		}
+	}
+}
+
+/**
+ * Gets the attributes of a batch of files that are in the same directory. The
+ * statx calls are submitted to the ring as long as there is room in it and the
+ * results are collected as they complete, so up to the size of the ring are
+ * in flight at the same time.
+ *
+ * @param ring			The threads ring (NULL to use one statx call at a time, as is done once the ring has failed).
+ * @param directoryFd	The directory that the names are relative to.
+ * @param names			The names of the files.
+ * @param amount		The amount of files.
+ * @param flags			The flags for getFileAttributes.
+ * @param attributes	The attributes of each file.
+ * @param errors		The error of each file (0 if there was none).
+ * @param statistics	The threads statistics (NULL if they are not kept).
+ */
+void getBatchAttributes(struct statRing *ring, int directoryFd, char **names, int amount, int flags, struct fileAttributes *attributes, int *errors, struct scanStatistics *statistics) {
+
+	if (statistics != NULL) {
+		statistics->statCalls = statistics->statCalls + amount;
+	}
+
+	if (ring == NULL || ring->broken) {
+		getBatchAttributesOneByOne(directoryFd, names, amount, flags, attributes, errors, statistics);
+		return;
+	}
+
+	// The latency of a call is measured from when it is put in the ring until its result is collected.
+	long long batchStart = 0;
+	long long submitTimes[STAT_RING_SIZE];
+	if (statistics != NULL) {
+		batchStart = getStatisticsTime();
+	}
+
+	unsigned int mask = getStatxMask(flags);
+	int statxFlags = getStatxFlags(flags);
+
+	// The result buffers that are not in use by a call in flight.
+	int freeResults[STAT_RING_SIZE];
+	int freeResultAmount = STAT_RING_SIZE;
+	for (int i = 0; i < STAT_RING_SIZE; i++) {
+		freeResults[i] = i;
+	}
+
+	int submitted = 0;
+	int completed = 0;
+	unsigned int notEntered = 0;
+	while (completed < amount) {
+
+		// Fills the submission queue with as many statx calls as there is room for.
+		unsigned int tail = *ring->submissionTail;
+		unsigned int head = atomic_load_explicit((_Atomic unsigned int *)ring->submissionHead, memory_order_acquire);
+		while (submitted < amount && freeResultAmount > 0 && tail - head < ring->entries) {
+			unsigned int index = tail & *ring->submissionMask;
+			int result = freeResults[--freeResultAmount];
+			struct io_uring_sqe *entry = &ring->submissionEntries[index];
+			memset(entry, 0, sizeof(struct io_uring_sqe));
+			entry->opcode = IORING_OP_STATX;
+			entry->fd = directoryFd;
+			entry->addr = (unsigned long)names[submitted];
+			entry->len = mask;
+			entry->statx_flags = statxFlags;
+			entry->off = (unsigned long)&ring->results[result];
+
+			// The name and the result buffer that the call belongs to.
+			entry->user_data = ((unsigned long)result << 32) | (unsigned int)submitted;
+			ring->submissionArray[index] = index;
+			if (statistics != NULL) {
+				submitTimes[result] = getStatisticsTime();
+			}
+
+			tail++;
+			submitted++;
+			notEntered++;
+		}
+		atomic_store_explicit((_Atomic unsigned int *)ring->submissionTail, tail, memory_order_release);
+
+		// Submits the new calls and waits for at least one of them to complete.
+		int enterCheck = syscall(__NR_io_uring_enter, ring->fd, notEntered, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (enterCheck == -1 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+
+			// The ring is given up once the calls it still has are done, and the batch is checked again without it.
+			unsigned int notTaken = *ring->submissionTail - atomic_load_explicit((_Atomic unsigned int *)ring->submissionHead, memory_order_acquire);
+			ring->broken = 1;
+			drainStatRing(ring, submitted - completed - notTaken);
+			getBatchAttributesOneByOne(directoryFd, names, amount, flags, attributes, errors, statistics);
+			return;
+		}
+		if (enterCheck > 0) {
+			notEntered = notEntered - enterCheck;
+		}
+
+		// Collects the results of the calls that have completed.
+		head = *ring->completionHead;
+		tail = atomic_load_explicit((_Atomic unsigned int *)ring->completionTail, memory_order_acquire);
+		while (head != tail) {
+			struct io_uring_cqe *entry = &ring->completionEntries[head & *ring->completionMask];
+			int index = entry->user_data & 0xffffffff;
+			int result = entry->user_data >> 32;
+			errors[index] = 0;
+
+			if (entry->res < 0) {
+				errors[index] = -entry->res;
+			}
+
+			// If the file system did not give all the attributes they are taken from fstatat.
+			else if (copyStatxAttributes(&ring->results[result], mask, &attributes[index]) == -1) {
+				if (getFileAttributes(directoryFd, names[index], flags, &attributes[index]) == -1) {
+					errors[index] = errno;
+				}
+			}
+
+			if (statistics != NULL) {
+				addStatLatency(statistics, getStatisticsTime() - submitTimes[result]);
+			}
+
+			freeResults[freeResultAmount++] = result;
+			head++;
+			completed++;
+		}
+		atomic_store_explicit((_Atomic unsigned int *)ring->completionHead, head, memory_order_release);
+	}
+
+	if (statistics != NULL) {
+		statistics->statNanoseconds = statistics->statNanoseconds + getStatisticsTime() - batchStart;
+	}
+}
@@ -0,0 +1,58 @@
+/**
+ * This is the header file for the io_uring stat engine, which gets the
+ * attributes of a whole batch of files at once with many statx calls in flight.
+ *
+ * @file uring.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include "attributes.h"
+#include "stats.h"
+
+// The amount of statx calls that a ring keeps in flight at the most.
+#define STAT_RING_SIZE 256
+
+// A submission and completion ring that is owned by one thread.
+struct statRing {
+	int fd;
+	unsigned int entries;
+
+	// The submission queue.
+	void *submissionPointer;
+	size_t submissionSize;
+	unsigned int *submissionHead;
+	unsigned int *submissionTail;
+	unsigned int *submissionMask;
+	unsigned int *submissionArray;
+	struct io_uring_sqe *submissionEntries;
+
+	// The completion queue.
+	void *completionPointer;
+	size_t completionSize;
+	unsigned int *completionHead;
+	unsigned int *completionTail;
+	unsigned int *completionMask;
+	struct io_uring_cqe *completionEntries;
+
+	// The buffers that the kernel writes the statx results into.
+	struct statx *results;
+
+	// Set once the ring has failed, the batches after that are checked with one statx call at a time.
+	int broken;
+};
+
+// Creates a stat ring (returns -1 if io_uring or statx in io_uring is unavailable).
+int createStatRing(struct statRing *ring);
+
+// Destroys a stat ring.
+void destroyStatRing(struct statRing *ring);
+
+// Gets the attributes of a batch of files in the same directory (and counts the calls if the statistics are not NULL).
+void getBatchAttributes(struct statRing *ring, int directoryFd, char **names, int amount, int flags, struct fileAttributes *attributes, int *errors, struct scanStatistics *statistics);
+
+#endif
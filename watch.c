@@ -0,0 +1,1229 @@
+/**
+ * This is the implementation file for the watch mode. The files/directories
+ * are searched once into a tree of directories that is kept in memory, and
+ * every directory gets an inotify watch. An event only marks its directory as
+ * changed, and the changed directories are read again (just their own
+ * entries) when the totals are printed, so a directory that changes many
+ * times between two prints is only read once. The difference in its blocks
+ * is added to the directories above it, and subdirectories that have appeared
+ * or disappeared are searched or taken out of the tree.
+ *
+ * A file with more than one link only counts once in all the trees, for the
+ * first file/directory in the program arguments that has a link to it: each
+ * directory keeps its files with more than one link apart, and the watcher
+ * counts how many links to each such file each file/directory has, so the
+ * blocks move over when the links of one go away. A file that gets its second
+ * link after its own directory was read is not seen as such until something
+ * changes in that directory, since the new link only changes the file itself.
+ *
+ * If the event queue of a file/directory overflows, events have been lost and
+ * it is not known where, so that file/directory (and only that one) is
+ * searched again from scratch.
+ *
+ * @file watch.c
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#define _GNU_SOURCE
+#include "mdu.h"
+#include "search.h"
+#include "watch.h"
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+
+// The events that make a directory change size.
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+// The size of the buffer that the events are read into.
+#define EVENT_BUFFER_SIZE (64*1024)
+
+// The subdirectories that are found when a directory is read (kept until the directory has been compared).
+struct subdirectoryList {
+	struct nameList names;
+	struct fileAttributes *attributes;
+	int size;
+};
+
+// The files with more than one link that are found when a directory is read.
+struct watchedLinkList {
+	struct watchedLink *links;
+	int amount;
+	int size;
+};
+
+// A subdirectory name that is sorted together with where its attributes are.
+struct sortedName {
+	const char *name;
+	int index;
+};
+
+static struct watchedDirectory *scanWatchedDirectory(struct sizeWatcher *watcher, struct watchedOperand *operand, struct watchedDirectory *parent, int parentFd, const char *name, const struct fileAttributes *attributes);
+
+/**
+ * Allocates memory and exits the program if it fails.
+ *
+ * @param size		The amount of bytes.
+ * @return memory	The allocated memory.
+ */
+static void *allocateOrExit(size_t size) {
+
+	void *memory = malloc(size);
+
+	// Error checks the allocation of the memory.
+	if (memory == NULL) {
+		perror("Fatal Error:");
+		exit(EXIT_FAILURE);
+	}
+
+	return memory;
+}
+
+/**
+ * Gets the slot that a watch starts looking from.
+ *
+ * @param operand	The file/directory.
+ * @param watch		The watch.
+ * @return slot		The index of the slot.
+ */
+static size_t getWatchSlot(struct watchedOperand *operand, int watch) {
+	return ((unsigned int)watch*2654435761u) & (operand->slotAmount - 1);
+}
+
+/**
+ * Finds the directory of a watch.
+ *
+ * @param operand	The file/directory that the watch belongs to.
+ * @param watch		The watch.
+ * @return directory	The directory or NULL if the watch is not in the table.
+ */
+static struct watchedDirectory *findWatch(struct watchedOperand *operand, int watch) {
+
+	if (operand->slotAmount == 0) {
+		return NULL;
+	}
+
+	for (size_t slot = getWatchSlot(operand, watch); operand->slots[slot].directory != NULL; slot = (slot + 1) & (operand->slotAmount - 1)) {
+		if (operand->slots[slot].watch == watch) {
+			return operand->slots[slot].directory;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Sets the directory of a watch (the table grows when it gets half full).
+ *
+ * @param operand	The file/directory that the watch belongs to.
+ * @param watch		The watch.
+ * @param directory	The directory.
+ */
+static void setWatch(struct watchedOperand *operand, int watch, struct watchedDirectory *directory) {
+
+	if ((operand->usedSlots + 1)*2 > operand->slotAmount) {
+		struct watchSlot *oldSlots = operand->slots;
+		size_t oldAmount = operand->slotAmount;
+
+		operand->slotAmount = oldAmount == 0 ? 1024 : oldAmount*2;
+		operand->slots = allocateOrExit(operand->slotAmount*sizeof(struct watchSlot));
+		memset(operand->slots, 0, operand->slotAmount*sizeof(struct watchSlot));
+		operand->usedSlots = 0;
+
+		for (size_t slot = 0; slot < oldAmount; slot++) {
+			if (oldSlots[slot].directory != NULL) {
+				setWatch(operand, oldSlots[slot].watch, oldSlots[slot].directory);
+			}
+		}
+		free(oldSlots);
+	}
+
+	size_t slot = getWatchSlot(operand, watch);
+	while (operand->slots[slot].directory != NULL && operand->slots[slot].watch != watch) {
+		slot = (slot + 1) & (operand->slotAmount - 1);
+	}
+
+	if (operand->slots[slot].directory == NULL) {
+		operand->usedSlots++;
+	}
+	operand->slots[slot].watch = watch;
+	operand->slots[slot].directory = directory;
+}
+
+/**
+ * Takes a watch out of the table. The slots after it are moved back so that
+ * every watch can still be found from its own slot.
+ *
+ * @param operand	The file/directory that the watch belongs to.
+ * @param watch		The watch.
+ */
+static void removeWatch(struct watchedOperand *operand, int watch) {
+
+	if (operand->slotAmount == 0) {
+		return;
+	}
+
+	size_t mask = operand->slotAmount - 1;
+	size_t slot = getWatchSlot(operand, watch);
+	while (operand->slots[slot].directory != NULL && operand->slots[slot].watch != watch) {
+		slot = (slot + 1) & mask;
+	}
+	if (operand->slots[slot].directory == NULL) {
+		return;
+	}
+
+	// Moves back every following watch that would not be found past the emptied slot.
+	size_t empty = slot;
+	for (size_t next = (slot + 1) & mask; operand->slots[next].directory != NULL; next = (next + 1) & mask) {
+		size_t home = getWatchSlot(operand, operand->slots[next].watch);
+		if (((next - home) & mask) >= ((next - empty) & mask)) {
+			operand->slots[empty] = operand->slots[next];
+			empty = next;
+		}
+	}
+	operand->slots[empty].directory = NULL;
+	operand->usedSlots--;
+}
+
+/**
+ * Gets the slot that a file with more than one link starts looking from (the
+ * device and the inode are mixed so that inodes that follow each other end
+ * up far apart).
+ *
+ * @param watcher	The watcher.
+ * @param device	The device of the file.
+ * @param inode		The inode of the file.
+ * @return slot		The index of the slot.
+ */
+static size_t getLinkSlot(struct sizeWatcher *watcher, dev_t device, ino_t inode) {
+
+	uint64_t hash = ((uint64_t)inode ^ ((uint64_t)device*0x9e3779b97f4a7c15ULL))*0xbf58476d1ce4e5b9ULL;
+	return (hash ^ (hash >> 31)) & (watcher->linkSlotAmount - 1);
+}
+
+/**
+ * Finds the slot of a file with more than one link, or the empty slot where
+ * it belongs (the table grows when it gets half full).
+ *
+ * @param watcher	The watcher.
+ * @param device	The device of the file.
+ * @param inode		The inode of the file.
+ * @return slot		The index of the slot.
+ */
+static size_t findLinkSlot(struct sizeWatcher *watcher, dev_t device, ino_t inode) {
+
+	if ((watcher->usedLinkSlots + 1)*2 > watcher->linkSlotAmount) {
+		struct linkCount **oldSlots = watcher->linkSlots;
+		size_t oldAmount = watcher->linkSlotAmount;
+
+		watcher->linkSlotAmount = oldAmount == 0 ? 1024 : oldAmount*2;
+		watcher->linkSlots = allocateOrExit(watcher->linkSlotAmount*sizeof(struct linkCount*));
+		memset(watcher->linkSlots, 0, watcher->linkSlotAmount*sizeof(struct linkCount*));
+
+		for (size_t slot = 0; slot < oldAmount; slot++) {
+			if (oldSlots[slot] != NULL) {
+				size_t newSlot = getLinkSlot(watcher, oldSlots[slot]->device, oldSlots[slot]->inode);
+				while (watcher->linkSlots[newSlot] != NULL) {
+					newSlot = (newSlot + 1) & (watcher->linkSlotAmount - 1);
+				}
+				watcher->linkSlots[newSlot] = oldSlots[slot];
+			}
+		}
+		free(oldSlots);
+	}
+
+	size_t slot = getLinkSlot(watcher, device, inode);
+	while (watcher->linkSlots[slot] != NULL && (watcher->linkSlots[slot]->inode != inode || watcher->linkSlots[slot]->device != device)) {
+		slot = (slot + 1) & (watcher->linkSlotAmount - 1);
+	}
+	return slot;
+}
+
+/**
+ * Takes a file with more than one link out of the table and frees it. The
+ * slots after it are moved back so that every file can still be found from
+ * its own slot.
+ *
+ * @param watcher	The watcher.
+ * @param slot		The slot of the file.
+ */
+static void removeLinkSlot(struct sizeWatcher *watcher, size_t slot) {
+
+	size_t mask = watcher->linkSlotAmount - 1;
+	free(watcher->linkSlots[slot]);
+
+	// Moves back every following file that would not be found past the emptied slot.
+	size_t empty = slot;
+	for (size_t next = (slot + 1) & mask; watcher->linkSlots[next] != NULL; next = (next + 1) & mask) {
+		size_t home = getLinkSlot(watcher, watcher->linkSlots[next]->device, watcher->linkSlots[next]->inode);
+		if (((next - home) & mask) >= ((next - empty) & mask)) {
+			watcher->linkSlots[empty] = watcher->linkSlots[next];
+			empty = next;
+		}
+	}
+	watcher->linkSlots[empty] = NULL;
+	watcher->usedLinkSlots--;
+}
+
+/**
+ * Gets the file/directory in the program arguments that the blocks of a file
+ * with more than one link count for (the first one that has a link to it).
+ *
+ * @param watcher	The watcher.
+ * @param count		The file.
+ * @return operand	The index of the file/directory or -1 if none of them has a link to it.
+ */
+static int getLinkOwner(struct sizeWatcher *watcher, const struct linkCount *count) {
+
+	for (int index = 0; index < watcher->operandAmount; index++) {
+		if (count->counts[index] > 0) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Adds or takes away a link that a file/directory in the program arguments
+ * has to a file with more than one link. If the file/directory that the
+ * blocks of the file count for changes, the blocks are moved over to the new
+ * one, and a file without links in the watched trees is forgotten. The
+ * blocks of an added link are the newest ones, so a file that has grown
+ * changes the total it counts for.
+ *
+ * @param watcher	The watcher.
+ * @param operand	The index of the file/directory.
+ * @param link		The file.
+ * @param change	1 for a new link, -1 for one that is gone.
+ */
+static void countWatchedLink(struct sizeWatcher *watcher, int operand, const struct watchedLink *link, int change) {
+
+	size_t slot = findLinkSlot(watcher, link->device, link->inode);
+	struct linkCount *count = watcher->linkSlots[slot];
+	if (count == NULL) {
+		count = allocateOrExit(sizeof(struct linkCount) + watcher->operandAmount*sizeof(int));
+		memset(count, 0, sizeof(struct linkCount) + watcher->operandAmount*sizeof(int));
+		count->device = link->device;
+		count->inode = link->inode;
+		count->blocks = link->blocks;
+		watcher->linkSlots[slot] = count;
+		watcher->usedLinkSlots++;
+	}
+
+	int oldOwner = getLinkOwner(watcher, count);
+	if (change > 0 && oldOwner != -1) {
+		watcher->operands[oldOwner].linkedBlocks = watcher->operands[oldOwner].linkedBlocks + link->blocks - count->blocks;
+	}
+	if (change > 0) {
+		count->blocks = link->blocks;
+	}
+	count->counts[operand] = count->counts[operand] + change;
+
+	int newOwner = getLinkOwner(watcher, count);
+	if (newOwner != oldOwner) {
+		if (oldOwner != -1) {
+			watcher->operands[oldOwner].linkedBlocks = watcher->operands[oldOwner].linkedBlocks - count->blocks;
+		}
+		if (newOwner != -1) {
+			watcher->operands[newOwner].linkedBlocks = watcher->operands[newOwner].linkedBlocks + count->blocks;
+		}
+	}
+
+	if (newOwner == -1) {
+		removeLinkSlot(watcher, slot);
+	}
+}
+
+/**
+ * Adds a file with more than one link to a list.
+ *
+ * @param list			The list.
+ * @param attributes	The attributes of the file.
+ */
+static void addWatchedLink(struct watchedLinkList *list, const struct fileAttributes *attributes) {
+
+	if (list->amount == list->size) {
+		int newSize = list->size*2 + 16;
+		struct watchedLink *newLinks = realloc(list->links, newSize*sizeof(struct watchedLink));
+
+		// Error checks the reallocation of the files.
+		if (newLinks == NULL) {
+			perror("Fatal Error:");
+			exit(EXIT_FAILURE);
+		}
+
+		list->links = newLinks;
+		list->size = newSize;
+	}
+
+	list->links[list->amount].device = attributes->device;
+	list->links[list->amount].inode = attributes->inode;
+	list->links[list->amount].blocks = attributes->blocks;
+	list->amount++;
+}
+
+/**
+ * Replaces the files with more than one link of a directory with the ones
+ * that were just found in it. The new links are counted before the old ones
+ * are taken away, so a file that is still there keeps counting where it did.
+ *
+ * @param watcher	The watcher.
+ * @param directory	The directory.
+ * @param list		The files that were found (taken over by the directory).
+ */
+static void replaceWatchedLinks(struct sizeWatcher *watcher, struct watchedDirectory *directory, struct watchedLinkList *list) {
+
+	for (int index = 0; index < list->amount; index++) {
+		countWatchedLink(watcher, directory->operand, &list->links[index], 1);
+	}
+	for (int index = 0; index < directory->linkAmount; index++) {
+		countWatchedLink(watcher, directory->operand, &directory->links[index], -1);
+	}
+
+	free(directory->links);
+	directory->links = list->links;
+	directory->linkAmount = list->amount;
+}
+
+/**
+ * Gets the name and the parent of a watched directory (for getChainPath).
+ *
+ * @param link		The directory.
+ * @param parent	Where its parent is stored.
+ * @return name		The name of the directory.
+ */
+static const char *getWatchedName(const void *link, const void **parent) {
+
+	const struct watchedDirectory *directory = link;
+	*parent = directory->parent;
+	return directory->name;
+}
+
+/**
+ * Puts together the full path of a watched directory.
+ *
+ * @param directory	The directory.
+ * @return fullPath	The full path (has to be freed by the caller).
+ */
+static char *getWatchedPath(struct watchedDirectory *directory) {
+
+	char *fullPath = getChainPath(directory, getWatchedName);
+
+	// Error checks the allocation of the full path.
+	if (fullPath == NULL) {
+		perror("Fatal Error:");
+		exit(EXIT_FAILURE);
+	}
+
+	return fullPath;
+}
+
+/**
+ * Prints out that a watched directory can not be read (with the reason from errno).
+ *
+ * @param watcher	The watcher.
+ * @param directory	The directory.
+ */
+static void printWatchedError(struct sizeWatcher *watcher, struct watchedDirectory *directory) {
+
+	int error = errno;
+	char *fullPath = getWatchedPath(directory);
+
+	fprintf(stderr, "du: cannot read directory '%s': %s\n", fullPath, strerror(error));
+	free(fullPath);
+	watcher->exitValue = EXIT_FAILURE;
+}
+
+/**
+ * Opens a watched directory through its full path, or one level at a time if
+ * the path is too long.
+ *
+ * @param directory		The directory.
+ * @return directoryFd	The file descriptor of the directory or -1 if it can not be opened.
+ */
+static int openWatchedDirectory(struct watchedDirectory *directory) {
+
+	int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+	if (directory->parent == NULL) {
+		return openat(AT_FDCWD, directory->name, flags);
+	}
+
+	char *fullPath = getWatchedPath(directory);
+	int directoryFd = openat(AT_FDCWD, fullPath, flags);
+	free(fullPath);
+
+	if (directoryFd == -1 && errno == ENAMETOOLONG) {
+		int parentFd = openWatchedDirectory(directory->parent);
+		if (parentFd == -1) {
+			return -1;
+		}
+		directoryFd = openat(parentFd, directory->name, flags);
+		int error = errno;
+		close(parentFd);
+		errno = error;
+	}
+
+	return directoryFd;
+}
+
+/**
+ * Adds an inotify watch for an open directory. The watch is added through the
+ * file descriptor, so it is the directory that was opened even if the path
+ * has changed since (the path is only used if /proc is not there).
+ *
+ * @param watcher		The watcher.
+ * @param operand		The file/directory that the directory belongs to.
+ * @param directory		The directory.
+ * @param directoryFd	The file descriptor of the directory.
+ */
+static void addDirectoryWatch(struct sizeWatcher *watcher, struct watchedOperand *operand, struct watchedDirectory *directory, int directoryFd) {
+
+	if (operand->inotifyFd == -1) {
+		return;
+	}
+
+	char fdPath[64];
+	snprintf(fdPath, sizeof(fdPath), "/proc/self/fd/%d", directoryFd);
+	int watch = inotify_add_watch(operand->inotifyFd, fdPath, WATCH_EVENTS);
+
+	if (watch == -1 && errno == ENOENT) {
+		char *fullPath = getWatchedPath(directory);
+		watch = inotify_add_watch(operand->inotifyFd, fullPath, WATCH_EVENTS | IN_DONT_FOLLOW);
+		free(fullPath);
+	}
+
+	// The directory is still counted, but its changes are only seen if it is searched again.
+	if (watch == -1) {
+		if (watcher->watchWarning == 0) {
+			char *fullPath = getWatchedPath(directory);
+			fprintf(stderr, "mdu: cannot watch '%s': %s (see fs.inotify.max_user_watches)\n", fullPath, strerror(errno));
+			free(fullPath);
+			watcher->watchWarning = 1;
+		}
+		return;
+	}
+
+	// A directory that already has the watch has been moved here (its old place is taken out of the tree later).
+	struct watchedDirectory *oldDirectory = findWatch(operand, watch);
+	if (oldDirectory != NULL) {
+		oldDirectory->watch = -1;
+	}
+
+	setWatch(operand, watch, directory);
+	directory->watch = watch;
+}
+
+/**
+ * Creates a watched directory that only counts its own blocks so far.
+ *
+ * @param parent		The parent directory (NULL for a directory in the program arguments).
+ * @param name			The name of the directory.
+ * @param operand		The index of the file/directory in the program arguments.
+ * @param attributes	The attributes of the directory.
+ * @return directory	The directory.
+ */
+static struct watchedDirectory *createWatchedDirectory(struct watchedDirectory *parent, const char *name, int operand, const struct fileAttributes *attributes) {
+
+	size_t nameLength = strlen(name);
+	struct watchedDirectory *directory = allocateOrExit(sizeof(struct watchedDirectory) + nameLength + 1);
+
+	directory->parent = parent;
+	directory->children = NULL;
+	directory->next = NULL;
+	directory->device = attributes->device;
+	directory->inode = attributes->inode;
+	directory->ownBlocks = attributes->blocks;
+	directory->totalBlocks = attributes->blocks;
+	directory->links = NULL;
+	directory->linkAmount = 0;
+	directory->watch = -1;
+	directory->operand = operand;
+	directory->dirty = 0;
+	directory->removed = 0;
+	memcpy(directory->name, name, nameLength + 1);
+
+	return directory;
+}
+
+/**
+ * Takes a directory and its subdirectories out of the tree and removes their
+ * watches and their links to files with more than one link. The directories
+ * are only freed once all the changes have been applied, since they might
+ * still be waiting to be read again.
+ *
+ * @param watcher	The watcher.
+ * @param operand	The file/directory that the directory belongs to.
+ * @param directory	The directory.
+ */
+static void removeWatchedDirectory(struct sizeWatcher *watcher, struct watchedOperand *operand, struct watchedDirectory *directory) {
+
+	struct watchedDirectory *child = directory->children;
+	while (child != NULL) {
+		struct watchedDirectory *next = child->next;
+		removeWatchedDirectory(watcher, operand, child);
+		child = next;
+	}
+
+	if (directory->watch != -1 && findWatch(operand, directory->watch) == directory) {
+		inotify_rm_watch(operand->inotifyFd, directory->watch);
+		removeWatch(operand, directory->watch);
+	}
+
+	struct watchedLinkList noLinks = {NULL, 0, 0};
+	replaceWatchedLinks(watcher, directory, &noLinks);
+
+	directory->removed = 1;
+	directory->children = NULL;
+	directory->next = watcher->removedDirectories;
+	watcher->removedDirectories = directory;
+}
+
+/**
+ * Adds a subdirectory to a list of subdirectories.
+ *
+ * @param list			The list.
+ * @param name			The name of the subdirectory.
+ * @param attributes	The attributes of the subdirectory.
+ */
+static void addSubdirectory(struct subdirectoryList *list, const char *name, const struct fileAttributes *attributes) {
+
+	if (list->names.amount == list->size) {
+		int newSize = list->size*2 + 16;
+		struct fileAttributes *newAttributes = realloc(list->attributes, newSize*sizeof(struct fileAttributes));
+
+		// Error checks the reallocation of the attributes.
+		if (newAttributes == NULL) {
+			perror("Fatal Error:");
+			exit(EXIT_FAILURE);
+		}
+
+		list->attributes = newAttributes;
+		list->size = newSize;
+	}
+
+	list->attributes[list->names.amount] = *attributes;
+
+	// Error checks the adding of the name.
+	if (addName(&list->names, name, attributes->blocks) == -1) {
+		perror("Fatal Error:");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/**
+ * Compares two subdirectory names (for qsort).
+ *
+ * @param first		The first name.
+ * @param second	The second name.
+ * @return order	Less than, equal to or greater than zero.
+ */
+static int compareSortedNames(const void *first, const void *second) {
+	return strcmp(((const struct sortedName *)first)->name, ((const struct sortedName *)second)->name);
+}
+
+/**
+ * Reads the entries of a directory again and compares its subdirectories with
+ * the ones in the tree (both sorted by name). New subdirectories are searched,
+ * the ones that are gone are taken out of the tree and the ones that are still
+ * there are left as they are (their own changes are seen by their own watches).
+ *
+ * @param watcher		The watcher.
+ * @param operand		The file/directory that the directory belongs to.
+ * @param directory		The directory.
+ * @param directoryFd	The file descriptor of the directory.
+ * @return difference	How much the total of the directory has changed.
+ */
+static blkcnt_t refreshWatchedDirectory(struct sizeWatcher *watcher, struct watchedOperand *operand, struct watchedDirectory *directory, int directoryFd) {
+
+	struct fileAttributes directoryAttributes;
+	int flags = watcher->attributeFlags | ATTRIBUTES_INODE;
+	if (getFileAttributes(directoryFd, "", flags | ATTRIBUTES_EMPTY_PATH, &directoryAttributes) == -1) {
+		printWatchedError(watcher, directory);
+		return 0;
+	}
+
+	// A different directory has taken its place (the parent has changed as well and is read again).
+	if (directoryAttributes.inode != directory->inode || directoryAttributes.device != directory->device) {
+		return 0;
+	}
+
+	struct subdirectoryList subdirectories;
+	memset(&subdirectories, 0, sizeof(subdirectories));
+	struct watchedLinkList links = {NULL, 0, 0};
+	blkcnt_t ownBlocks = directoryAttributes.blocks;
+
+	struct entryBatch *batch = &watcher->reader.batch;
+	int batchCheck;
+	// Goes through the directory one batch of entries at a time.
+	while ((batchCheck = readEntryBatch(&watcher->reader, directoryFd)) > 0) {
+		getBatchAttributes(watcher->ringPointer, directoryFd, batch->names, batch->amount, flags, batch->attributes, batch->errors, NULL);
+
+		for (int index = 0; index < batch->amount; index++) {
+
+			// A file that has been removed after the directory was read is left out (its removal is another event).
+			if (batch->errors[index] == ENOENT) {
+				continue;
+			}
+			if (batch->errors[index] != 0) {
+				errno = batch->errors[index];
+				perror("stat");
+				watcher->exitValue = EXIT_FAILURE;
+				continue;
+			}
+
+			if (S_ISDIR(batch->attributes[index].mode)) {
+				addSubdirectory(&subdirectories, batch->names[index], &batch->attributes[index]);
+			}
+
+			// A file with more than one link only counts once in all the trees (unless every link is counted).
+			else if (watcher->options->countLinks == 0 && batch->attributes[index].links > 1) {
+				addWatchedLink(&links, &batch->attributes[index]);
+			}
+			else {
+				ownBlocks = batch->attributes[index].blocks + ownBlocks;
+			}
+		}
+	}
+
+	// The entries that could be read are still counted.
+	if (batchCheck == -1) {
+		printWatchedError(watcher, directory);
+	}
+
+	// Sorts the subdirectories by name, the same way as the ones in the tree.
+	int amount = subdirectories.names.amount;
+	struct sortedName *sorted = allocateOrExit((amount + 1)*sizeof(struct sortedName));
+	const char *name = subdirectories.names.names;
+	for (int index = 0; index < amount; index++) {
+		sorted[index].name = name;
+		sorted[index].index = index;
+		name = name + strlen(name) + 1;
+	}
+	qsort(sorted, amount, sizeof(struct sortedName), compareSortedNames);
+
+	blkcnt_t difference = ownBlocks - directory->ownBlocks;
+	directory->ownBlocks = ownBlocks;
+	replaceWatchedLinks(watcher, directory, &links);
+
+	// Goes through the old and the new subdirectories side by side and builds the new list.
+	struct watchedDirectory *oldChild = directory->children;
+	struct watchedDirectory *newChildren = NULL;
+	struct watchedDirectory **tail = &newChildren;
+	int index = 0;
+	while (oldChild != NULL || index < amount) {
+		int order;
+		if (oldChild == NULL) {
+			order = 1;
+		}
+		else if (index == amount) {
+			order = -1;
+		}
+		else {
+			order = strcmp(oldChild->name, sorted[index].name);
+		}
+
+		const struct fileAttributes *attributes = NULL;
+		if (index < amount) {
+			attributes = &subdirectories.attributes[sorted[index].index];
+		}
+
+		// The subdirectory is still there (and is still the same directory).
+		if (order == 0 && oldChild->inode == attributes->inode && oldChild->device == attributes->device) {
+			struct watchedDirectory *next = oldChild->next;
+			*tail = oldChild;
+			tail = &oldChild->next;
+			oldChild = next;
+			index++;
+			continue;
+		}
+
+		// The subdirectory is gone (or has been replaced by another one with the same name).
+		if (order <= 0) {
+			struct watchedDirectory *next = oldChild->next;
+			difference = difference - oldChild->totalBlocks;
+			removeWatchedDirectory(watcher, operand, oldChild);
+			oldChild = next;
+		}
+
+		// The subdirectory is new.
+		if (order >= 0) {
+			struct watchedDirectory *child = scanWatchedDirectory(watcher, operand, directory, directoryFd, sorted[index].name, attributes);
+			if (child != NULL) {
+				difference = difference + child->totalBlocks;
+				*tail = child;
+				tail = &child->next;
+			}
+			index++;
+		}
+	}
+	*tail = NULL;
+	directory->children = newChildren;
+	directory->totalBlocks = directory->totalBlocks + difference;
+
+	free(sorted);
+	free(subdirectories.attributes);
+	freeNameList(&subdirectories.names);
+
+	return difference;
+}
+
+/**
+ * Searches a directory that is not in the tree yet: the directory is opened,
+ * watched and then read (the watch is added first, so that nothing that
+ * changes while it is read is missed).
+ *
+ * @param watcher		The watcher.
+ * @param operand		The file/directory that the directory belongs to.
+ * @param parent		The parent directory (NULL for a directory in the program arguments).
+ * @param parentFd		The file descriptor of the parent (or AT_FDCWD).
+ * @param name			The name of the directory relative to the parent.
+ * @param attributes	The attributes of the directory.
+ * @return directory	The directory or NULL if it no longer exists.
+ */
+static struct watchedDirectory *scanWatchedDirectory(struct sizeWatcher *watcher, struct watchedOperand *operand, struct watchedDirectory *parent, int parentFd, const char *name, const struct fileAttributes *attributes) {
+
+	int directoryFd = openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (directoryFd == -1 && (errno == ENOENT || errno == ENOTDIR)) {
+		return NULL;
+	}
+
+	struct watchedDirectory *directory = createWatchedDirectory(parent, name, operand - watcher->operands, attributes);
+
+	// The directory still counts with its own blocks.
+	if (directoryFd == -1) {
+		printWatchedError(watcher, directory);
+		return directory;
+	}
+
+	addDirectoryWatch(watcher, operand, directory, directoryFd);
+	refreshWatchedDirectory(watcher, operand, directory, directoryFd);
+	close(directoryFd);
+
+	return directory;
+}
+
+/**
+ * Forgets everything about a file/directory and checks it again (the whole
+ * tree is searched again with a new inotify instance if it is a directory).
+ *
+ * @param watcher	The watcher.
+ * @param operand	The file/directory.
+ */
+static void rescanOperand(struct sizeWatcher *watcher, struct watchedOperand *operand) {
+
+	// Closing the inotify instance removes all of its watches at once.
+	if (operand->inotifyFd != -1) {
+		close(operand->inotifyFd);
+		operand->inotifyFd = -1;
+	}
+	if (operand->slotAmount > 0) {
+		memset(operand->slots, 0, operand->slotAmount*sizeof(struct watchSlot));
+		operand->usedSlots = 0;
+	}
+	if (operand->root != NULL) {
+		removeWatchedDirectory(watcher, operand, operand->root);
+		operand->root = NULL;
+	}
+	operand->needsRescan = 0;
+
+	// The file that the file/directory was the last time is let go of once it has been checked again.
+	struct watchedLink oldLink = operand->fileLink;
+	operand->fileLink.inode = 0;
+	operand->fileBlocks = 0;
+
+	// A file/directory that does not exist is checked again the next time (the error is only printed once).
+	struct fileAttributes fileStat;
+	if (getFileAttributes(AT_FDCWD, operand->path, watcher->attributeFlags | ATTRIBUTES_INODE, &fileStat) == -1) {
+		if (operand->exists == 1) {
+			fprintf(stderr, "du: cannot access '%s': %s\n", operand->path, strerror(errno));
+			watcher->exitValue = EXIT_FAILURE;
+		}
+		operand->exists = 0;
+	}
+	else {
+		operand->exists = 1;
+	}
+
+	// A file with more than one link counts the same way as one in a directory.
+	if (operand->exists == 1 && !S_ISDIR(fileStat.mode)) {
+		if (watcher->options->countLinks == 0 && fileStat.links > 1) {
+			operand->fileLink.device = fileStat.device;
+			operand->fileLink.inode = fileStat.inode;
+			operand->fileLink.blocks = fileStat.blocks;
+			countWatchedLink(watcher, operand - watcher->operands, &operand->fileLink, 1);
+		}
+		else {
+			operand->fileBlocks = fileStat.blocks;
+		}
+	}
+	if (oldLink.inode != 0) {
+		countWatchedLink(watcher, operand - watcher->operands, &oldLink, -1);
+	}
+	if (operand->exists == 0 || !S_ISDIR(fileStat.mode)) {
+		return;
+	}
+
+	// Without an inotify instance the directory is searched again every time.
+	operand->inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (operand->inotifyFd == -1) {
+		if (watcher->watchWarning == 0) {
+			fprintf(stderr, "mdu: cannot watch '%s': %s (see fs.inotify.max_user_instances)\n", operand->path, strerror(errno));
+			watcher->watchWarning = 1;
+		}
+		operand->needsRescan = 1;
+	}
+
+	operand->root = scanWatchedDirectory(watcher, operand, NULL, AT_FDCWD, operand->path, &fileStat);
+	if (operand->root == NULL) {
+		operand->exists = 0;
+	}
+}
+
+/**
+ * Marks a directory as changed (it is read again before the totals are printed).
+ *
+ * @param watcher	The watcher.
+ * @param directory	The directory.
+ */
+static void markDirectory(struct sizeWatcher *watcher, struct watchedDirectory *directory) {
+
+	if (directory->dirty == 1) {
+		return;
+	}
+
+	if (watcher->dirtyAmount == watcher->dirtySize) {
+		size_t newSize = watcher->dirtySize*2 + 64;
+		struct watchedDirectory **newDirectories = realloc(watcher->dirtyDirectories, newSize*sizeof(struct watchedDirectory*));
+
+		// Error checks the reallocation of the changed directories.
+		if (newDirectories == NULL) {
+			perror("Fatal Error:");
+			exit(EXIT_FAILURE);
+		}
+
+		watcher->dirtyDirectories = newDirectories;
+		watcher->dirtySize = newSize;
+	}
+
+	directory->dirty = 1;
+	watcher->dirtyDirectories[watcher->dirtyAmount] = directory;
+	watcher->dirtyAmount++;
+}
+
+/**
+ * Reads the events that are waiting on a file/directories inotify instance
+ * and marks the directories that they happened in.
+ *
+ * @param watcher	The watcher.
+ * @param operand	The file/directory.
+ */
+static void readWatchEvents(struct sizeWatcher *watcher, struct watchedOperand *operand) {
+
+	char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+	while (operand->inotifyFd != -1) {
+		ssize_t length = read(operand->inotifyFd, buffer, sizeof(buffer));
+		if (length <= 0) {
+			break;
+		}
+
+		for (char *position = buffer; position < buffer + length; ) {
+			const struct inotify_event *event = (const struct inotify_event *)position;
+			position = position + sizeof(struct inotify_event) + event->len;
+
+			// Events have been lost, so the whole tree is searched again (the rest of the queue is of no use).
+			if (event->mask & IN_Q_OVERFLOW) {
+				close(operand->inotifyFd);
+				operand->inotifyFd = -1;
+				operand->needsRescan = 1;
+				break;
+			}
+
+			struct watchedDirectory *directory = findWatch(operand, event->wd);
+			if (directory == NULL) {
+				continue;
+			}
+
+			// The watch is gone (the directory was removed or unmounted), so the parent is read again.
+			if (event->mask & IN_IGNORED) {
+				removeWatch(operand, event->wd);
+				directory->watch = -1;
+				if (directory->parent == NULL) {
+					operand->needsRescan = 1;
+				}
+				else {
+					markDirectory(watcher, directory->parent);
+				}
+			}
+
+			// The top directory is no longer at its path (the other directories are handled by their parents).
+			else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+				if (directory->parent == NULL) {
+					operand->needsRescan = 1;
+				}
+			}
+
+			else {
+				markDirectory(watcher, directory);
+			}
+		}
+	}
+}
+
+/**
+ * Frees the directories that have been taken out of the tree.
+ *
+ * @param watcher	The watcher.
+ */
+static void freeRemovedDirectories(struct sizeWatcher *watcher) {
+
+	while (watcher->removedDirectories != NULL) {
+		struct watchedDirectory *next = watcher->removedDirectories->next;
+		free(watcher->removedDirectories);
+		watcher->removedDirectories = next;
+	}
+}
+
+/**
+ * Applies the changes since the totals were last printed: the files/directories
+ * that have lost events are searched again, the files are checked again and
+ * each changed directory is read again, with the difference in its total
+ * added to all the directories above it.
+ *
+ * @param watcher	The watcher.
+ */
+static void applyWatchChanges(struct sizeWatcher *watcher) {
+
+	for (int index = 0; index < watcher->operandAmount; index++) {
+		struct watchedOperand *operand = &watcher->operands[index];
+		if (operand->needsRescan == 1 || operand->root == NULL) {
+			rescanOperand(watcher, operand);
+		}
+	}
+
+	for (size_t index = 0; index < watcher->dirtyAmount; index++) {
+		struct watchedDirectory *directory = watcher->dirtyDirectories[index];
+		directory->dirty = 0;
+		if (directory->removed == 1) {
+			continue;
+		}
+
+		// A directory that can't be found has been moved or removed (which its parent has an event for).
+		int directoryFd = openWatchedDirectory(directory);
+		if (directoryFd == -1) {
+			if (errno != ENOENT && errno != ENOTDIR) {
+				printWatchedError(watcher, directory);
+			}
+			continue;
+		}
+
+		blkcnt_t difference = refreshWatchedDirectory(watcher, &watcher->operands[directory->operand], directory, directoryFd);
+		close(directoryFd);
+
+		for (struct watchedDirectory *parent = directory->parent; parent != NULL; parent = parent->parent) {
+			parent->totalBlocks = parent->totalBlocks + difference;
+		}
+	}
+	watcher->dirtyAmount = 0;
+
+	freeRemovedDirectories(watcher);
+}
+
+/**
+ * Prints out the totals of the files/directories (in the order they were given)
+ * through the output writer. Every print after the first one starts with an
+ * empty record (an empty line in text, a lone NUL with -0 and nothing in JSON,
+ * where each record stands on its own).
+ *
+ * @param watcher	The watcher.
+ * @param first		If it is the first print.
+ */
+static void printWatchedTotals(struct sizeWatcher *watcher, int first) {
+
+	if (first == 0) {
+		writeHeadingRecord(watcher->writer, watcher->buffer, "");
+	}
+
+	for (int index = 0; index < watcher->operandAmount; index++) {
+		struct watchedOperand *operand = &watcher->operands[index];
+		if (operand->exists == 0) {
+			continue;
+		}
+
+		blkcnt_t blockAmount = operand->fileBlocks + operand->linkedBlocks;
+		if (operand->root != NULL) {
+			blockAmount = operand->root->totalBlocks + operand->linkedBlocks;
+		}
+		writeUsageRecord(watcher->writer, watcher->buffer, operand->path, blockAmount, operand->root != NULL);
+	}
+
+	flushOutputBuffer(watcher->writer, watcher->buffer);
+}
+
+/**
+ * Gets the time from a clock that never jumps.
+ *
+ * @return seconds	The time in seconds.
+ */
+static double getMonotonicTime(void) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/**
+ * Searches the files/directories once and then keeps their totals up to date
+ * until the program is interrupted. The totals are printed every interval and
+ * whenever the program gets SIGUSR1.
+ *
+ * @param files			The list of files/directories.
+ * @param fileAmount	The amount of files/directories.
+ * @param options		The options for the search.
+ * @param writer		The output writer that the totals are written through.
+ * @param buffer		The buffer that the totals are put together in.
+ * @return exitValue	The exit value of the program.
+ */
+int watchSizeOnDisk(char **files, int fileAmount, struct scanOptions *options, struct outputWriter *writer, struct outputBuffer *buffer) {
+
+	struct sizeWatcher watcher;
+	memset(&watcher, 0, sizeof(watcher));
+	watcher.options = options;
+	watcher.writer = writer;
+	watcher.buffer = buffer;
+	watcher.attributeFlags = getAttributeFlags(options);
+	watcher.operandAmount = fileAmount;
+	watcher.exitValue = EXIT_SUCCESS;
+
+	// Error checks the creation of the directory reader.
+	if (createDirectoryReader(&watcher.reader) == -1) {
+		perror("Fatal Error:");
+		exit(EXIT_FAILURE);
+	}
+	watcher.ringPointer = NULL;
+	if (options->ioUring == 1 && createStatRing(&watcher.ring) == 0) {
+		watcher.ringPointer = &watcher.ring;
+	}
+
+	// The signals are read from a file descriptor, so that they can be waited for together with the events.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+	int signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	// Error checks the creation of the signal file descriptor.
+	if (signalFd == -1) {
+		perror("signalfd");
+		exit(EXIT_FAILURE);
+	}
+
+	// Searches every file/directory for the first time.
+	watcher.operands = allocateOrExit((fileAmount + 1)*sizeof(struct watchedOperand));
+	memset(watcher.operands, 0, (fileAmount + 1)*sizeof(struct watchedOperand));
+	for (int index = 0; index < fileAmount; index++) {
+		watcher.operands[index].path = files[index];
+		watcher.operands[index].inotifyFd = -1;
+		watcher.operands[index].exists = 1;
+		rescanOperand(&watcher, &watcher.operands[index]);
+	}
+	applyWatchChanges(&watcher);
+	printWatchedTotals(&watcher, 1);
+
+	struct pollfd *pollFds = allocateOrExit((fileAmount + 1)*sizeof(struct pollfd));
+	double nextPrint = getMonotonicTime() + options->watchInterval;
+	int running = 1;
+
+	// Loop that will iterate until the program gets SIGINT or SIGTERM.
+	while (running == 1) {
+
+		// Waits for events, a signal or the next print (a closed inotify instance is left out by poll).
+		pollFds[0].fd = signalFd;
+		pollFds[0].events = POLLIN;
+		for (int index = 0; index < fileAmount; index++) {
+			pollFds[index + 1].fd = watcher.operands[index].inotifyFd;
+			pollFds[index + 1].events = POLLIN;
+		}
+		double timeLeft = nextPrint - getMonotonicTime();
+		int timeout = timeLeft > 0 ? (int)(timeLeft*1000) + 1 : 0;
+		if (poll(pollFds, fileAmount + 1, timeout) == -1 && errno != EINTR) {
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+
+		int printNow = 0;
+		struct signalfd_siginfo signalInfo;
+		while (read(signalFd, &signalInfo, sizeof(signalInfo)) == sizeof(signalInfo)) {
+			if (signalInfo.ssi_signo == SIGUSR1) {
+				printNow = 1;
+			}
+			else {
+				running = 0;
+			}
+		}
+
+		for (int index = 0; index < fileAmount; index++) {
+			if (pollFds[index + 1].fd != -1 && (pollFds[index + 1].revents & POLLIN)) {
+				readWatchEvents(&watcher, &watcher.operands[index]);
+			}
+		}
+
+		// Prints at the interval (the next print is planned from now if the program has fallen behind).
+		double now = getMonotonicTime();
+		if (now >= nextPrint) {
+			printNow = 1;
+			nextPrint = nextPrint + options->watchInterval;
+			if (nextPrint <= now) {
+				nextPrint = now + options->watchInterval;
+			}
+		}
+
+		if (printNow == 1 && running == 1) {
+			applyWatchChanges(&watcher);
+			printWatchedTotals(&watcher, 0);
+		}
+
+		// A print that could not be written ends the watch (the program reports the error).
+		if (writer->error != 0) {
+			running = 0;
+		}
+	}
+
+	// Closes the inotify instances (which removes all the watches) and frees the trees.
+	for (int index = 0; index < fileAmount; index++) {
+		struct watchedOperand *operand = &watcher.operands[index];
+		if (operand->inotifyFd != -1) {
+			close(operand->inotifyFd);
+		}
+		free(operand->slots);
+		operand->slots = NULL;
+		operand->slotAmount = 0;
+		if (operand->root != NULL) {
+			removeWatchedDirectory(&watcher, operand, operand->root);
+		}
+	}
+	freeRemovedDirectories(&watcher);
+
+	// Only the files in the program arguments are left in the link counts.
+	for (size_t slot = 0; slot < watcher.linkSlotAmount; slot++) {
+		free(watcher.linkSlots[slot]);
+	}
+	free(watcher.linkSlots);
+
+	close(signalFd);
+	free(pollFds);
+	free(watcher.dirtyDirectories);
+	free(watcher.operands);
+	freeDirectoryReader(&watcher.reader);
+	if (watcher.ringPointer != NULL) {
+		destroyStatRing(watcher.ringPointer);
+	}
+	free(files);
+
+	return watcher.exitValue;
+}
@@ -0,0 +1,157 @@
+/**
+ * This is the header file for the watch mode, which searches the files and
+ * directories once and then keeps their totals up to date from the changes
+ * that inotify reports, instead of searching everything again.
+ *
+ * @file watch.h
+ * @author Jakob Mukka
+ * @date 2023-03-10
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <sys/types.h>
+#include "attributes.h"
+#include "entries.h"
+#include "uring.h"
+#include "output.h"
+
+// A file with more than one link in a watched directory (or a file in the program arguments).
+struct watchedLink {
+	dev_t device;
+	ino_t inode;
+	blkcnt_t blocks;
+};
+
+/**
+ * A file with more than one link in the watched trees, with the amount of
+ * links to it that each file/directory in the program arguments has. Its
+ * blocks count for the first file/directory that has a link to it, the same
+ * way as in a search that counts every file only once.
+ */
+struct linkCount {
+	dev_t device;
+	ino_t inode;
+	blkcnt_t blocks;
+	int counts[];
+};
+
+/**
+ * A directory that is kept in memory while it is watched. The total of a
+ * directory is its own blocks and the totals of its subdirectories, so a
+ * change in one directory only has to be added to the directories above it.
+ */
+struct watchedDirectory {
+	struct watchedDirectory *parent;
+
+	// The first subdirectory and the next directory with the same parent (sorted by name).
+	struct watchedDirectory *children;
+	struct watchedDirectory *next;
+
+	// The directory is only read again if it is still the same directory.
+	dev_t device;
+	ino_t inode;
+
+	// The blocks of the directory itself and of the files in it that are not directories (except the files with more than one link, unless every link is counted).
+	blkcnt_t ownBlocks;
+
+	// The files with more than one link in the directory (counted through the link counts of the watcher).
+	struct watchedLink *links;
+	int linkAmount;
+
+	// The own blocks and the totals of all the subdirectories.
+	blkcnt_t totalBlocks;
+
+	// The inotify watch of the directory (-1 if it is not watched).
+	int watch;
+
+	// The index of the file/directory in the program arguments that the directory belongs to.
+	int operand;
+
+	// Set while the directory is waiting to be read again, and once it has been taken out of the tree.
+	char dirty;
+	char removed;
+
+	// The name of the directory relative to the parent (the path from the program arguments for the top one).
+	char name[];
+};
+
+// A slot in the table that finds the directory of an inotify watch.
+struct watchSlot {
+	int watch;
+	struct watchedDirectory *directory;
+};
+
+/**
+ * A file/directory from the program arguments. Each one has an inotify instance
+ * of its own, so that if its event queue overflows only its own tree has to be
+ * searched again.
+ */
+struct watchedOperand {
+	char *path;
+	int inotifyFd;
+
+	// The directories of the watches (open addressing, the size is a power of two).
+	struct watchSlot *slots;
+	size_t slotAmount;
+	size_t usedSlots;
+
+	// The top directory (NULL if the file/directory is not a directory or does not exist).
+	struct watchedDirectory *root;
+
+	// The blocks of a file that is not a directory (checked again every time the totals are printed).
+	blkcnt_t fileBlocks;
+
+	// The file if it is not a directory and has more than one link (the inode is 0 otherwise).
+	struct watchedLink fileLink;
+
+	// The blocks of the files with more than one link that count for the file/directory.
+	blkcnt_t linkedBlocks;
+
+	// If the file/directory could be checked the last time.
+	int exists;
+
+	// If the whole tree has to be searched again (events have been lost).
+	int needsRescan;
+};
+
+// Everything that the watch mode keeps between the events.
+struct sizeWatcher {
+	struct scanOptions *options;
+	int attributeFlags;
+	struct watchedOperand *operands;
+	int operandAmount;
+
+	// The directory reader and the io_uring ring (NULL if it is not used).
+	struct directoryReader reader;
+	struct statRing ring;
+	struct statRing *ringPointer;
+
+	// The directories that have changed since the totals were printed.
+	struct watchedDirectory **dirtyDirectories;
+	size_t dirtyAmount;
+	size_t dirtySize;
+
+	// The files with more than one link (open addressing, the size is a power of two, and no slots at all if every link is counted).
+	struct linkCount **linkSlots;
+	size_t linkSlotAmount;
+	size_t usedLinkSlots;
+
+	// The directories that have been taken out of the tree (freed once the changes have been applied).
+	struct watchedDirectory *removedDirectories;
+
+	// If a warning about a directory that can not be watched has been printed.
+	int watchWarning;
+
+	// Where the totals are written (in the format of the program) and the buffer they are put together in.
+	struct outputWriter *writer;
+	struct outputBuffer *buffer;
+
+	int exitValue;
+};
+
+// Searches the files/directories and then prints their totals whenever they are asked for or the interval has passed.
+int watchSizeOnDisk(char **files, int fileAmount, struct scanOptions *options, struct outputWriter *writer, struct outputBuffer *buffer);
+
+#endif